@@ -0,0 +1,158 @@
+/* Measures the delimiter scanners on short lines, like wmii events, and on
+ * long ones, against finding one line at a time with memchr() as the
+ * modules used to.  Each scanner is checked against memchr() first. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lscan.h"
+
+#define BUF_SIZE (32 << 20)
+#define ROUNDS 8
+
+static const char *names[] = { "avx2", "sse2", "scalar" };
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* fills buf with lines of about avg bytes, and returns how many */
+static size_t fill (char *buf, size_t size, size_t avg)
+{
+	static const char words[] = "ClientFocus 0x1a00004 FocusTag 3 "
+		"LeftBarClick 1 view UnresponsiveClient ";
+	size_t i = 0, lines = 0;
+
+	while (i < size) {
+		size_t len = avg / 2 + rand () % (avg + 1);
+		size_t j;
+		for (j = 0; j < len && i < size - 1; j++, i++)
+			buf[i] = words[(i + j) % (sizeof (words) - 1)];
+		buf[i++] = '\n';
+		lines++;
+	}
+	return lines;
+}
+
+/* the old way: one memchr() per line */
+static size_t count_memchr (const char *buf, size_t size)
+{
+	const char *p = buf, *e = buf + size;
+	size_t n = 0;
+
+	while ((p = memchr (p, '\n', e - p))) {
+		n++;
+		p++;
+	}
+	return n;
+}
+
+static size_t count_cursor (const char *buf, size_t size)
+{
+	struct lscan_cursor c;
+	size_t pos = 0, n = 0;
+	long d;
+
+	lscan_reset (&c);
+	while ((d = lscan_find (&c, buf, pos, size, '\n')) >= 0) {
+		n++;
+		pos = d + 1;
+	}
+	return n;
+}
+
+static int check (const char *name)
+{
+	char buf[4096];
+	uint32_t offs[LSCAN_BATCH];
+	int round;
+
+	for (round = 0; round < 2000; round++) {
+		size_t len = rand () % sizeof (buf), start = len ? rand () % len : 0;
+		size_t i, n, scanned, want = start;
+
+		for (i = 0; i < len; i++)
+			buf[i] = rand () % 8 ? 'a' + rand () % 26 : '\n';
+
+		while (want < len) {
+			n = lscan_delims (buf, want, len, '\n', offs,
+					1 + rand () % LSCAN_BATCH, &scanned);
+			for (i = 0; i < n; i++) {
+				const char *p = memchr (buf + want, '\n', len - want);
+				if (!p || (size_t)(p - buf) != offs[i]) {
+					printf ("%s: wrong offset at round %d\n",
+							name, round);
+					return 0;
+				}
+				want = offs[i] + 1;
+			}
+			if (scanned == len
+					&& memchr (buf + want, '\n', len - want)) {
+				printf ("%s: missed a delimiter at round %d\n",
+						name, round);
+				return 0;
+			}
+			want = scanned;
+		}
+	}
+	return 1;
+}
+
+static void run (const char *label, const char *buf, size_t size,
+		size_t lines, size_t (*count) (const char *, size_t))
+{
+	double t = now ();
+	int r;
+
+	for (r = 0; r < ROUNDS; r++) {
+		if (count (buf, size) != lines) {
+			printf ("  %-8s counted wrong\n", label);
+			return;
+		}
+	}
+	t = now () - t;
+	printf ("  %-8s %7.2f GB/s %9.1f Mlines/s\n", label,
+			(double)size * ROUNDS / t / 1e9,
+			(double)lines * ROUNDS / t / 1e6);
+}
+
+int main (void)
+{
+	static const size_t avgs[] = { 40, 4096 };
+	char *buf = malloc (BUF_SIZE);
+	unsigned a, i;
+
+	if (!buf) {
+		perror ("malloc");
+		return 1;
+	}
+
+	printf ("default scanner: %s\n", lscan_impl ());
+	for (i = 0; i < sizeof (names) / sizeof (names[0]); i++) {
+		if (!lscan_select (names[i]))
+			continue;
+		if (!check (names[i]))
+			return 1;
+	}
+
+	for (a = 0; a < sizeof (avgs) / sizeof (avgs[0]); a++) {
+		size_t lines = fill (buf, BUF_SIZE, avgs[a]);
+
+		printf ("%d MB in lines of about %d bytes\n",
+				BUF_SIZE >> 20, (int)avgs[a]);
+		run ("memchr", buf, BUF_SIZE, lines, count_memchr);
+		for (i = 0; i < sizeof (names) / sizeof (names[0]); i++) {
+			if (!lscan_select (names[i]))
+				continue;
+			run (names[i], buf, BUF_SIZE, lines, count_cursor);
+		}
+	}
+
+	free (buf);
+	return 0;
+}
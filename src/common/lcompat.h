@@ -0,0 +1,67 @@
+#ifndef __WMII_LUA_LCOMPAT_H__
+#define __WMII_LUA_LCOMPAT_H__
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* The modules are written against the Lua 5.1 API.  On 5.2 to 5.4 this
+ * maps what they use of it onto what replaced it, so the same sources
+ * build for any of them; config.mk picks the version from the lua found
+ * in PATH.  On 5.1 it does nothing. */
+
+#if LUA_VERSION_NUM >= 502
+
+#define luaL_reg luaL_Reg
+
+#define lua_objlen(L,i)		lua_rawlen(L,(i))
+
+#ifndef luaL_checkint
+#define luaL_checkint(L,n)	((int)luaL_checkinteger(L,(n)))
+#endif
+#ifndef luaL_optint
+#define luaL_optint(L,n,d)	((int)luaL_optinteger(L,(n),(d)))
+#endif
+
+/* the modules keep tables with their userdata in its environment, which
+ * became the user value; 5.4 has several of them, the first is used */
+#if LUA_VERSION_NUM >= 504
+#define lua_getfenv(L,i)	((void)lua_getiuservalue(L,(i),1))
+#define lua_setfenv(L,i)	lua_setiuservalue(L,(i),1)
+#else
+#define lua_getfenv(L,i)	((void)lua_getuservalue(L,(i)))
+#define lua_setfenv(L,i)	(lua_setuservalue(L,(i)), 1)
+#endif
+
+/* luaL_openlib(L, name, l, nup) as in 5.1: with a name, the functions go
+ * into package.loaded[name], also set as the global name, which is left
+ * on the stack; without one, into the table below the upvalues */
+static inline void lcompat_openlib (lua_State *L, const char *name,
+		const luaL_Reg *l, int nup)
+{
+	if (name) {
+		luaL_getsubtable (L, LUA_REGISTRYINDEX, "_LOADED");
+		lua_getfield (L, -1, name);
+		if (!lua_istable (L, -1)) {
+			lua_pop (L, 1);
+			lua_getglobal (L, name);
+			if (!lua_istable (L, -1)) {
+				lua_pop (L, 1);
+				lua_newtable (L);
+			}
+			lua_pushvalue (L, -1);
+			lua_setfield (L, -3, name);
+		}
+		lua_remove (L, -2);
+		lua_pushvalue (L, -1);
+		lua_setglobal (L, name);
+		lua_insert (L, -(nup + 1));
+	}
+	luaL_setfuncs (L, l, nup);
+}
+
+#define luaL_openlib(L,n,l,nup)	lcompat_openlib(L,(n),(l),(nup))
+#define luaL_register(L,n,l)	lcompat_openlib(L,(n),(l),0)
+
+#endif // LUA_VERSION_NUM >= 502
+
+#endif // __WMII_LUA_LCOMPAT_H__
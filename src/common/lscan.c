@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#include "lscan.h"
+
+
+/* ------------------------------------------------------------------------
+ * the scanners
+ *
+ * Each stores up to max offsets and returns how many; they share the
+ * contract of lscan_delims().
+ */
+typedef size_t (*scan_fn) (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned);
+
+static size_t scan_scalar (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned)
+{
+	const char *p = buf + start, *e = buf + end;
+	size_t n = 0;
+
+	while (n < max && p < e) {
+		p = memchr (p, delim, e - p);
+		if (!p)
+			break;
+		offs[n++] = p - buf;
+		p++;
+	}
+	*scanned = n == max ? offs[n-1] + 1 : end;
+	return n;
+}
+
+#ifdef LSCAN_X86
+/* the bits of mask are delimiters in the block at pos; stores them, and
+ * returns nonzero if max was reached on the way */
+static inline int take_bits (uint64_t mask, size_t pos, uint32_t *offs,
+		size_t *n, size_t max)
+{
+	while (mask) {
+		offs[(*n)++] = pos + __builtin_ctzll (mask);
+		if (*n == max)
+			return 1;
+		mask &= mask - 1;
+	}
+	return 0;
+}
+
+static size_t scan_sse2 (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned)
+{
+	__m128i needle = _mm_set1_epi8 ((char)delim);
+	size_t pos = start, n = 0;
+
+	for (; pos + 16 <= end; pos += 16) {
+		__m128i chunk = _mm_loadu_si128 ((const __m128i*)(buf + pos));
+		unsigned mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, needle));
+		if (mask && take_bits (mask, pos, offs, &n, max)) {
+			*scanned = offs[n-1] + 1;
+			return n;
+		}
+	}
+	return n + scan_scalar (buf, pos, end, delim, offs + n, max - n,
+			scanned);
+}
+
+/* 64 bytes a step: long lines mostly take the one branch that finds
+ * nothing in the block */
+__attribute__((target("avx2")))
+static size_t scan_avx2 (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned)
+{
+	__m256i needle = _mm256_set1_epi8 ((char)delim);
+	size_t pos = start, n = 0;
+
+	for (; pos + 64 <= end; pos += 64) {
+		__m256i lo = _mm256_cmpeq_epi8 (needle,
+				_mm256_loadu_si256 ((const __m256i*)(buf + pos)));
+		__m256i hi = _mm256_cmpeq_epi8 (needle,
+				_mm256_loadu_si256 ((const __m256i*)(buf + pos + 32)));
+		uint64_t mask;
+
+		if (_mm256_testz_si256 (_mm256_or_si256 (lo, hi),
+					_mm256_or_si256 (lo, hi)))
+			continue;
+		mask = (uint32_t)_mm256_movemask_epi8 (lo)
+			| (uint64_t)(uint32_t)_mm256_movemask_epi8 (hi) << 32;
+		if (take_bits (mask, pos, offs, &n, max)) {
+			*scanned = offs[n-1] + 1;
+			return n;
+		}
+	}
+	return n + scan_sse2 (buf, pos, end, delim, offs + n, max - n,
+			scanned);
+}
+#endif
+
+/* ------------------------------------------------------------------------
+ * picking one
+ */
+static const struct {
+	const char *name;
+	scan_fn fn;
+} impls[] = {
+#ifdef LSCAN_X86
+	{ "avx2",	scan_avx2 },
+	{ "sse2",	scan_sse2 },
+#endif
+	{ "scalar",	scan_scalar },
+};
+#define NIMPLS (sizeof (impls) / sizeof (impls[0]))
+
+static int current = -1;
+
+static int supported (int i)
+{
+#ifdef LSCAN_X86
+	if (impls[i].fn == scan_avx2)
+		return __builtin_cpu_supports ("avx2");
+	if (impls[i].fn == scan_sse2)
+		return __builtin_cpu_supports ("sse2");
+#endif
+	return 1;
+}
+
+static void pick (void)
+{
+	unsigned i;
+
+#ifdef LSCAN_X86
+	__builtin_cpu_init ();
+#endif
+	for (i=0; i<NIMPLS && !supported (i); i++)
+		;
+	current = i;
+}
+
+const char *lscan_impl (void)
+{
+	if (current < 0)
+		pick ();
+	return impls[current].name;
+}
+
+int lscan_select (const char *name)
+{
+	unsigned i;
+
+	if (current < 0)
+		pick ();
+	for (i=0; i<NIMPLS; i++) {
+		if (!strcmp (impls[i].name, name) && supported (i)) {
+			current = i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+size_t lscan_delims (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned)
+{
+	if (current < 0)
+		pick ();
+	if (!max || start >= end) {
+		*scanned = start;
+		return 0;
+	}
+	return impls[current].fn (buf, start, end, delim, offs, max, scanned);
+}
@@ -0,0 +1,64 @@
+#ifndef __WMII_LUA_LSCAN_H__
+#define __WMII_LUA_LSCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Finds the delimiters, newlines or NULs, in a buffer, many at a time.
+ * Shared by luaeventloop and luaixp; each builds it in with its own
+ * objects.  On x86 the widest of AVX2, SSE2 and plain C that the CPU has
+ * is picked on first use. */
+
+#define LSCAN_BATCH 64			// delimiters a cursor finds per scan
+
+/* stores the offsets of the delimiters in buf[start, end) to offs, at
+ * most max of them, and returns how many it found; *scanned is where it
+ * stopped: end, or just past the last one stored once max were found */
+extern size_t lscan_delims (const char *buf, size_t start, size_t end,
+		unsigned char delim, uint32_t *offs, size_t max,
+		size_t *scanned);
+
+/* the scanner in use, "avx2", "sse2" or "scalar"; lscan_select() switches
+ * to the named one, for benchmarks, and returns 0 if the CPU lacks it */
+extern const char *lscan_impl (void);
+extern int lscan_select (const char *name);
+
+/* remembers the delimiters of a buffer that is consumed from the front
+ * and appended to at the back, so each byte is scanned once */
+struct lscan_cursor {
+	uint32_t offs[LSCAN_BATCH];
+	unsigned n;			// offsets held
+	unsigned next;			// first that may be at or after pos
+	size_t scanned;			// everything before this was scanned
+};
+
+/* forget what was found, after the data in the buffer was moved */
+static inline void lscan_reset (struct lscan_cursor *c)
+{
+	c->n = c->next = 0;
+	c->scanned = 0;
+}
+
+/* returns the offset of the first delimiter in buf[pos, end), or -1 if
+ * there is none yet; the buffer must only have grown at the end since
+ * the last call, and pos must not have gone back */
+static inline long lscan_find (struct lscan_cursor *c, const char *buf,
+		size_t pos, size_t end, unsigned char delim)
+{
+	for (;;) {
+		while (c->next < c->n && c->offs[c->next] < pos)
+			c->next++;
+		if (c->next < c->n)
+			return c->offs[c->next] < end ? (long)c->offs[c->next] : -1;
+
+		if (c->scanned < pos)
+			c->scanned = pos;
+		if (c->scanned >= end)
+			return -1;
+		c->next = 0;
+		c->n = lscan_delims (buf, c->scanned, end, delim, c->offs,
+				LSCAN_BATCH, &c->scanned);
+	}
+}
+
+#endif // __WMII_LUA_LSCAN_H__
@@ -0,0 +1,99 @@
+--[[
+=pod
+
+=head1 NAME
+
+compat.lua - run the wmiirc-lua scripts on Lua 5.2 to 5.4
+
+=head1 SYNOPSIS
+
+    require "compat"
+    module("myplugin")
+
+=head1 DESCRIPTION
+
+The core and the plugins are written for Lua 5.1, and declare themselves
+with module().  Later versions dropped module(), along with a few other
+globals; this brings back what the scripts use of them.  On Lua 5.1 it
+does nothing.
+
+module(name, ...) works as in 5.1: the module table is package.loaded[name],
+or the global of that name, created if needed, and it becomes the
+environment of the rest of the calling chunk.  A plugin that is loaded
+lazily thus fills in the stand-in that wmii.load_plugin() returned.
+
+=cut
+--]]
+
+if module then
+        return
+end
+
+local _G = _G
+local debug = require("debug")
+local package = package
+local string = require("string")
+local table = require("table")
+local setmetatable = setmetatable
+local type = type
+local error = error
+local ipairs = ipairs
+
+-- the table at the dotted name, created where missing
+local function find_table (name)
+        local t = _G
+        local part
+        for part in string.gmatch(name, "[^%.]+") do
+                local v = t[part]
+                if v == nil then
+                        v = {}
+                        t[part] = v
+                elseif type(v) ~= "table" then
+                        error("name conflict for module '" .. name .. "'", 3)
+                end
+                t = v
+        end
+        return t
+end
+
+-- makes t the environment of the function at the given stack level
+local function set_env (level, t)
+        local fn = debug.getinfo(level + 1, "f").func
+        local i = 1
+        while true do
+                local up = debug.getupvalue(fn, i)
+                if up == "_ENV" then
+                        debug.setupvalue(fn, i, t)
+                        return
+                elseif not up then
+                        return
+                end
+                i = i + 1
+        end
+end
+
+function package.seeall (m)
+        setmetatable(m, { __index = _G })
+end
+
+function _G.module (name, ...)
+        local m = package.loaded[name]
+        if type(m) ~= "table" then
+                m = find_table(name)
+                package.loaded[name] = m
+        end
+        if m._NAME == nil then
+                m._M = m
+                m._NAME = name
+                m._PACKAGE = string.match(name, "^(.*%.)") or ""
+        end
+        set_env(2, m)
+
+        local _, option
+        for _, option in ipairs({...}) do
+                option(m)
+        end
+end
+
+_G.unpack = _G.unpack or table.unpack
+_G.loadstring = _G.loadstring or _G.load
@@ -0,0 +1,210 @@
+--[[
+=pod
+
+=head1 NAME
+
+cron.lua - cron expressions for wmii timers
+
+=head1 SYNOPSIS
+
+    local cron = require "cron"
+    local spec = assert (cron.parse ("*/5 9-17 * * mon-fri"))
+    local t = cron.next (spec, os.time ())
+
+Timers take the expression as it is:
+
+    wmii.timer:new (fn, { cron = "0 * * * *" })
+
+=head1 DESCRIPTION
+
+The five fields are minute, hour, day of month, month and day of week, in
+local time.  Each is C<*>, a number, a range C<a-b>, a step C<*/n> or
+C<a-b/n>, or a comma separated list of those; months and days of the week
+may be given by their first three letters, and Sunday is 0 or 7.  As in
+cron, when both days are restricted either one matching is enough.
+
+@hourly, @daily (or @midnight), @weekly, @monthly and @yearly (or
+@annually) stand for the usual expressions.
+
+=cut
+--]]
+
+local math = require("math")
+local os = require("os")
+local string = require("string")
+local table = require("table")
+local tonumber = tonumber
+local ipairs = ipairs
+
+module("cron")
+
+local aliases = {
+        ["@hourly"]   = "0 * * * *",
+        ["@daily"]    = "0 0 * * *",
+        ["@midnight"] = "0 0 * * *",
+        ["@weekly"]   = "0 0 * * 0",
+        ["@monthly"]  = "0 0 1 * *",
+        ["@yearly"]   = "0 0 1 1 *",
+        ["@annually"] = "0 0 1 1 *",
+}
+
+local names = {
+        month = { jan=1, feb=2, mar=3, apr=4, may=5, jun=6,
+                  jul=7, aug=8, sep=9, oct=10, nov=11, dec=12 },
+        dow   = { sun=0, mon=1, tue=2, wed=3, thu=4, fri=5, sat=6 },
+}
+
+local fields = {
+        { name = "minute", lo = 0, hi = 59 },
+        { name = "hour",   lo = 0, hi = 23 },
+        { name = "dom",    lo = 1, hi = 31 },
+        { name = "month",  lo = 1, hi = 12 },
+        { name = "dow",    lo = 0, hi = 7 },
+}
+
+-- a number, or a name of a month or day
+local function value (s, field)
+        local n = tonumber (s)
+        if not n and names[field.name] then
+                n = names[field.name][s:lower()]
+        end
+        return n
+end
+
+-- parses one field to a set of the values it matches; returns nil and an
+-- error if it is not valid
+local function parse_field (s, field)
+        local set = {}
+        local part
+        for part in s:gmatch ("[^,]+") do
+                local range, step = part:match ("^([^/]+)/(%d+)$")
+                range = range or part
+                step = tonumber (step) or 1
+
+                local lo, hi
+                if range == "*" then
+                        lo, hi = field.lo, field.hi
+                else
+                        local a, b = range:match ("^(%w+)-(%w+)$")
+                        if a then
+                                lo, hi = value (a, field), value (b, field)
+                        else
+                                lo = value (range, field)
+                                hi = lo
+                                -- n/step runs to the end of the range
+                                if lo and part:find ("/") then
+                                        hi = field.hi
+                                end
+                        end
+                end
+
+                if not lo or not hi or lo < field.lo or hi > field.hi
+                                or lo > hi or step < 1 then
+                        return nil, "bad " .. field.name .. " field '" .. s .. "'"
+                end
+
+                local v
+                for v = lo, hi, step do
+                        set[v] = true
+                end
+        end
+        return set
+end
+
+--[[
+=pod
+
+=over 4
+
+=item parse ( expr )
+
+Returns the parsed form of I<expr>, or nil and an error.
+
+=cut
+--]]
+function parse (expr)
+        expr = aliases[expr] or expr
+
+        local parts = {}
+        local p
+        for p in expr:gmatch ("%S+") do
+                parts[#parts+1] = p
+        end
+        if #parts ~= #fields then
+                return nil, "cron expression '" .. expr .. "' needs 5 fields"
+        end
+
+        local spec = { expr = expr }
+        local i, field
+        for i, field in ipairs (fields) do
+                local set, err = parse_field (parts[i], field)
+                if not set then
+                        return nil, err
+                end
+                spec[field.name] = set
+        end
+        if spec.dow[7] then
+                spec.dow[0] = true
+        end
+        spec.any_dom = parts[3] == "*"
+        spec.any_dow = parts[5] == "*"
+        return spec
+end
+
+local function day_matches (spec, d)
+        local dom = spec.dom[d.day]
+        local dow = spec.dow[d.wday - 1]
+        if spec.any_dom then
+                return dow
+        elseif spec.any_dow then
+                return dom
+        end
+        return dom or dow
+end
+
+-- lets os.time() fix up the fields, and whether DST applies
+local function normalize (d)
+        d.isdst = nil
+        return os.date ("*t", os.time (d))
+end
+
+--[[
+=pod
+
+=item next ( spec, t )
+
+Returns the first time after I<t>, in seconds since the epoch, that
+I<spec> matches; it is always at the start of a minute.  Returns nil if
+there is none within the next few years, as for "0 0 30 2 *".
+
+=back
+
+=cut
+--]]
+function next (spec, t)
+        local d = os.date ("*t", math.floor (t / 60) * 60 + 60)
+        d.sec = 0
+
+        local tries
+        for tries = 1, 5000 do
+                if not spec.month[d.month] then
+                        d.month = d.month + 1
+                        d.day, d.hour, d.min = 1, 0, 0
+                        d = normalize (d)
+                elseif not day_matches (spec, d) then
+                        d.day = d.day + 1
+                        d.hour, d.min = 0, 0
+                        d = normalize (d)
+                elseif not spec.hour[d.hour] then
+                        d.hour = d.hour + 1
+                        d.min = 0
+                        d = normalize (d)
+                elseif not spec.minute[d.min] then
+                        d.min = d.min + 1
+                        d = normalize (d)
+                else
+                        return os.time (d)
+                end
+        end
+        return nil
+end
@@ -0,0 +1,176 @@
+--[[
+=pod
+
+=head1 NAME
+
+fastpath.lua - the hot ixp and eventloop calls through LuaJIT's FFI
+
+=head1 SYNOPSIS
+
+    local fastpath = require "fastpath"
+
+    fastpath.write (x, "/rbar/clock", "12:00")
+    fastpath.write_ctl (x, "/ctl", "bar on top")
+    local data, short_read = fastpath.read (x, "/ctl")
+
+    fastpath.add_exec (el, "wmiir read /event", function (line) ... end)
+
+=head1 DESCRIPTION
+
+Under LuaJIT every call of a C function through the Lua API ends the trace
+that the JIT was recording, so the loops that write to wmii and take the
+lines of its events do not get compiled.  The ixp and eventloop modules
+also offer these calls as plain C functions, and under LuaJIT this module
+calls them through the FFI instead.  Elsewhere, or with modules that lack
+them, it calls the methods of the modules as before; I<fastpath.enabled>
+tells which.
+
+write_ctl() keeps the file open for the next write.  It is for files that
+wmii acts on at each write, as /ctl; a bar file only takes its contents
+when it is closed, and an /event fid left open collects events.
+
+add_exec() takes the same options as el:add_exec(), and calls the function
+the same way.  With LuaJIT, programs of lines, NUL terminated records,
+netstrings and length prefixed records are read with pull = true, and the
+records are passed on from a loop in Lua.
+
+=cut
+--]]
+
+local ixp = require("ixp")
+local eventloop = require("eventloop")
+local pcall = pcall
+local require = require
+local pairs = pairs
+local type = type
+
+module("fastpath")
+
+enabled = false
+
+-- ------------------------------------------------------------------------
+-- the methods, on PUC Lua
+
+function write (x, file, data)
+        return x:write (file, data)
+end
+
+write_ctl = write
+
+function read (x, file)
+        return x:read (file)
+end
+
+function add_exec (el, cmd, fn, opts)
+        return el:add_exec (cmd, fn, opts)
+end
+
+now = eventloop.now
+
+-- ------------------------------------------------------------------------
+-- the plain C functions, on LuaJIT
+
+local have_ffi, ffi = pcall (require, "ffi")
+if not have_ffi or not ixp.ffi_api or not eventloop.ffi_api then
+        return
+end
+
+-- as in luaixp/lixp_ffi.h and luaeventloop/lel_ffi.h
+ffi.cdef [[
+struct lixp_ffi_api {
+        int version;
+        int (*write) (void *ixp, const char *file, const char *data,
+                        size_t len);
+        int (*write_cached) (void *ixp, const char *file, const char *data,
+                        size_t len);
+        long (*read) (void *ixp, const char *file, char *buf, size_t size,
+                        int *short_read);
+        const char *(*error) (void);
+};
+struct lel_ffi_api {
+        int version;
+        double (*now) (void);
+        int (*next_record) (void *el, int fd, const char **s, size_t *len);
+};
+]]
+
+local ixp_api = ffi.cast ("const struct lixp_ffi_api *", ixp.ffi_api ())
+local el_api = ffi.cast ("const struct lel_ffi_api *", eventloop.ffi_api ())
+if ixp_api.version ~= 1 or el_api.version ~= 1 then
+        return
+end
+
+enabled = true
+
+local READ_SIZE = 65536         -- as ixp.read() without a size
+local read_buf = ffi.new ("char[?]", READ_SIZE)
+local short_read = ffi.new ("int[1]")
+local rec = ffi.new ("const char *[1]")
+local rec_len = ffi.new ("size_t[1]")
+
+local function ixp_error ()
+        return nil, ffi.string (ixp_api.error ())
+end
+
+function write (x, file, data)
+        if type(data) ~= "string" then
+                return x:write (file, data)
+        end
+        if ixp_api.write (x, file, data, #data) < 0 then
+                return ixp_error ()
+        end
+end
+
+function write_ctl (x, file, data)
+        if type(data) ~= "string" then
+                return x:write (file, data)
+        end
+        if ixp_api.write_cached (x, file, data, #data) < 0 then
+                return ixp_error ()
+        end
+end
+
+function read (x, file)
+        local len = ixp_api.read (x, file, read_buf, READ_SIZE, short_read)
+        if len < 0 then
+                return ixp_error ()
+        end
+        return ffi.string (read_buf, len), short_read[0] ~= 0
+end
+
+now = el_api.now
+
+local pull_framings = { line = true, nul = true, netstring = true, length = true }
+
+function add_exec (el, cmd, fn, opts)
+        opts = opts or {}
+        if not pull_framings[opts.framing or "line"]
+                        or (opts.keep or "all") ~= "all" then
+                return el:add_exec (cmd, fn, opts)
+        end
+
+        local pull = {}
+        local k, v
+        for k, v in pairs (opts) do
+                pull[k] = v
+        end
+        pull.pull = true
+
+        -- records left over are offered again in the next batch
+        local high_water = opts.high_water or 0
+        local fd
+        fd = el:add_exec (cmd, function (ready, err)
+                if ready ~= true then
+                        return fn (ready, err)
+                end
+                local n = 0
+                while el_api.next_record (el, fd, rec, rec_len) > 0 do
+                        fn (ffi.string (rec[0], rec_len[0]))
+                        n = n + 1
+                        if n == high_water then
+                                break
+                        end
+                end
+        end, pull)
+        return fd
+end
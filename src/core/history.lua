@@ -1,104 +1,15 @@
+--[[
+The history module is kept for configurations and plugins that still use
+it; histories are now ring buffers of strings from the ringbuf module,
+which has the same add(), oldest(), newest(), walk_reverse() and
+walk_reverse_unique() methods, and a few more.
+--]]
 
-local os = require("os")
-local io = require("io")
-local string = require("string")
---       local posix = require("posix")
---       local table = require("table")
---       local math = require("math")
---       local type = type
---       local error = error
-local print = print
---       local pcall = pcall
---       local pairs = pairs
---       local package = package
---       local require = require
-local tostring = tostring
---       local tonumber = tonumber
-local setmetatable = setmetatable
+local ringbuf = require("ringbuf")
 
 module("history")
 
 
-history = {}
 function new (size)
-        local o = {}
-
-        setmetatable (o,history)
-        history.__index = history
-
-        o.data = {}
-        o.data[size] = nil
-        o.size = size
-        o.count = 0
-        o.last = 0
-
-        return o
-end
-
-function history:add (entry)
-        if self.count < self.size then
-                self.count = self.count + 1
-                self.last = self.count
-                self.data[self.last] = entry
-        else
-                self.last = 1 + (self.last % self.size)
-                self.data[self.last] = entry
-        end
-end
-
-function history:oldest ()
-        if self.count then
-                local i = 1 + ((self.last + self.size - self.count) % self.size)
-                return self.data[i]
-        end
-        return nil
-end
-
-function history:newest ()
-        if self.count then
-                return self.data[self.last]
-        end
-        return nil
+        return ringbuf.new (size, "string")
 end
-
-function history:walk_reverse ()
-        local s = self
-        local count = s.count
-        local index = s.last
-
-        return function ()
-                local ret = nil
-                if count > 0 then
-                        local i = 1 + (s.size + index - 1) % s.size
-                        ret = s.data[i]
-                        count = count - 1
-                        index = index - 1
-                end
-                return ret
-        end
-end
-
-function history:walk_reverse_unique ()
-        local s = self
-
-        local iterator = s:walk_reverse()
-        if not iterator then
-                return function ()
-                        return nil
-                end
-        end
-
-        local seen = {}
-        return function ()
-                local v = iterator()
-                while v do
-                        if not seen[v] then
-                                seen[v] = 1
-                                return v
-                        end
-                        v = iterator()
-                end
-        end
-end
-
-
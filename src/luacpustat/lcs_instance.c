@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcs_debug.h"
+#include "lcs_util.h"
+#include "lcs_instance.h"
+
+
+const char *lcs_groupings[] = { "cpu", "cluster", "package", "all", "auto",
+	NULL };
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+struct lcs_sampler *lcs_checksampler (lua_State *L, int narg)
+{
+	void *ud = luaL_checkudata (L, narg, L_CPUSTAT_MT);
+	luaL_argcheck (L, ud != NULL, narg, "`sampler' expected");
+	return (struct lcs_sampler*)ud;
+}
+
+/* reads a small file of cpu id into buf, NUL terminated; returns the
+ * length or -1 */
+static ssize_t read_small (struct lcs_sampler *s, unsigned id,
+		const char *file, char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	ssize_t rc;
+	int fd;
+
+	snprintf (path, sizeof (path), "%s/cpu%u/%s", s->sysdir, id, file);
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	do {
+		rc = read (fd, buf, size - 1);
+	} while (rc < 0 && errno == EINTR);
+	close (fd);
+
+	buf[rc > 0 ? rc : 0] = 0;
+	return rc;
+}
+
+static long read_number (struct lcs_sampler *s, unsigned id,
+		const char *file, long dflt)
+{
+	char buf[32], *end;
+	long n;
+
+	if (read_small (s, id, file, buf, sizeof (buf)) <= 0)
+		return dflt;
+	n = strtol (buf, &end, 10);
+	return end == buf ? dflt : n;
+}
+
+/* reads a number from a file kept open */
+static long pread_number (int fd)
+{
+	char buf[32];
+	ssize_t rc;
+
+	do {
+		rc = pread (fd, buf, sizeof (buf) - 1, 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc <= 0)
+		return -1;
+	buf[rc] = 0;
+	return strtol (buf, NULL, 10);
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+/* ------------------------------------------------------------------------
+ * finding the cpus
+ */
+
+/* what puts cpus in the same group */
+static long group_key (struct lcs_sampler *s, struct lcs_cpu *c)
+{
+	switch (s->grouping) {
+	case LCS_BY_CPU:	return c->id;
+	case LCS_BY_CLUSTER:	return ((long)c->package << 16) | (c->cluster & 0xffff);
+	case LCS_BY_PACKAGE:	return c->package;
+	case LCS_BY_ALL:
+	case LCS_BY_AUTO:	return 0;
+	}
+	return 0;
+}
+
+static struct lcs_sampler *sort_sampler;
+
+static int cmp_cpu (const void *a, const void *b)
+{
+	const struct lcs_cpu *x = a, *y = b;
+	long kx = group_key (sort_sampler, (struct lcs_cpu*)x);
+	long ky = group_key (sort_sampler, (struct lcs_cpu*)y);
+
+	if (kx != ky)
+		return kx < ky ? -1 : 1;
+	return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static void name_group (struct lcs_sampler *s, struct lcs_group *g,
+		struct lcs_cpu *c)
+{
+	switch (s->grouping) {
+	case LCS_BY_CPU:
+		snprintf (g->name, sizeof (g->name), "cpu%u", c->id);
+		break;
+	case LCS_BY_CLUSTER:
+		snprintf (g->name, sizeof (g->name), "P%dC%d",
+				c->package, c->cluster);
+		break;
+	case LCS_BY_PACKAGE:
+		snprintf (g->name, sizeof (g->name), "P%d", c->package);
+		break;
+	case LCS_BY_ALL:
+	case LCS_BY_AUTO:
+		snprintf (g->name, sizeof (g->name), "all");
+		break;
+	}
+}
+
+/* sorts the cpus for the grouping, and counts the groups it makes */
+static unsigned sort_cpus (struct lcs_sampler *s, struct lcs_cpu *cpus,
+		unsigned ncpus)
+{
+	unsigned i, n = 0;
+
+	sort_sampler = s;
+	qsort (cpus, ncpus, sizeof (*cpus), cmp_cpu);
+
+	for (i=0; i<ncpus; i++)
+		if (!i || group_key (s, &cpus[i]) != group_key (s, &cpus[i-1]))
+			n++;
+	return n;
+}
+
+/* the details of one cpu that do not change while it runs */
+static void probe_cpu (struct lcs_sampler *s, struct lcs_cpu *c)
+{
+	char path[PATH_MAX], *p;
+
+	c->package = read_number (s, c->id, "topology/physical_package_id", 0);
+	c->cluster = read_number (s, c->id, "topology/cluster_id", -1);
+	if (c->cluster < 0)
+		c->cluster = read_number (s, c->id, "topology/die_id", 0);
+	if (c->package < 0)
+		c->package = 0;
+	if (c->cluster < 0)
+		c->cluster = 0;
+
+	c->freq_lo = read_number (s, c->id, "cpufreq/cpuinfo_min_freq", 0);
+	c->freq_hi = read_number (s, c->id, "cpufreq/cpuinfo_max_freq", 0);
+
+	read_small (s, c->id, "cpufreq/scaling_governor", c->governor,
+			sizeof (c->governor));
+	for (p = c->governor; *p && *p != '\n'; p++)
+		;
+	*p = 0;
+
+	snprintf (path, sizeof (path), "%s/cpu%u/cpufreq/scaling_cur_freq",
+			s->sysdir, c->id);
+	c->freq_fd = open (path, O_RDONLY | O_CLOEXEC);
+	c->util = -1;
+}
+
+void lcs_sampler_close (struct lcs_sampler *s)
+{
+	unsigned i;
+
+	for (i=0; i<s->ncpus; i++)
+		if (s->cpus[i].freq_fd >= 0)
+			close (s->cpus[i].freq_fd);
+	if (s->stat_fd >= 0)
+		close (s->stat_fd);
+	s->stat_fd = -1;
+
+	free (s->cpus);
+	free (s->by_id);
+	free (s->groups);
+	free (s->buf);
+	s->cpus = NULL;
+	s->by_id = NULL;
+	s->groups = NULL;
+	s->buf = NULL;
+	s->ncpus = s->ngroups = s->max_id = 0;
+}
+
+int lcs_sampler_scan (struct lcs_sampler *s)
+{
+	struct lcs_cpu *cpus = NULL, *old_cpus;
+	unsigned ncpus = 0, alloc = 0, old_ncpus, old_max_id;
+	unsigned *old_by_id;
+	struct dirent *de;
+	unsigned i, id;
+	DIR *dir;
+
+	dir = opendir (s->sysdir);
+	if (!dir)
+		return -1;
+
+	while ((de = readdir (dir))) {
+		char extra;
+
+		if (sscanf (de->d_name, "cpu%u%c", &id, &extra) != 1)
+			continue;
+		if (ncpus == alloc) {
+			struct lcs_cpu *n;
+			alloc = alloc ? alloc * 2 : 64;
+			n = realloc (cpus, alloc * sizeof (*cpus));
+			if (!n) {
+				free (cpus);
+				closedir (dir);
+				errno = ENOMEM;
+				return -1;
+			}
+			cpus = n;
+		}
+		memset (&cpus[ncpus], 0, sizeof (*cpus));
+		cpus[ncpus].id = id;
+		ncpus++;
+	}
+	closedir (dir);
+
+	for (i=0; i<ncpus; i++)
+		probe_cpu (s, &cpus[i]);
+
+	// the counters carry over, so the first sample after a rescan is
+	// still against the last one
+	old_cpus = s->cpus;
+	old_ncpus = s->ncpus;
+	old_by_id = s->by_id;
+	old_max_id = s->max_id;
+	for (i=0; i<ncpus; i++) {
+		id = cpus[i].id;
+		if (id < old_max_id && old_by_id[id]) {
+			struct lcs_cpu *o = &old_cpus[old_by_id[id] - 1];
+			cpus[i].busy = o->busy;
+			cpus[i].total = o->total;
+		}
+	}
+	s->cpus = old_cpus;
+	s->ncpus = old_ncpus;
+	lcs_sampler_close (s);
+
+	s->cpus = cpus;
+	s->ncpus = ncpus;
+
+	// auto takes the finest grouping that fits, going from a group for
+	// each cpu to one for them all
+	s->grouping = s->wanted == LCS_BY_AUTO ? LCS_BY_CPU : s->wanted;
+	while (sort_cpus (s, cpus, ncpus) > s->max_groups
+			&& s->wanted == LCS_BY_AUTO && s->grouping < LCS_BY_ALL)
+		s->grouping++;
+
+	// the groups, and the cpus by id for parsing /proc/stat
+	for (i=0; i<ncpus; i++)
+		if (cpus[i].id >= s->max_id)
+			s->max_id = cpus[i].id + 1;
+	s->by_id = calloc (s->max_id ? s->max_id : 1, sizeof (unsigned));
+	s->groups = calloc (ncpus ? ncpus : 1, sizeof (struct lcs_group));
+	s->buf_size = (ncpus + 2) * 160 + 256;
+	s->buf = malloc (s->buf_size);
+	if (!s->by_id || !s->groups || !s->buf) {
+		lcs_sampler_close (s);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i=0; i<ncpus; i++) {
+		s->by_id[cpus[i].id] = i + 1;
+		if (!i || group_key (s, &cpus[i]) != group_key (s, &cpus[i-1])) {
+			struct lcs_group *g = &s->groups[s->ngroups++];
+			name_group (s, g, &cpus[i]);
+			g->first = i;
+		}
+		cpus[i].group = s->ngroups - 1;
+		s->groups[s->ngroups - 1].count++;
+	}
+
+	s->stat_fd = open (s->procstat, O_RDONLY | O_CLOEXEC);
+	if (s->stat_fd < 0) {
+		int err = errno;
+		lcs_sampler_close (s);
+		errno = err;
+		return -1;
+	}
+
+	DBGF("** cpustat: %u cpus in %u groups by %s **\n", s->ncpus,
+			s->ngroups, lcs_groupings[s->grouping]);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * sampling
+ */
+
+/* reads the cpu lines of /proc/stat, and works out how busy each cpu was
+ * since the last time */
+static int sample_stat (struct lcs_sampler *s)
+{
+	char *p, *end;
+	ssize_t rc;
+	unsigned i;
+
+	do {
+		rc = pread (s->stat_fd, s->buf, s->buf_size - 1, 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0)
+		return -1;
+	s->buf[rc] = 0;
+	s->reads++;
+
+	for (i=0; i<s->ncpus; i++)
+		s->cpus[i].util = -1;
+
+	// the first line adds up all cpus, the cpuN lines follow it; what
+	// comes after them is not needed, and may not have been read
+	p = strchr (s->buf, '\n');
+	while (p && !strncmp (++p, "cpu", 3)) {
+		unsigned long long f[8], total = 0, busy;
+		struct lcs_cpu *c;
+		unsigned long id;
+		int n;
+
+		id = strtoul (p + 3, &end, 10);
+		if (end == p + 3)
+			break;
+		for (n=0, p=end; n<8; n++, p=end) {
+			f[n] = strtoull (p, &end, 10);
+			if (end == p)
+				break;
+			total += f[n];
+		}
+		p = strchr (p, '\n');
+		if (!p && n < 8)
+			break;		// cut short
+
+		if (id >= s->max_id || !s->by_id[id])
+			continue;	// came online since the last rescan
+		c = &s->cpus[s->by_id[id] - 1];
+
+		// user nice system idle iowait irq softirq steal
+		busy = total - f[3] - (n > 4 ? f[4] : 0);
+		if (total > c->total && busy >= c->busy)
+			c->util = (double)(busy - c->busy) / (total - c->total);
+		else
+			c->util = 0;
+		c->busy = busy;
+		c->total = total;
+	}
+	return 0;
+}
+
+static void sample_freq (struct lcs_sampler *s)
+{
+	unsigned i;
+
+	for (i=0; i<s->ncpus; i++) {
+		struct lcs_cpu *c = &s->cpus[i];
+		long f;
+
+		if (c->freq_fd < 0)
+			continue;
+		f = pread_number (c->freq_fd);
+		c->freq = f > 0 ? f : 0;
+		s->reads++;
+	}
+}
+
+/* min, median and max of n values, which get sorted */
+static void spread (double *v, unsigned n, double *min, double *median,
+		double *max)
+{
+	qsort (v, n, sizeof (*v), cmp_double);
+	*min = v[0];
+	*max = v[n-1];
+	*median = n % 2 ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+}
+
+static void push_spread (lua_State *L, const char *prefix, double *v,
+		unsigned n, double scale)
+{
+	double min, median, max;
+	char key[32];
+
+	if (!n)
+		return;
+	spread (v, n, &min, &median, &max);
+	snprintf (key, sizeof (key), "%s_min", prefix);
+	lua_pushnumber (L, min * scale);
+	lua_setfield (L, -2, key);
+	snprintf (key, sizeof (key), "%s_median", prefix);
+	lua_pushnumber (L, median * scale);
+	lua_setfield (L, -2, key);
+	snprintf (key, sizeof (key), "%s_max", prefix);
+	lua_pushnumber (L, max * scale);
+	lua_setfield (L, -2, key);
+}
+
+/* the cpus of the group in a fixed number of cells, each showing how busy
+ * its cpus were on average; offline ones show as '_' */
+static void push_heat (lua_State *L, struct lcs_sampler *s,
+		struct lcs_group *g)
+{
+	size_t levels = strlen (s->heat_chars);
+	char heat[64];
+	unsigned k;
+
+	for (k=0; k<s->heat_width; k++) {
+		unsigned a = k * g->count / s->heat_width;
+		unsigned b = (k + 1) * g->count / s->heat_width;
+		double sum = 0;
+		unsigned n = 0, i;
+
+		if (b <= a)
+			b = a + 1;
+		for (i=a; i<b; i++) {
+			struct lcs_cpu *c = &s->cpus[g->first + i];
+			if (c->util >= 0) {
+				sum += c->util;
+				n++;
+			}
+		}
+		if (!n)
+			heat[k] = '_';
+		else
+			heat[k] = s->heat_chars[(size_t)(sum / n * (levels - 1) + 0.5)];
+	}
+	lua_pushlstring (L, heat, s->heat_width);
+	lua_setfield (L, -2, "heat");
+}
+
+/* ------------------------------------------------------------------------
+ * lua: groups = s:sample() -- reads all cpus, returns a table per group
+ *
+ * Each group has name, cpus (how many), online, util_mean and util_min,
+ * util_median, util_max (busy fraction since the last sample), freq_min,
+ * freq_median, freq_max (MHz), freq_lo and freq_hi (the range it can run
+ * at, MHz), governor (that of its first cpu) and heat, a fixed width
+ * string showing how busy its cpus are.  Fields are missing when nothing
+ * is known, as there is no cpufreq in a VM.
+ */
+int l_cpustat_sample (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+	double *utils, *freqs;
+	unsigned gi;
+
+	if (!s->buf)
+		return lcs_pusherror (L, "cpustat: no cpus, rescan() failed");
+
+	if (sample_stat (s) < 0)
+		return lcs_pusherror (L, s->procstat);
+	sample_freq (s);
+	s->samples++;
+
+	utils = malloc (2 * s->ncpus * sizeof (double) + 1);
+	if (!utils)
+		return luaL_error (L, "cpustat: out of memory");
+	freqs = utils + s->ncpus;
+
+	lua_createtable (L, s->ngroups, 0);
+	for (gi=0; gi<s->ngroups; gi++) {
+		struct lcs_group *g = &s->groups[gi];
+		unsigned long lo = 0, hi = 0;
+		unsigned i, nu = 0, nf = 0;
+		double sum = 0;
+
+		for (i=0; i<g->count; i++) {
+			struct lcs_cpu *c = &s->cpus[g->first + i];
+			if (c->util >= 0) {
+				utils[nu++] = c->util;
+				sum += c->util;
+			}
+			if (c->freq && c->util >= 0)
+				freqs[nf++] = c->freq;
+			if (c->freq_lo && (!lo || c->freq_lo < lo))
+				lo = c->freq_lo;
+			if (c->freq_hi > hi)
+				hi = c->freq_hi;
+		}
+
+		lua_createtable (L, 0, 16);
+		lua_pushstring (L, g->name);
+		lua_setfield (L, -2, "name");
+		lua_pushinteger (L, g->count);
+		lua_setfield (L, -2, "cpus");
+		lua_pushinteger (L, nu);
+		lua_setfield (L, -2, "online");
+		if (nu) {
+			lua_pushnumber (L, sum / nu);
+			lua_setfield (L, -2, "util_mean");
+		}
+		push_spread (L, "util", utils, nu, 1);
+		push_spread (L, "freq", freqs, nf, 1e-3);
+		if (hi) {
+			lua_pushnumber (L, lo / 1e3);
+			lua_setfield (L, -2, "freq_lo");
+			lua_pushnumber (L, hi / 1e3);
+			lua_setfield (L, -2, "freq_hi");
+		}
+		if (*s->cpus[g->first].governor) {
+			lua_pushstring (L, s->cpus[g->first].governor);
+			lua_setfield (L, -2, "governor");
+		}
+		push_heat (L, s, g);
+
+		lua_rawseti (L, -2, gi + 1);
+	}
+
+	free (utils);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: ok = s:rescan() -- finds the cpus again, after some came online,
+ * or the governor was changed
+ */
+int l_cpustat_rescan (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+
+	if (lcs_sampler_scan (s) < 0)
+		return lcs_pusherror (L, s->sysdir);
+
+	lua_pushboolean (L, 1);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: list = s:cpus() -- the cpus as of the last sample
+ *
+ * Each has id, package, cluster, group (its name), util and freq (MHz),
+ * when they are known, and governor.
+ */
+int l_cpustat_cpus (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+	unsigned i;
+
+	lua_createtable (L, s->ncpus, 0);
+	for (i=0; i<s->ncpus; i++) {
+		struct lcs_cpu *c = &s->cpus[i];
+
+		lua_createtable (L, 0, 8);
+		lua_pushinteger (L, c->id);
+		lua_setfield (L, -2, "id");
+		lua_pushinteger (L, c->package);
+		lua_setfield (L, -2, "package");
+		lua_pushinteger (L, c->cluster);
+		lua_setfield (L, -2, "cluster");
+		lua_pushstring (L, s->groups[c->group].name);
+		lua_setfield (L, -2, "group");
+		if (c->util >= 0) {
+			lua_pushnumber (L, c->util);
+			lua_setfield (L, -2, "util");
+		}
+		if (c->freq) {
+			lua_pushnumber (L, c->freq / 1e3);
+			lua_setfield (L, -2, "freq");
+		}
+		if (*c->governor) {
+			lua_pushstring (L, c->governor);
+			lua_setfield (L, -2, "governor");
+		}
+		lua_rawseti (L, -2, i + 1);
+	}
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: t = s:stats() -- cpus, groups, grouping (as it is, once "auto" has
+ * picked one), samples, and reads (files read by all the samples together)
+ */
+int l_cpustat_stats (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+
+	lua_createtable (L, 0, 5);
+	lua_pushinteger (L, s->ncpus);
+	lua_setfield (L, -2, "cpus");
+	lua_pushinteger (L, s->ngroups);
+	lua_setfield (L, -2, "groups");
+	lua_pushstring (L, lcs_groupings[s->grouping]);
+	lua_setfield (L, -2, "grouping");
+	lua_pushnumber (L, s->samples);
+	lua_setfield (L, -2, "samples");
+	lua_pushnumber (L, s->reads);
+	lua_setfield (L, -2, "reads");
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: tostring(s), and the garbage collector
+ */
+int l_cpustat_tostring (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+
+	lua_pushfstring (L, "cpustat.sampler{%d cpus, %d groups by %s}",
+			(int)s->ncpus, (int)s->ngroups,
+			lcs_groupings[s->grouping]);
+	return 1;
+}
+
+int l_cpustat_gc (lua_State *L)
+{
+	struct lcs_sampler *s = lcs_checksampler (L, 1);
+
+	DBGF("** sampler:__gc (%p) **\n", s);
+
+	lcs_sampler_close (s);
+	free (s->sysdir);
+	free (s->procstat);
+	s->sysdir = s->procstat = NULL;
+	return 0;
+}
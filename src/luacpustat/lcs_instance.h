@@ -0,0 +1,95 @@
+#ifndef __LUACPUSTAT_INSTANCE_H__
+#define __LUACPUSTAT_INSTANCE_H__
+
+#include <lua.h>
+
+#define L_CPUSTAT_MT "cpustat.sampler_mt"
+
+#define LCS_SYSDIR "/sys/devices/system/cpu"
+#define LCS_PROCSTAT "/proc/stat"
+
+#define LCS_HEAT_WIDTH 8		// cells in a group's heat map
+#define LCS_HEAT_CHARS " .:-=+*#"	// from idle to busy
+#define LCS_GOVERNOR_SIZE 16
+
+/* how cpus are put together into groups */
+enum lcs_grouping {
+	LCS_BY_CPU,			// a group for each cpu
+	LCS_BY_CLUSTER,			// topology/cluster_id within a package
+	LCS_BY_PACKAGE,			// topology/physical_package_id
+	LCS_BY_ALL,			// one group for the whole machine
+	LCS_BY_AUTO,			// the finest of those, within max_groups
+};
+
+#define LCS_MAX_GROUPS 4		// for LCS_BY_AUTO, unless told otherwise
+
+struct lcs_cpu {
+	unsigned id;			// the N of cpuN
+	int package;			// topology ids, 0 if not known
+	int cluster;
+	unsigned group;			// index into the sampler's groups
+	int freq_fd;			// cpufreq/scaling_cur_freq, or -1
+	unsigned long freq_lo;		// kHz, the range it can run at
+	unsigned long freq_hi;
+	unsigned long freq;		// kHz, at the last sample
+	unsigned long long busy;	// /proc/stat counters at the last sample
+	unsigned long long total;
+	double util;			// busy fraction since the sample before,
+					// or -1 while it is offline
+	char governor[LCS_GOVERNOR_SIZE];
+};
+
+struct lcs_group {
+	char name[24];
+	unsigned first;			// cpus are sorted by group, then id
+	unsigned count;
+};
+
+/* the C representation of a sampler instance object
+ *
+ * The cpus are found once, by new() and rescan(); each has its frequency
+ * file kept open, and /proc/stat is kept open as well, so a sample reads
+ * them all with pread() and opens nothing. */
+struct lcs_sampler {
+	enum lcs_grouping wanted;
+	enum lcs_grouping grouping;	// as it is, after LCS_BY_AUTO
+	unsigned max_groups;
+	char *sysdir;
+	char *procstat;
+	int stat_fd;
+
+	struct lcs_cpu *cpus;
+	unsigned ncpus;
+	unsigned *by_id;		// index into cpus + 1, by cpu id
+	unsigned max_id;
+
+	struct lcs_group *groups;
+	unsigned ngroups;
+
+	char *buf;			// for /proc/stat
+	size_t buf_size;
+
+	unsigned heat_width;
+	char heat_chars[32];
+
+	unsigned long samples;
+	unsigned long long reads;	// files read by all samples
+};
+
+extern const char *lcs_groupings[];
+
+extern struct lcs_sampler *lcs_checksampler (lua_State *L, int narg);
+
+/* finds the cpus and opens their files; returns 0, or -1 with errno set */
+extern int lcs_sampler_scan (struct lcs_sampler *s);
+extern void lcs_sampler_close (struct lcs_sampler *s);
+
+/* exported api */
+extern int l_cpustat_tostring (lua_State *L);
+extern int l_cpustat_gc (lua_State *L);
+extern int l_cpustat_sample (lua_State *L);
+extern int l_cpustat_rescan (lua_State *L);
+extern int l_cpustat_cpus (lua_State *L);
+extern int l_cpustat_stats (lua_State *L);
+
+#endif // __LUACPUSTAT_INSTANCE_H__
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lcs_debug.h"
+#include "lcs_util.h"
+#include "lcs_instance.h"
+
+
+static const char *opt_string (lua_State *L, const char *key,
+		const char *dflt)
+{
+	const char *s = dflt;
+
+	lua_getfield (L, 1, key);
+	if (!lua_isnil (L, -1))
+		s = luaL_checkstring (L, -1);
+	lua_pop (L, 1);
+	return s;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: s = cpustat.new([options]) -- find the cpus, and a sampler for them
+ *
+ *    grouping   - "cpu", "cluster", "package" or "all"; "auto" (the
+ *                 default) takes the first of those that makes no more
+ *                 than max_groups groups, 4 by default
+ *    heat_width - cells in each group's heat map, 8 by default
+ *    heat_chars - from idle to busy, " .:-=+*#" by default
+ *    sysdir     - where the cpuN directories are
+ *    procstat   - the file with the cpu times
+ *
+ * The last two are there for testing.  Returns nil and an error if the
+ * cpus cannot be found.
+ */
+static int l_new (lua_State *L)
+{
+	struct lcs_sampler *s;
+	const char *grouping, *chars, *sysdir, *procstat;
+	lua_Integer width, max_groups;
+	int g;
+
+	if (!lua_isnoneornil (L, 1))
+		luaL_checktype (L, 1, LUA_TTABLE);
+	else {
+		lua_settop (L, 0);
+		lua_newtable (L);
+	}
+
+	grouping = opt_string (L, "grouping", "auto");
+	for (g=0; lcs_groupings[g] && strcmp (lcs_groupings[g], grouping); g++)
+		;
+	luaL_argcheck (L, lcs_groupings[g], 1, "unknown grouping");
+
+	lua_getfield (L, 1, "max_groups");
+	max_groups = luaL_optinteger (L, -1, LCS_MAX_GROUPS);
+	lua_pop (L, 1);
+	luaL_argcheck (L, max_groups > 0, 1, "max_groups must be positive");
+
+	chars = opt_string (L, "heat_chars", LCS_HEAT_CHARS);
+	luaL_argcheck (L, strlen (chars) >= 2 && strlen (chars) < 32, 1,
+			"heat_chars needs 2 to 31 characters");
+
+	lua_getfield (L, 1, "heat_width");
+	width = luaL_optinteger (L, -1, LCS_HEAT_WIDTH);
+	lua_pop (L, 1);
+	luaL_argcheck (L, width > 0 && width <= 64, 1,
+			"heat_width must be 1 to 64");
+
+	sysdir = opt_string (L, "sysdir", LCS_SYSDIR);
+	procstat = opt_string (L, "procstat", LCS_PROCSTAT);
+
+	DBGF("** cpustat.new (%s, %s) **\n", grouping, sysdir);
+
+	s = (struct lcs_sampler*)lua_newuserdata (L, sizeof (*s));
+	memset (s, 0, sizeof (*s));
+	s->stat_fd = -1;
+	s->wanted = (enum lcs_grouping)g;
+	s->max_groups = max_groups;
+	s->heat_width = width;
+	strcpy (s->heat_chars, chars);
+	s->sysdir = strdup (sysdir);
+	s->procstat = strdup (procstat);
+
+	luaL_getmetatable (L, L_CPUSTAT_MT);
+	lua_setmetatable (L, -2);
+
+	if (!s->sysdir || !s->procstat)
+		return luaL_error (L, "cpustat: out of memory");
+	if (lcs_sampler_scan (s) < 0)
+		return lcs_pusherror (L, sysdir);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * the class method table
+ */
+static const luaL_reg class_table[] =
+{
+	{ "new",		l_new },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the instance method table
+ */
+static const luaL_reg instance_table[] =
+{
+	{ "__tostring",		l_cpustat_tostring },
+	{ "__gc",		l_cpustat_gc },
+
+	{ "sample",		l_cpustat_sample },
+	{ "rescan",		l_cpustat_rescan },
+	{ "cpus",		l_cpustat_cpus },
+	{ "stats",		l_cpustat_stats },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the class metatable
+ */
+static int lcs_init_cpustat_class (lua_State *L)
+{
+	luaL_newmetatable(L, L_CPUSTAT_MT);
+
+	// setup the __index and __gc field
+	lua_pushstring (L, "__index");
+	lua_pushvalue (L, -2);		// pushes the new metatable
+	lua_settable (L, -3);		// metatable.__index = metatable
+
+	luaL_openlib (L, NULL, instance_table, 0);
+
+	luaL_openlib (L, "cpustat", class_table, 0);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * library entry
+ */
+LUALIB_API int luaopen_cpustat (lua_State *L)
+{
+	return lcs_init_cpustat_class (L);
+}
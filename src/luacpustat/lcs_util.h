@@ -0,0 +1,8 @@
+#ifndef __LUACPUSTAT_UTIL_H__
+#define __LUACPUSTAT_UTIL_H__
+
+#include <lua.h>
+
+extern int lcs_pusherror(lua_State *L, const char *info);
+
+#endif // __LUACPUSTAT_UTIL_H__
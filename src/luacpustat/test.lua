@@ -0,0 +1,136 @@
+#!/usr/bin/env lua
+
+require "cpustat"
+
+-- a machine of two packages, with two clusters of four cpus each; cpu5
+-- is offline, and the second package has no cpufreq
+local root = os.tmpname ()
+os.remove (root)
+local sysdir = root .. "/cpu"
+local procstat = root .. "/stat"
+
+local function write (path, s)
+        local f = assert (io.open (path, "w"))
+        f:write (s)
+        f:close ()
+end
+
+local function make_cpu (id)
+        local dir = sysdir .. "/cpu" .. id
+        local package = math.floor (id / 8)
+        os.execute ("mkdir -p " .. dir .. "/topology")
+        write (dir .. "/topology/physical_package_id", package .. "\n")
+        write (dir .. "/topology/cluster_id", math.floor (id / 4) % 2 .. "\n")
+        if package == 0 then
+                os.execute ("mkdir -p " .. dir .. "/cpufreq")
+                write (dir .. "/cpufreq/cpuinfo_min_freq", "800000\n")
+                write (dir .. "/cpufreq/cpuinfo_max_freq", "3600000\n")
+                write (dir .. "/cpufreq/scaling_governor", "schedutil\n")
+                write (dir .. "/cpufreq/scaling_cur_freq", (1000 + id * 200) * 1000 .. "\n")
+        end
+end
+
+for id = 0, 15 do
+        make_cpu (id)
+end
+os.execute ("mkdir -p " .. sysdir .. "/cpufreq " .. sysdir .. "/cpuidle")
+
+-- busy jiffies of each cpu, the rest of 100 per sample are idle
+local ticks = {}
+local last_cpu = 15
+local function stat (busy)
+        local lines = { "cpu  0 0 0 0 0 0 0 0 0 0" }
+        for id = 0, last_cpu do
+                if id ~= 5 then
+                        ticks[id] = ticks[id] or { 0, 0 }
+                        local t = ticks[id]
+                        t[1] = t[1] + busy (id)
+                        t[2] = t[2] + 100 - busy (id)
+                        lines[#lines+1] = string.format ("cpu%d %d 0 0 %d 0 0 0 0 0 0",
+                                id, t[1], t[2])
+                end
+        end
+        lines[#lines+1] = "intr 12345 0 0"
+        write (procstat, table.concat (lines, "\n") .. "\n")
+end
+
+local function show (groups)
+        for _, g in ipairs (groups) do
+                print (string.format ("  %-6s %2d cpus %2d online  util %.2f/%.2f/%.2f mean %.2f"
+                        .. "  freq %s  [%s]",
+                        g.name, g.cpus, g.online, g.util_min or -1, g.util_median or -1,
+                        g.util_max or -1, g.util_mean or -1,
+                        g.freq_median and string.format ("%d/%d/%d MHz %s",
+                                g.freq_min, g.freq_median, g.freq_max, g.governor)
+                                or "-", g.heat))
+        end
+end
+
+stat (function (id) return 0 end)
+
+for _, grouping in ipairs { "package", "cluster", "all" } do
+        print ("grouping by " .. grouping .. "...")
+        local s = assert (cpustat.new { grouping = grouping, sysdir = sysdir,
+                procstat = procstat })
+        print ("  " .. tostring (s))
+        s:sample ()
+        stat (function (id) return id * 6 end)
+        show (s:sample ())
+end
+
+print ("a cpu each, with a wide heat map...")
+local s = assert (cpustat.new { grouping = "cpu", sysdir = sysdir,
+        procstat = procstat, heat_width = 2, heat_chars = "01" })
+s:sample ()
+stat (function (id) return id % 2 * 100 end)
+local groups = s:sample ()
+print ("  " .. #groups .. " groups, cpu4 " .. groups[5].heat .. ", cpu5 " .. groups[6].heat
+        .. ", cpu7 " .. groups[8].heat)
+
+print ("cpus...")
+for _, c in ipairs (s:cpus ()) do
+        if c.id % 5 == 0 then
+                print (string.format ("  cpu%d: P%d C%d in %s, util %s, freq %s",
+                        c.id, c.package, c.cluster, c.group, tostring (c.util),
+                        tostring (c.freq)))
+        end
+end
+
+print ("auto grouping...")
+for _, max in ipairs { 16, 4, 2, 1 } do
+        s = assert (cpustat.new { max_groups = max, sysdir = sysdir,
+                procstat = procstat })
+        print ("  " .. max .. " groups at most: " .. s:stats ().grouping)
+end
+
+print ("rescan after a cpu comes online...")
+s = assert (cpustat.new { sysdir = sysdir, procstat = procstat })
+s:sample ()
+print ("  before: " .. tostring (s))
+make_cpu (16)
+last_cpu = 16
+stat (function (id) return 50 end)
+assert (s:rescan ())
+print ("  after:  " .. tostring (s))
+s:sample ()
+stat (function (id) return 50 end)
+show (s:sample ())
+local st = s:stats ()
+print (string.format ("  %d cpus, %d groups, %d samples, %d reads",
+        st.cpus, st.groups, st.samples, st.reads))
+
+print ("this machine...")
+s = cpustat.new ()
+if s then
+        print ("  " .. tostring (s))
+        s:sample ()
+        show (s:sample ())
+end
+
+print ("errors...")
+print ("  " .. tostring (select (2, cpustat.new { sysdir = root .. "/none" })))
+print ("  " .. select (2, pcall (cpustat.new, { grouping = "core" })))
+
+os.execute ("rm -rf " .. root)
+
+print ("finished!")
@@ -0,0 +1,79 @@
+#!/usr/bin/env lua
+--
+-- compare calling into eventloop through the lua API with the plain C
+-- functions of core/fastpath.lua, which LuaJIT calls through its FFI;
+-- elsewhere fastpath falls back to the lua API, and so should match it
+--
+--   ./bench_ffi.lua [calls] [records]
+--
+
+package.path = "../core/?.lua;" .. package.path
+package.cpath = "../luaixp/?.so;" .. package.cpath
+
+require "compat"
+require "eventloop"
+local fastpath = require "fastpath"
+
+local calls = tonumber(arg[1]) or 1000000
+local records = tonumber(arg[2]) or 200000
+
+print (string.format ("%s, ffi fast path %s", jit and jit.version or _VERSION,
+                      fastpath.enabled and "on" or "off"))
+
+-- the cost of a call that does next to nothing
+local function per_call (name, now)
+        local t = os.clock ()
+        for i=1,calls do
+                now ()
+        end
+        t = os.clock () - t
+        print (string.format ("%-24s %8.1f ns/call", name, t * 1e9 / calls))
+end
+
+per_call ("eventloop.now", eventloop.now)
+per_call ("fastpath.now", fastpath.now)
+
+-- the cost of passing on a record, reading included
+local function per_record (name, add)
+        local el = eventloop.new ()
+        local n, sum = 0, 0
+        local done = false
+        add (el, "seq 1 " .. records, function (line, err)
+                if not line then
+                        done = true
+                        return
+                end
+                n = n + 1
+                sum = sum + #line
+        end)
+        local t = os.clock ()
+        while not done do
+                el:run_loop (1)
+        end
+        t = os.clock () - t
+        assert (n == records, name .. " passed on " .. n .. " records")
+        print (string.format ("%-24s %8.1f ns/record", name, t * 1e9 / n))
+end
+
+per_record ("callback", function (el, cmd, fn)
+        return el:add_exec (cmd, fn)
+end)
+
+per_record ("pull, el:next_record", function (el, cmd, fn)
+        local fd
+        fd = el:add_exec (cmd, function (ready, err)
+                if ready ~= true then
+                        return fn (ready, err)
+                end
+                local rec = el:next_record (fd)
+                while rec do
+                        fn (rec)
+                        rec = el:next_record (fd)
+                end
+        end, { pull = true })
+        return fd
+end)
+
+per_record ("fastpath.add_exec", function (el, cmd, fn)
+        return fastpath.add_exec (el, cmd, fn)
+end)
@@ -0,0 +1,125 @@
+#!/usr/bin/env lua
+--
+-- replay wmii events the way wmiirc handles them, and compare how long
+-- single events take under each garbage collector mode
+--
+--   ./bench_gc.lua [events] [heap MB] [event log]
+--
+-- the event log is what `wmiir read /event` prints; without one a mix of
+-- focus, tag and bar events is made up
+--
+
+require "eventloop"
+
+local count = tonumber(arg[1]) or 200000
+local heap_mb = tonumber(arg[2]) or 16
+local log_file = arg[3]
+
+local events = {}
+if log_file then
+        for line in io.lines (log_file) do
+                events[#events+1] = line
+        end
+else
+        local kinds = { "ClientFocus 0x%x", "FocusTag %d", "UnfocusTag %d",
+                        "CreateClient 0x%x", "DestroyClient 0x%x",
+                        "LeftBarClick 1 %d", "RightBarMouseDown 4 800_vol%d",
+                        "FocusFloating", "AreaFocus %d" }
+        for i=1,997 do
+                local k = kinds[i % #kinds + 1]
+                events[#events+1] = string.format (k, (i * 7919) % 4096)
+        end
+end
+
+-- what wmiirc keeps for good: clients, histories, plugin state
+local ballast = {}
+local function grow_to (mb)
+        while collectgarbage ("count") < mb * 1024 do
+                local n = #ballast
+                ballast[n+1] = { id = n, name = "client " .. n,
+                                 tags = { "1", "web", tostring(n % 9) } }
+        end
+end
+
+-- what a handler does with an event: take it apart, update the state it
+-- keeps and redraw a widget
+local clients = {}
+local recent = {}
+local function handle (line)
+        local ev, arg = line:match ("^(%S+)%s*(.*)$")
+        local args = {}
+        for word in arg:gmatch ("%S+") do
+                args[#args+1] = word
+        end
+        local c = clients[args[1] or ev]
+        if not c or ev == "CreateClient" then
+                c = { id = args[1], seen = 0, props = {} }
+                clients[args[1] or ev] = c
+        end
+        c.seen = c.seen + 1
+        c.props[ev] = line
+        if ev == "DestroyClient" then
+                clients[args[1]] = nil
+        end
+
+        recent[#recent % 200 + 1] = ev .. " " .. arg
+        local parts = {}
+        for i=1,6 do
+                parts[i] = string.format ("%s:%d", ev, c.seen + i)
+        end
+        return table.concat (parts, " | ")
+end
+
+-- runs the events, keeps how long each took in times, in microseconds
+local times = {}
+local function replay ()
+        local now = eventloop.now
+        local n = #events
+        for i=1,count do
+                local t = now()
+                handle (events[(i - 1) % n + 1])
+                times[i] = (now() - t) * 1e6
+        end
+end
+
+local function pct (p)
+        return times[math.max (1, math.floor (count * p))]
+end
+
+-- 5.1 knows neither mode, and only 5.4 takes the parameters with them
+local function incremental (pause, stepmul)
+        if not pcall (collectgarbage, "incremental", pause, stepmul) then
+                collectgarbage ("setpause", pause)
+                collectgarbage ("setstepmul", stepmul)
+        end
+        return true
+end
+
+local modes = {
+        { "incremental 200/100", function () return incremental (200, 100) end },
+        { "incremental 100/200", function () return incremental (100, 200) end },
+        { "generational 20/100", function ()
+                return _VERSION >= "Lua 5.4"
+                        and pcall (collectgarbage, "generational", 20, 100)
+        end },
+}
+
+grow_to (heap_mb)
+print (string.format ("%s, %d events, %.0f MB kept",
+                      _VERSION, count, collectgarbage ("count") / 1024))
+print (string.format ("%-20s %9s %9s %9s %9s %9s", "mode",
+                      "total ms", "p50 us", "p99 us", "p99.9 us", "max us"))
+for _, m in ipairs (modes) do
+        collectgarbage ("collect")
+        if not m[2] () then
+                print (string.format ("%-20s %9s", m[1], "n/a"))
+        else
+                local t = eventloop.now()
+                replay ()
+                t = eventloop.now() - t
+                table.sort (times)
+                print (string.format ("%-20s %9.0f %9.1f %9.1f %9.1f %9.1f",
+                                      m[1], t * 1e3, pct (0.5), pct (0.99),
+                                      pct (0.999), times[count]))
+        end
+end
@@ -0,0 +1,55 @@
+#!/usr/bin/env lua
+--
+-- compare the cost of os.execute() with the spawn helper as the heap grows
+--
+--   ./bench_spawn.lua [runs] [max heap MB]
+--
+
+require "eventloop"
+
+local runs = tonumber(arg[1]) or 200
+local max_mb = tonumber(arg[2]) or 256
+
+-- the helper is forked before the heap grows, as wmii.lua does
+local sp = assert(eventloop.spawner())
+
+local function time (fn)
+        local t = eventloop.now()
+        for i=1,runs do
+                fn()
+        end
+        return (eventloop.now() - t) * 1e6 / runs
+end
+
+local function os_execute ()
+        os.execute ("true")
+end
+
+local function spawn_wait ()
+        assert(sp:spawn { argv = { "true" }, wait = true })
+end
+
+local function spawn_sh ()
+        assert(sp:spawn { argv = { "/bin/sh", "-c", "true" }, wait = true })
+end
+
+-- each entry is a distinct string, so this really is heap
+local ballast = {}
+local function grow_to (mb)
+        while collectgarbage ("count") < mb * 1024 do
+                ballast[#ballast+1] = string.rep (string.char (#ballast % 256), 1000) .. #ballast
+        end
+end
+
+print (string.format ("%8s %14s %14s %14s", "heap MB",
+                      "os.execute us", "spawn us", "spawn sh us"))
+local mb = 1
+while mb <= max_mb do
+        grow_to (mb)
+        print (string.format ("%8d %14.1f %14.1f %14.1f",
+                              collectgarbage ("count") / 1024,
+                              time (os_execute), time (spawn_wait), time (spawn_sh)))
+        mb = mb * 4
+end
+
+sp:close ()
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lel_debug.h"
+#include "lel_util.h"
+#include "lel_instance.h"
+#include "lel_children.h"
+
+/*
+ * Resource accounting for the programs started by add_exec(), and for
+ * other pids that wmii.lua asks us to watch (like programs launched through
+ * the spawn helper).  Live numbers come from /proc/<pid>, or from the
+ * child's own cgroup when a delegated cgroup v2 directory was given with
+ * el:set_cgroup(); a cgroup also covers everything the child forks.
+ */
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+static double mono_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* reads a small file into buf, NUL terminated; returns the length or -1 */
+static ssize_t read_small (const char *dir, const char *file,
+		char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	ssize_t rc;
+	int fd;
+
+	snprintf (path, sizeof (path), "%s/%s", dir, file);
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	do {
+		rc = read (fd, buf, size - 1);
+	} while (rc < 0 && errno == EINTR);
+	close (fd);
+
+	if (rc < 0)
+		return -1;
+	buf[rc] = 0;
+	return rc;
+}
+
+/* makes the cgroup directory for a new child; returns the directory, and
+ * the fd of its cgroup.procs in *procs_fd */
+static char * cgroup_create (struct lel_eventloop *el, int *procs_fd)
+{
+	char *dir;
+	char procs[PATH_MAX];
+	size_t len;
+
+	len = strlen (el->cgroup_base) + 32;
+	dir = malloc (len);
+	if (!dir)
+		return NULL;
+
+	snprintf (dir, len, "%s/exec-%d-%u", el->cgroup_base, (int)getpid (),
+			++el->cgroup_seq);
+	if (mkdir (dir, 0755) < 0 && errno != EEXIST) {
+		DBGF("** mkdir %s: %s **\n", dir, strerror (errno));
+		free (dir);
+		return NULL;
+	}
+
+	snprintf (procs, sizeof (procs), "%s/cgroup.procs", dir);
+	*procs_fd = open (procs, O_WRONLY | O_CLOEXEC);
+	if (*procs_fd < 0) {
+		rmdir (dir);
+		free (dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static struct lel_child * children_find (struct lel_eventloop *el, int pid)
+{
+	size_t i;
+
+	for (i=0; i<el->children_count; i++)
+		if (el->children[i].pid == pid && !el->children[i].ended)
+			return &el->children[i];
+
+	return NULL;
+}
+
+static void child_free (struct lel_child *c)
+{
+	if (c->cgroup) {
+		// fails while something it forked is still in there
+		rmdir (c->cgroup);
+		free (c->cgroup);
+	}
+	free (c->name);
+}
+
+/* the cgroup of an exited child goes away once everything in it is gone */
+static void child_ended (struct lel_child *c, double now)
+{
+	c->ended = now;
+
+	if (c->cgroup && !rmdir (c->cgroup)) {
+		free (c->cgroup);
+		c->cgroup = NULL;
+	}
+}
+
+/* forgets the oldest exited children beyond LEL_CHILDREN_EXITED_KEEP */
+static void children_trim (struct lel_eventloop *el)
+{
+	size_t i, exited = 0;
+
+	for (i=0; i<el->children_count; i++)
+		if (el->children[i].ended)
+			exited++;
+
+	while (exited > LEL_CHILDREN_EXITED_KEEP) {
+		size_t oldest = el->children_count;
+
+		for (i=0; i<el->children_count; i++) {
+			if (!el->children[i].ended)
+				continue;
+			if (oldest == el->children_count
+					|| el->children[i].ended
+					< el->children[oldest].ended)
+				oldest = i;
+		}
+
+		child_free (&el->children[oldest]);
+		el->children_count--;
+		memmove (&el->children[oldest], &el->children[oldest+1],
+				(el->children_count - oldest)
+				* sizeof (struct lel_child));
+		exited--;
+	}
+}
+
+/* refreshes the live numbers; returns -1 when the process is gone */
+static int child_read_live (struct lel_child *c)
+{
+	char buf[1024];
+	char dir[64];
+	char *p;
+
+	if (c->cgroup) {
+		unsigned long long usec, r, w;
+
+		if (read_small (c->cgroup, "cpu.stat", buf, sizeof (buf)) > 0
+				&& (p = strstr (buf, "usage_usec "))
+				&& sscanf (p, "usage_usec %llu", &usec) == 1)
+			c->cpu = usec / 1e6;
+
+		// only there with the memory and io controllers enabled
+		if (read_small (c->cgroup, "memory.current", buf,
+					sizeof (buf)) > 0)
+			c->rss = strtoull (buf, NULL, 10) / 1024;
+		if (read_small (c->cgroup, "memory.peak", buf,
+					sizeof (buf)) > 0)
+			c->rss_peak = strtoull (buf, NULL, 10) / 1024;
+		if (c->rss > c->rss_peak)
+			c->rss_peak = c->rss;
+
+		if (read_small (c->cgroup, "io.stat", buf, sizeof (buf)) > 0) {
+			c->read_bytes = c->write_bytes = 0;
+			for (p = buf; (p = strstr (p, "rbytes=")); p++) {
+				if (sscanf (p, "rbytes=%llu wbytes=%llu",
+							&r, &w) == 2) {
+					c->read_bytes += r;
+					c->write_bytes += w;
+				}
+			}
+		}
+
+		if (!c->own) {
+			snprintf (dir, sizeof (dir), "/proc/%d", c->pid);
+			if (access (dir, F_OK) < 0)
+				return -1;
+		}
+		return 0;
+	}
+
+	snprintf (dir, sizeof (dir), "/proc/%d", c->pid);
+
+	if (read_small (dir, "stat", buf, sizeof (buf)) > 0
+			&& (p = strrchr (buf, ')'))) {
+		unsigned long utime, stime;
+		long cutime, cstime, rss;
+
+		// fields 3 to 24 of proc(5), after the command name
+		if (sscanf (p + 1, " %*c %*d %*d %*d %*d %*d %*u"
+					" %*u %*u %*u %*u %lu %lu %ld %ld"
+					" %*d %*d %*d %*d %*u %*u %ld",
+					&utime, &stime, &cutime, &cstime,
+					&rss) == 5) {
+			double hz = sysconf (_SC_CLK_TCK);
+			c->cpu = (utime + stime + cutime + cstime) / hz;
+			c->rss = rss * (sysconf (_SC_PAGESIZE) / 1024);
+			if (c->rss > c->rss_peak)
+				c->rss_peak = c->rss;
+		}
+	} else
+		return -1;
+
+	// not readable for programs that changed their credentials
+	if (read_small (dir, "io", buf, sizeof (buf)) > 0) {
+		if ((p = strstr (buf, "\nread_bytes: ")))
+			c->read_bytes = strtoull (p + 13, NULL, 10);
+		if ((p = strstr (buf, "\nwrite_bytes: ")))
+			c->write_bytes = strtoull (p + 14, NULL, 10);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * used by add_exec() and run_loop()
+ */
+
+int lel_children_cgroup_open (struct lel_eventloop *el, char **path)
+{
+	int fd = -1;
+
+	*path = NULL;
+	if (!el->cgroup_base)
+		return -1;
+
+	*path = cgroup_create (el, &fd);
+	return *path ? fd : -1;
+}
+
+void lel_children_add (struct lel_eventloop *el, int pid, const char *name,
+		char *cgroup, int own)
+{
+	struct lel_child *c;
+
+	if (el->children_size <= el->children_count) {
+		size_t size = el->children_size + LEL_CHILDREN_GROWS_BY;
+
+		c = realloc (el->children, size * sizeof (struct lel_child));
+		if (!c) {
+			// we just won't account for this one
+			if (cgroup) {
+				rmdir (cgroup);
+				free (cgroup);
+			}
+			return;
+		}
+		el->children = c;
+		el->children_size = size;
+	}
+
+	c = &el->children[el->children_count++];
+	memset (c, 0, sizeof (*c));
+	c->pid = pid;
+	c->own = own;
+	c->name = strdup (name ? name : "");
+	c->cgroup = cgroup;
+	c->started = mono_now ();
+	c->status = -1;
+}
+
+/* collects the exit status and final rusage of children that quit */
+void lel_children_reap (struct lel_eventloop *el)
+{
+	struct rusage ru;
+	int status, pid;
+
+	while ((pid = wait4 (-1, &status, WNOHANG, &ru)) > 0) {
+		struct lel_child *c = children_find (el, pid);
+
+		if (!c)
+			continue;
+
+		if (c->cgroup)
+			// has the totals of the whole tree
+			child_read_live (c);
+		else {
+			c->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+				+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+			c->read_bytes = (unsigned long long)ru.ru_inblock * 512;
+			c->write_bytes = (unsigned long long)ru.ru_oublock * 512;
+		}
+		// not ru_maxrss: a vforked child starts out with our own peak,
+		// and exec keeps it; what we saw of it is all we have
+		c->rss = c->rss_peak;
+
+		if (WIFEXITED (status))
+			c->status = WEXITSTATUS (status);
+		else if (WIFSIGNALED (status))
+			c->status = 128 + WTERMSIG (status);
+
+		child_ended (c, mono_now ());
+
+		DBGF("** child %d (%s) exited with %d, %.2fs cpu **\n",
+				c->pid, c->name, c->status, c->cpu);
+	}
+
+	children_trim (el);
+}
+
+void lel_children_free (struct lel_eventloop *el)
+{
+	size_t i;
+
+	for (i=0; i<el->children_count; i++)
+		child_free (&el->children[i]);
+
+	free (el->children);
+	free (el->cgroup_base);
+	el->children = NULL;
+	el->children_count = el->children_size = 0;
+	el->cgroup_base = NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * lists running and recently exited children
+ *
+ * lua: list = el:children()
+ *
+ *    list - an array of tables with pid, name, fd (of a running add_exec()
+ *           program), running, status (once exited), started and runtime
+ *           (seconds), cpu (seconds), rss (kB; the most seen once exited),
+ *           read_bytes, write_bytes and cgroup
+ */
+int l_eventloop_children (lua_State *L)
+{
+	struct lel_eventloop *el;
+	double now;
+	size_t i, j;
+
+	el = lel_checkeventloop (L, 1);
+	now = mono_now ();
+
+	lel_children_reap (el);
+
+	lua_createtable (L, el->children_count, 0);
+	for (i=0; i<el->children_count; i++) {
+		struct lel_child *c = &el->children[i];
+
+		if (!c->ended && child_read_live (c) < 0 && !c->own)
+			// a watched pid went away; it is not ours to wait for
+			child_ended (c, now);
+
+		lua_createtable (L, 0, 12);
+
+		lua_pushinteger (L, c->pid);
+		lua_setfield (L, -2, "pid");
+		lua_pushstring (L, c->name);
+		lua_setfield (L, -2, "name");
+
+		for (j=0; !c->ended && j<el->progs_count; j++) {
+			if (el->progs[j]->pid == c->pid) {
+				lua_pushinteger (L, el->progs[j]->fd);
+				lua_setfield (L, -2, "fd");
+				break;
+			}
+		}
+
+		lua_pushboolean (L, !c->ended);
+		lua_setfield (L, -2, "running");
+		if (c->ended && c->status >= 0) {
+			lua_pushinteger (L, c->status);
+			lua_setfield (L, -2, "status");
+		}
+
+		lua_pushnumber (L, c->started);
+		lua_setfield (L, -2, "started");
+		lua_pushnumber (L, (c->ended ? c->ended : now) - c->started);
+		lua_setfield (L, -2, "runtime");
+
+		lua_pushnumber (L, c->cpu);
+		lua_setfield (L, -2, "cpu");
+		lua_pushnumber (L, c->rss);
+		lua_setfield (L, -2, "rss");
+		lua_pushnumber (L, c->read_bytes);
+		lua_setfield (L, -2, "read_bytes");
+		lua_pushnumber (L, c->write_bytes);
+		lua_setfield (L, -2, "write_bytes");
+
+		if (c->cgroup) {
+			lua_pushstring (L, c->cgroup);
+			lua_setfield (L, -2, "cgroup");
+		}
+
+		lua_rawseti (L, -2, i+1);
+	}
+
+	children_trim (el);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * accounts for a process we did not start through add_exec()
+ *
+ * lua: ok = el:watch_pid(pid, name)
+ *
+ *    with a cgroup directory set, the process is moved into its own cgroup
+ */
+int l_eventloop_watch_pid (lua_State *L)
+{
+	struct lel_eventloop *el;
+	const char *name;
+	char *cgroup = NULL;
+	int pid, fd;
+
+	el = lel_checkeventloop (L, 1);
+	pid = luaL_checkinteger (L, 2);
+	name = luaL_optstring (L, 3, "");
+
+	DBGF("** eventloop:watch_pid (%d, %s) **\n", pid, name);
+
+	if (pid <= 0 || (kill (pid, 0) < 0 && errno != EPERM))
+		return lel_pusherror (L, "cannot watch pid");
+
+	if (children_find (el, pid)) {
+		lua_pushboolean (L, 1);
+		return 1;
+	}
+
+	if (el->cgroup_base && (cgroup = cgroup_create (el, &fd))) {
+		char buf[32];
+		int len = snprintf (buf, sizeof (buf), "%d", pid);
+
+		if (write (fd, buf, len) != len) {
+			rmdir (cgroup);
+			free (cgroup);
+			cgroup = NULL;
+		}
+		close (fd);
+	}
+
+	lel_children_add (el, pid, name, cgroup, 0);
+
+	lua_pushboolean (L, 1);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * sets the cgroup v2 directory under which each program started from now
+ * on gets a cgroup of its own; it must be delegated to us, that is
+ * writable, with cgroup.procs writable
+ *
+ * lua: ok = el:set_cgroup(path) -- or nil to stop
+ */
+int l_eventloop_set_cgroup (lua_State *L)
+{
+	struct lel_eventloop *el;
+	const char *path;
+	char procs[PATH_MAX];
+	struct stat st;
+
+	el = lel_checkeventloop (L, 1);
+	path = luaL_optstring (L, 2, NULL);
+
+	DBGF("** eventloop:set_cgroup (%s) **\n", path ? path : "nil");
+
+	if (path) {
+		if (stat (path, &st) < 0)
+			return lel_pusherror (L, path);
+		if (!S_ISDIR (st.st_mode)) {
+			errno = ENOTDIR;
+			return lel_pusherror (L, path);
+		}
+
+		snprintf (procs, sizeof (procs), "%s/cgroup.procs", path);
+		if (access (path, W_OK) < 0 || access (procs, W_OK) < 0)
+			return lel_pusherror (L, "cgroup is not delegated to us");
+	}
+
+	free (el->cgroup_base);
+	el->cgroup_base = path ? strdup (path) : NULL;
+
+	lua_pushboolean (L, 1);
+	return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef __LUAIXP_CHILDREN_H__
+#define __LUAIXP_CHILDREN_H__
+
+#include <lua.h>
+
+struct lel_eventloop;
+
+/* what we know about a program we started or were asked to watch */
+struct lel_child {
+	int pid;
+	int own;		// our child; reaped with wait4()
+	char *name;
+	char *cgroup;		// its own cgroup directory, or NULL
+	double started;		// eventloop.now() when it was added
+	double ended;		// when it exited, 0 while running
+	int status;		// exit code or 128+signal, -1 when unknown
+	double cpu;		// user and system seconds
+	long rss;		// kB; the peak once it exited
+	long rss_peak;		// kB; the most seen, or the cgroup's memory.peak
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+};
+
+/* exited children are kept around to be reported, up to this many */
+#define LEL_CHILDREN_EXITED_KEEP 16
+#define LEL_CHILDREN_GROWS_BY 16
+
+/* returns an open cgroup.procs of a new cgroup for the next child, which
+ * writes "0" to it before exec; -1 without a cgroup base */
+extern int lel_children_cgroup_open (struct lel_eventloop *el, char **path);
+extern void lel_children_add (struct lel_eventloop *el, int pid,
+		const char *name, char *cgroup, int own);
+extern void lel_children_reap (struct lel_eventloop *el);
+extern void lel_children_free (struct lel_eventloop *el);
+
+/* exported api */
+extern int l_eventloop_children (lua_State *L);
+extern int l_eventloop_watch_pid (lua_State *L);
+extern int l_eventloop_set_cgroup (lua_State *L);
+
+#endif // __LUAIXP_CHILDREN_H__
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lel_debug.h"
+#include "lel_instance.h"
+#include "lel_ffi.h"
+
+
+/* ------------------------------------------------------------------------
+ * the functions
+ */
+
+static double ffi_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int ffi_next_record (void *el, int fd, const char **s, size_t *len)
+{
+	return lel_next_record ((struct lel_eventloop*)el, fd, s, len);
+}
+
+static const struct lel_ffi_api ffi_api = {
+	.version	= LEL_FFI_VERSION,
+	.now		= ffi_now,
+	.next_record	= ffi_next_record,
+};
+
+/* ------------------------------------------------------------------------
+ * lua: api = eventloop.ffi_api() -- the plain C functions, as a pointer
+ *
+ * To be cast to a struct lel_ffi_api pointer with LuaJIT's ffi.cast().
+ */
+int l_eventloop_ffi_api (lua_State *L)
+{
+	lua_pushlightuserdata (L, (void*)&ffi_api);
+	return 1;
+}
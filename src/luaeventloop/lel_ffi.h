@@ -0,0 +1,25 @@
+#ifndef __LUAIXP_FFI_H__
+#define __LUAIXP_FFI_H__
+
+#include <stddef.h>
+#include <lua.h>
+
+/* The hot calls as plain C functions, for LuaJIT's FFI to call from
+ * compiled code; through the lua_State API every call ends the trace.
+ * eventloop.ffi_api() hands out a pointer to this table, so nothing has to
+ * be looked up with dlsym() in a module loaded RTLD_LOCAL.  The eventloop
+ * argument is the userdata itself, which the FFI passes as a pointer to
+ * its contents.  core/fastpath.lua declares the same struct; bump the
+ * version when it changes. */
+#define LEL_FFI_VERSION 1
+
+struct lel_ffi_api {
+	int version;
+	double (*now) (void);
+	int (*next_record) (void *el, int fd, const char **s, size_t *len);
+};
+
+/* exported api */
+extern int l_eventloop_ffi_api (lua_State *L);
+
+#endif // __LUAIXP_FFI_H__
@@ -17,10 +17,19 @@
 #include "lel_debug.h"
 #include "lel_util.h"
 #include "lel_instance.h"
+#include "lel_json.h"
+#include "lel_children.h"
 
 // local hepers
-static int loop_handle_event (lua_State *L, struct lel_program *prog);
+static int loop_handle_event (lua_State *L, struct lel_eventloop *el,
+		struct lel_program *prog);
+static void lua_issue_callback (lua_State *L, struct lel_program *prog);
 static void kill_exec (lua_State *L, struct lel_eventloop *el, int fd);
+static void prog_free (struct lel_program *prog);
+static void prog_service (lua_State *L, struct lel_eventloop *el,
+		struct lel_program *prog);
+static int frame_next (struct lel_program *prog, size_t *off, size_t *len,
+		size_t *used);
 
 /* ------------------------------------------------------------------------
  * utility functions
@@ -76,6 +85,20 @@ static void progs_add (struct lel_eventloop *el, struct lel_program *prog)
 			progs_compare);
 }
 
+static struct lel_program * progs_find (struct lel_eventloop *el, int fd)
+{
+	struct lel_program key = {.fd = fd};
+	struct lel_program *pkey = &key;
+	struct lel_program **pfound;
+
+	pfound = bsearch (&pkey, el->progs, el->progs_count,
+			sizeof (struct lel_program*), progs_compare);
+	if (!pfound)
+		return NULL;
+
+	return *pfound;
+}
+
 static struct lel_program * progs_remove (struct lel_eventloop *el, int fd)
 {
 	struct lel_program key = {.fd = fd};
@@ -106,64 +129,196 @@ static struct lel_program * progs_remove (struct lel_eventloop *el, int fd)
 /* ------------------------------------------------------------------------
  * executes a new process to handle events from another source
  *
- * lua: fd = el:add_exec(cmd, function) 
+ * lua: fd = el:add_exec(cmd, function [, options])
  *
  *    cmd - a string with program and parameters for execution
  *    function - a function to call back with data read
+ *    options - an optional table with
+ *        framing - how output is split into records:
+ *                  "line" (default) - newline terminated
+ *                  "nul" - NUL terminated
+ *                  "netstring" - <length>:<data>,
+ *                  "length" - 4 byte big endian length followed by data
+ *                  "json" - one JSON value per line, passed as a lua value;
+ *                           the function gets false and a message for
+ *                           records that do not parse
+ *        max_record - longest record in bytes; longer newline and NUL
+ *                     records are passed on in pieces, longer length
+ *                     prefixed ones end the stream with an error
+ *        keep - "all" (default) passes on every record, "latest" only the
+ *               last complete record of what was read in one go
+ *        high_water - most records passed on per run_loop() batch; the
+ *                     program is not read until the rest were passed on,
+ *                     so a fast producer blocks on the full pipe
+ *        pull - the function is called with true once records are
+ *               waiting, and takes them with el:next_record(fd); what it
+ *               leaves is offered again in the next batch.  Not with
+ *               "json" framing or "latest" keep
+ *        priority - passed on before the other programs, sockets and
+ *                   pressure triggers of a run_loop() batch
  *    fd - returned is the file descriptor or nil on error
  */
 
+static const char *keep_names[] = {
+	[LEL_KEEP_ALL]		= "all",
+	[LEL_KEEP_LATEST]	= "latest",
+	NULL
+};
+
+static const char *framing_names[] = {
+	[LEL_FRAME_LINE]	= "line",
+	[LEL_FRAME_NUL]		= "nul",
+	[LEL_FRAME_NETSTRING]	= "netstring",
+	[LEL_FRAME_LENGTH]	= "length",
+	[LEL_FRAME_JSON]	= "json",
+	NULL
+};
+
 int l_eventloop_add_exec (lua_State *L)
 {
 	struct lel_eventloop *el;
 	struct lel_program *prog;
 	const char *cmd;
 	int pfds[2];			// 0 is server, 1 is client
-	int rc, pid;
+	int rc, pid, procs_fd;
+	char *cgroup;
+	int framing = LEL_FRAME_LINE;
+	int keep = LEL_KEEP_ALL;
+	lua_Number max_record = LEL_PROGRAM_MAX_RECORD;
+	lua_Number high_water = 0;
+	int pull = 0;
+	int priority = 0;
 
 	el = lel_checkeventloop (L, 1);
 	cmd = luaL_checkstring (L, 2);
 	(void)luaL_checktype (L, 3, LUA_TFUNCTION);
 
-	DBGF("** eventloop:add_exec (%s, ...) **\n", cmd);
+	if (!lua_isnoneornil (L, 4)) {
+		luaL_checktype (L, 4, LUA_TTABLE);
+
+		lua_getfield (L, 4, "framing");
+		if (!lua_isnil (L, -1)) {
+			const char *name = lua_tostring (L, -1);
+
+			for (framing=0; framing_names[framing]; framing++)
+				if (name && !strcmp (name, framing_names[framing]))
+					break;
+			if (!framing_names[framing])
+				return luaL_argerror (L, 4, lua_pushfstring (L,
+						"unknown framing `%s'",
+						name ? name : "?"));
+		}
+		lua_pop (L, 1);
+
+		lua_getfield (L, 4, "keep");
+		if (!lua_isnil (L, -1)) {
+			const char *name = lua_tostring (L, -1);
+
+			for (keep=0; keep_names[keep]; keep++)
+				if (name && !strcmp (name, keep_names[keep]))
+					break;
+			if (!keep_names[keep])
+				return luaL_argerror (L, 4, lua_pushfstring (L,
+						"unknown keep policy `%s'",
+						name ? name : "?"));
+		}
+		lua_pop (L, 1);
+
+		lua_getfield (L, 4, "high_water");
+		if (!lua_isnil (L, -1)) {
+			high_water = luaL_checknumber (L, -1);
+			luaL_argcheck (L, high_water >= 0, 4,
+					"high_water must not be negative");
+		}
+		lua_pop (L, 1);
+
+		lua_getfield (L, 4, "max_record");
+		if (!lua_isnil (L, -1)) {
+			max_record = luaL_checknumber (L, -1);
+			luaL_argcheck (L, max_record >= 1, 4,
+					"max_record must be positive");
+		}
+		lua_pop (L, 1);
+
+		lua_getfield (L, 4, "pull");
+		pull = lua_toboolean (L, -1);
+		lua_pop (L, 1);
+		luaL_argcheck (L, !pull || (framing != LEL_FRAME_JSON
+					&& keep == LEL_KEEP_ALL), 4,
+				"pull programs take every record, and no json");
+
+		lua_getfield (L, 4, "priority");
+		priority = lua_toboolean (L, -1);
+		lua_pop (L, 1);
+	}
+
+	DBGF("** eventloop:add_exec (%s, ..., %s) **\n", cmd,
+			framing_names[framing]);
 
 	// create a new program entry
-	prog = (struct lel_program*) malloc (sizeof (struct lel_program) 
-			// we allocate the buffer and room for a terminator at the end
-			+ LEL_PROGRAM_IO_BUF_SIZE + 1);
+	prog = (struct lel_program*) calloc (1, sizeof (struct lel_program));
 	if (!prog)
 		return lel_pusherror (L, "failed to allocate program structure");
 
+	prog->framing = framing;
+	prog->keep = keep;
+	prog->high_water = (size_t)high_water;
+	prog->max_record = (size_t)max_record;
+	prog->pull = pull;
+	prog->priority = priority;
+
+	// the buffer starts small and grows as long records come in; it has
+	// room for a terminator at the end
+	prog->buf_size = LEL_PROGRAM_IO_BUF_SIZE;
+	prog->buf = malloc (prog->buf_size + 1);
+	prog->cmd = strdup (cmd);
+	if (!prog->buf || !prog->cmd) {
+		prog_free (prog);
+		return lel_pusherror (L, "failed to allocate program structure");
+	}
+
 	// spawn off a worker process
 	rc = pipe(pfds);
 	if (rc<0) {
-		free (prog);
+		prog_free (prog);
 		return lel_pusherror (L, "failed to create a pipe");
 	}
 
+	// with a cgroup directory set the child moves itself into a cgroup
+	// of its own before exec, so that everything it forks is in there
+	procs_fd = lel_children_cgroup_open (el, &cgroup);
+
 	pid = vfork();
 	if (pid<0) {			// fork failed...
-		free (prog);
+		prog_free (prog);
 		close (pfds[0]);
 		close (pfds[1]);
+		if (cgroup) {
+			close (procs_fd);
+			rmdir (cgroup);
+			free (cgroup);
+		}
 		return lel_pusherror (L, "failed to fork()");
 	}
 
 	if (! pid) {			// client...
+		if (procs_fd >= 0)	// into its cgroup; runs anyway on failure
+			write (procs_fd, "0", 1);
 		close (pfds[0]);	// close the server end
 		dup2(pfds[1], 1);	// stdout to client's end of pipe
 		close (pfds[1]);	// close the client end
 		execlp ("sh", "sh", "-c", cmd, NULL);
-		exit (1);
+		_exit (1);
 	}
 
 	// back in server...
 	close (pfds[1]);			// close the client end
+	if (procs_fd >= 0)
+		close (procs_fd);
 
-	// time to setup the program entry
-	memset (prog, 0, sizeof(*prog));
+	lel_children_add (el, pid, cmd, cgroup, 1);
 
-	prog->cmd = strdup (cmd);
+	// time to setup the program entry
 	prog->pid = pid;
 	prog->fd = pfds[0];
 
@@ -250,7 +405,6 @@ int l_eventloop_kill_exec (lua_State *L)
 static void kill_exec (lua_State *L, struct lel_eventloop *el, int fd)
 {
 	struct lel_program *prog;
-	int status;
 
 	prog = progs_remove (el, fd);
 	if (! prog)
@@ -269,14 +423,20 @@ static void kill_exec (lua_State *L, struct lel_eventloop *el, int fd)
 
 	kill (prog->pid, SIGTERM);
 	close (prog->fd);
-	free (prog);
+
+	// a callback of this program is killing it; the caller of the
+	// callback frees it once it returns
+	if (prog->busy)
+		prog->dead = 1;
+	else
+		prog_free (prog);
 
 	// catchup on programs that quit
-	while (waitpid (-1, &status, WNOHANG) > 0);
+	lel_children_reap (el);
 
 	// and we still have to remove it from the table
 	luaL_getmetatable (L, L_EVENTLOOP_MT);	// [-3] = get the table
-	lua_pushinteger (L, prog->fd);		// [-2] = the key
+	lua_pushinteger (L, fd);		// [-2] = the key
 	lua_pushnil (L);			// [-1] = nil
 	lua_settable (L, -3);			// eventloop[fd] = nil
 
@@ -284,77 +444,347 @@ static void kill_exec (lua_State *L, struct lel_eventloop *el, int fd)
 	lua_gc (L, LUA_GCSTEP, 10);
 }
 
+/* ------------------------------------------------------------------------
+ * flow control
+ */
+
+/* a program is only in the select() set while we want to read from it */
+static void prog_watch (struct lel_eventloop *el, struct lel_program *prog)
+{
+	if (prog->paused || prog->backlog)
+		FD_CLR (prog->fd, &el->all_fds);
+	else
+		FD_SET (prog->fd, &el->all_fds);
+}
+
+static struct lel_program * check_prog (lua_State *L,
+		struct lel_eventloop *el, int narg)
+{
+	struct lel_program *prog;
+	int fd;
+
+	fd = luaL_checknumber (L, narg);
+	prog = progs_find (el, fd);
+	if (!prog)
+		luaL_error (L, "no program with fd %d", fd);
+
+	return prog;
+}
+
+/*
+ * stops reading from a program; its output stays in the pipe, and once
+ * that is full the program blocks on its next write
+ *
+ * lua: el:pause(fd)
+ */
+int l_eventloop_pause (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_program *prog = check_prog (L, el, 2);
+
+	DBGF("** eventloop:pause (%d) **\n", prog->fd);
+
+	prog->paused = 1;
+	prog_watch (el, prog);
+	return 0;
+}
+
+/*
+ * lua: el:resume(fd)
+ */
+int l_eventloop_resume (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_program *prog = check_prog (L, el, 2);
+
+	DBGF("** eventloop:resume (%d) **\n", prog->fd);
+
+	prog->paused = 0;
+	prog_watch (el, prog);
+	return 0;
+}
+
+/*
+ * lua: t = el:stats(fd)
+ *
+ *    t - a table with records (passed on), dropped (skipped by the latest
+ *        policy), bytes (read), buffered (bytes not yet passed on),
+ *        paused and priority
+ */
+int l_eventloop_stats (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_program *prog = check_prog (L, el, 2);
+
+	lua_newtable (L);
+	lua_pushnumber (L, prog->records);
+	lua_setfield (L, -2, "records");
+	lua_pushnumber (L, prog->dropped);
+	lua_setfield (L, -2, "dropped");
+	lua_pushnumber (L, prog->bytes);
+	lua_setfield (L, -2, "bytes");
+	lua_pushnumber (L, prog->buf_len);
+	lua_setfield (L, -2, "buffered");
+	lua_pushboolean (L, prog->paused);
+	lua_setfield (L, -2, "paused");
+	lua_pushboolean (L, prog->priority);
+	lua_setfield (L, -2, "priority");
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * takes the records of pull programs
+ */
+int lel_next_record (struct lel_eventloop *el, int fd,
+		const char **s, size_t *len)
+{
+	struct lel_program *prog = progs_find (el, fd);
+	size_t off, used;
+	int rc;
+
+	if (!prog || !prog->pull)
+		return -1;
+	if (!prog->buf_len)
+		return 0;
+
+	rc = frame_next (prog, &off, len, &used);
+	if (rc <= 0)
+		return rc;
+
+	*s = prog->buf + prog->buf_pos + off;
+	prog->buf_pos += used;
+	prog->buf_len -= used;
+	prog->records++;
+	return 1;
+}
+
+/*
+ * lua: rec = el:next_record(fd)
+ *
+ *    rec - the next record of a program added with pull = true, or nil
+ *          if the callback has taken all there were
+ *
+ * A framing error also returns nil; the callback then hears of it as the
+ * end of the stream.
+ */
+int l_eventloop_next_record (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_program *prog = check_prog (L, el, 2);
+	const char *s;
+	size_t len;
+
+	luaL_argcheck (L, prog->pull, 2, "not a pull program");
+
+	if (lel_next_record (el, prog->fd, &s, &len) <= 0)
+		return 0;
+
+	lua_pushlstring (L, s, len);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * passes on what a readable program has, or the records left over; the
+ * program is gone afterwards if it ended or a callback killed it
+ */
+static void prog_service (lua_State *L, struct lel_eventloop *el,
+		struct lel_program *prog)
+{
+	int fd = prog->fd;
+	int rc;
+
+	rc = loop_handle_event (L, el, prog);
+	if (prog->dead) {
+		// a callback killed it
+		prog_free (prog);
+		return;
+	}
+
+	if (rc<=0) {
+		DBGF("** killing %d (fd=%d) **\n", prog->pid, fd);
+
+		// let the callback know that the stream ended
+		lua_issue_callback (L, prog);
+
+		if (prog->dead)
+			prog_free (prog);
+		else
+			kill_exec(L, el, fd);
+	}
+}
+
 /* ------------------------------------------------------------------------
  * runs the select loop over all registered execs with timeout
  *
+ * The timeout is in seconds and may have a fractional part; without one the
+ * loop waits for events for ever.  The function returns once a batch of
+ * events was handled, so that the caller can act on what the callbacks did.
+ * Programs added with the priority option are passed on first, then
+ * pressure triggers, sockets and the other programs.
+ *
  * lua: el.run_loop (timeout)
  */
 int l_eventloop_run_loop (lua_State *L)
 {
 	struct lel_eventloop *el;
-	int timeout, status;
+	lua_Number timeout;
 	fd_set rfds, xfds;
-	struct timeval tv;
+	struct timeval tv, *tvp = NULL;
+	struct timeval zero = { 0, 0 };
 
 	el = lel_checkeventloop (L, 1);
-	timeout = luaL_optnumber (L, 2, 0);
-
-	DBGF("** eventloop:run_loop (%d) **\n", timeout);
 
 	// init for timeout
-	tv.tv_sec = timeout;
-	tv.tv_usec = 0;
+	if (!lua_isnoneornil (L, 2)) {
+		timeout = luaL_checknumber (L, 2);
+		if (timeout < 0)
+			timeout = 0;
+		tv.tv_sec = (time_t)timeout;
+		tv.tv_usec = (suseconds_t)((timeout - tv.tv_sec) * 1e6);
+		tvp = &tv;
+	}
+
+	DBGF("** eventloop:run_loop (%ld.%06ld) **\n",
+			tvp ? (long)tv.tv_sec : -1L, tvp ? (long)tv.tv_usec : 0L);
 
 	// run the loop
-	while (el->progs_count) {
-		int i, rc;
+	while (el->progs_count || el->pressure.count
+			|| el->sockets.count) {
+		int fd, nready, max_fd, pass;
+		size_t i, watched = 0, backlog = 0;
 
 		// catchup on programs that quit
-		while (waitpid (-1, &status, WNOHANG) > 0);
+		lel_children_reap (el);
+
+		for (i=0; i<el->progs_count; i++) {
+			if (el->progs[i]->paused)
+				continue;
+			if (el->progs[i]->backlog)
+				backlog++;
+			else
+				watched++;
+		}
+
+		if (!watched && !backlog && !tvp && !el->pressure.count
+				&& !el->sockets.count)
+			// everything is paused, nothing would wake us up
+			break;
 
 		// init for select
 		rfds = el->all_fds;
 		xfds = el->all_fds;
-
-		// wait for the next event
-		rc = select (el->max_fd+1, &rfds, NULL, &xfds, &tv);
-		if (rc<0)
+		max_fd = lel_timer_fds (el, &rfds, el->max_fd);
+		max_fd = lel_psi_fds (el, &xfds, max_fd);
+		max_fd = lel_sock_fds (el, &rfds, max_fd);
+
+		// wait for the next event; records left over from the last
+		// batch are passed on without waiting
+		nready = select (max_fd+1, &rfds, NULL, &xfds,
+				backlog ? &zero : tvp);
+		el->batch++;
+		if (nready<0 && errno != EINTR)
 			return lel_pusherror (L, "select failed");
+		if (nready<0) {
+			FD_ZERO (&rfds);
+			FD_ZERO (&xfds);
+		}
 
-		if (!rc)
+		if (nready<=0 && !backlog)
 			// timeout
 			break;
 
-		for (i=(el->progs_count-1); i>=0; i--) {
-			struct lel_program *prog;
-			bool dead = false;
+		// a wall clock deadline, or the clock was set; either way we
+		// return and the caller reschedules before we wait again
+		lel_timer_handle (el, &rfds);
 
-			prog = el->progs[i];
+		// priority programs go first, then everything else
+		for (pass=0; pass<2; pass++) {
+			if (pass) {
+				// pressure stall triggers that fired
+				lel_psi_handle (L, el, &xfds);
 
-			if (FD_ISSET (prog->fd, &rfds)) {
-				rc = loop_handle_event (L, prog);
-				if (rc<=0)
-					dead = true;
-
-				// count could have changed in callback
-				if (i >= el->progs_count)
-					break;
+				// messages sent to our sockets
+				lel_sock_handle (L, el, &rfds);
 			}
 
-			if (dead /* || FD_ISSET (prog->fd, &xfds) */ ) {
-				DBGF("** killing %d (fd=%d) **\n",
-						prog->pid, prog->fd);
-				kill_exec(L, el, prog->fd);
+			for (fd=0; fd<=el->max_fd; fd++) {
+				struct lel_program *prog;
+
+				if (! FD_ISSET (fd, &rfds) && ! backlog)
+					continue;
+
+				// callbacks can add and remove programs, which
+				// reorders the array, so we always look the
+				// program up by fd
+				prog = progs_find (el, fd);
+				if (!prog || prog->priority == pass)
+					// priority is 0 or 1, the other pass
+					continue;
+
+				if (prog->served == el->batch)
+					// a callback took it with el:service()
+					continue;
+
+				if (! FD_ISSET (fd, &rfds)
+						&& (!prog->backlog || prog->paused))
+					// not readable, and no records left over
+					continue;
+
+				prog_service (L, el, prog);
 			}
 		}
+
+		break;
 	}
 
 	// catchup on programs that quit
-	while (waitpid (-1, &status, WNOHANG) > 0);
+	lel_children_reap (el);
 	
 	return 0;
 }
 
+/* ------------------------------------------------------------------------
+ * passes on what a program has ready, without waiting for it
+ *
+ * This lets the caller take the output of an important program, such as
+ * input events, in the middle of a long stretch of other work.
+ *
+ * lua: served = el:service(fd)
+ *
+ *    served - true if records were read or passed on; false if there was
+ *             nothing, the program is paused or in one of its callbacks,
+ *             or it is gone
+ */
+int l_eventloop_service (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_program *prog = progs_find (el, luaL_checkinteger (L, 2));
+	struct timeval zero = { 0, 0 };
+	fd_set rfds;
+
+	if (!prog || prog->paused || prog->busy) {
+		lua_pushboolean (L, 0);
+		return 1;
+	}
+
+	if (!prog->backlog) {
+		FD_ZERO (&rfds);
+		FD_SET (prog->fd, &rfds);
+		if (select (prog->fd + 1, &rfds, NULL, NULL, &zero) <= 0) {
+			lua_pushboolean (L, 0);
+			return 1;
+		}
+	}
+
+	DBGF("** eventloop:service (%d) **\n", prog->fd);
+
+	// what select() said about it in run_loop() is out of date now
+	prog->served = el->batch;
+	prog_service (L, el, prog);
+	lua_pushboolean (L, 1);
+	return 1;
+}
+
 /* ------------------------------------------------------------------------
  * terminates all executables
  */
@@ -379,50 +809,104 @@ int l_eventloop_kill_all (lua_State *L)
  * read more data and call callbacks
  */
 
-static void prog_read_more (lua_State *L, struct lel_program *prog)
+static void prog_free (struct lel_program *prog)
 {
-	int rc;
-	char *buf;
-	ssize_t len;
+	free (prog->cmd);
+	free (prog->buf);
+	free (prog);
+}
+
+/* largest header of a length prefixed record: a netstring with up to 10
+ * digits and the colon, plus the trailing comma */
+#define LEL_FRAME_OVERHEAD 12
+
+static void prog_read_more (struct lel_program *prog)
+{
+	ssize_t rc;
+	size_t room;
 
 	if (!prog->buf_len) {
 		// reset pos to beginning
 		prog->buf_pos = 0;
+		lscan_reset (&prog->scan);
 	}
 
-	buf = prog->buf + prog->buf_pos;
-	len = LEL_PROGRAM_IO_BUF_SIZE - prog->buf_pos - prog->buf_len;
-
-	if (len<=0) {
-		// reached the end
-		if (! prog->buf_pos) {
-			// cannot shift data down
-			prog->read_rc = -1;
-			prog->read_errno = EBUSY;
-			return;
-		}
+	room = prog->buf_size - prog->buf_pos - prog->buf_len;
 
+	if (!room && prog->buf_pos) {
 		// shift data down to make some more room
-		memmove (prog->buf, buf, prog->buf_len);
+		memmove (prog->buf, prog->buf + prog->buf_pos, prog->buf_len);
 		prog->buf_pos = 0;
-		buf = prog->buf;
+		lscan_reset (&prog->scan);
+		room = prog->buf_size - prog->buf_len;
+	}
+
+	if (!room && prog->buf_size < prog->max_record + LEL_FRAME_OVERHEAD) {
+		// a long record; grow the buffer, up to what a record may need
+		size_t size = prog->buf_size * 2;
+		char *buf;
+
+		if (size > prog->max_record + LEL_FRAME_OVERHEAD)
+			size = prog->max_record + LEL_FRAME_OVERHEAD;
+
+		buf = realloc (prog->buf, size + 1);
+		if (buf) {
+			prog->buf = buf;
+			prog->buf_size = size;
+			room = size - prog->buf_len;
+		}
+	}
+
+	if (!room) {
+		// the framing code makes room before it gets here
+		prog->read_rc = -1;
+		prog->read_errno = ENOBUFS;
+		return;
 	}
 
 	// get some data
-	rc = read (prog->fd, buf, len);
+	do {
+		rc = read (prog->fd, prog->buf + prog->buf_pos + prog->buf_len,
+				room);
+	} while (rc < 0 && errno == EINTR);
 
 	prog->read_rc = rc;
 	prog->read_errno = errno;
 
 	if (rc>0) {
-		prog->buf_len = rc;
-		buf[rc] = 0;
+		prog->bytes += rc;
+		prog->buf_len += rc;
+		prog->buf[prog->buf_pos + prog->buf_len] = 0;
+	}
+}
+
+/* calls the function on top of the stack for prog, which must not be freed
+ * while the function runs; an error is passed on once busy is restored, and
+ * a program the callback killed is freed first, as nobody else will */
+static void prog_call (lua_State *L, struct lel_program *prog, int nargs)
+{
+	int rc;
+
+	prog->busy++;
+	rc = lua_pcall (L, nargs, 0, 0);
+	prog->busy--;
+
+	if (rc) {
+		if (prog->dead && !prog->busy)
+			prog_free (prog);
+		lua_error (L);
 	}
+}
 
+static void lua_push_callback (lua_State *L, struct lel_program *prog)
+{
+	luaL_getmetatable (L, L_EVENTLOOP_MT);	// [-2] = get the table
+	lua_pushinteger (L, prog->fd);		// [-1] = the key
+	lua_gettable (L, -2);			// push (eventloop[fd])
 }
 
-static void lua_issue_callback (lua_State *L, struct lel_program *prog,
-		char *string)
+/* lets the callback know that the stream ended */
+static void lua_issue_callback (lua_State *L, struct lel_program *prog)
 {
 	int top;
 
@@ -430,68 +914,266 @@ static void lua_issue_callback (lua_State *L, struct lel_program *prog,
 	top = lua_gettop (L);
 
 	// find the call back function
-	luaL_getmetatable (L, L_EVENTLOOP_MT);	// [-2] = get the table
-	lua_pushinteger (L, prog->fd);		// [-1] = the key
-	lua_gettable (L, -2);			// push (eventloop[fd])
+	lua_push_callback (L, prog);
 
-	if (string) {
-		// success
-		lua_pushstring (L, string);
-		lua_call (L, 1, 0);
+	if (prog->error) {
+		// the output could not be split into records
+		lua_pushnil (L);
+		lua_pushstring (L, prog->error);
+		prog_call (L, prog, 2);
 
 	} else if (prog->read_rc == 0) {
 		// stream ended
 		lua_pushnil (L);
 		lua_pushstring (L, "EOF");
-		lua_call (L, 2, 0);
+		prog_call (L, prog, 2);
 
 	} else if (prog->read_rc < 0) {
 		// error reading
 		lua_pushnil (L);
 		lua_pushstring (L, strerror(prog->read_errno));
-		lua_call (L, 2, 0);
+		prog_call (L, prog, 2);
+	}
+
+	// restore top of stack
+	lua_settop (L, top);
+}
+
+/* passes one record, s..s+len, to the callback; the record is handed to lua
+ * straight out of the read buffer */
+static void issue_record (lua_State *L, struct lel_program *prog,
+		char *s, size_t len)
+{
+	int top;
+
+	if (prog->framing == LEL_FRAME_JSON) {
+		size_t i;
+
+		// blank lines are not records
+		for (i=0; i<len && isspace ((unsigned char)s[i]); i++);
+		if (i == len)
+			return;
+	}
+
+	// backup top of stack
+	top = lua_gettop (L);
+
+	// find the call back function
+	lua_push_callback (L, prog);
+
+	if (prog->framing == LEL_FRAME_JSON) {
+		const char *err;
+		char save;
+		int rc;
+
+		// the decoder relies on a terminator after the record
+		save = s[len];
+		s[len] = 0;
+		rc = lel_json_push (L, s, len, &err);
+		s[len] = save;
+
+		if (rc < 0) {
+			// a bad record is reported, the stream goes on
+			lua_pushboolean (L, 0);
+			lua_pushstring (L, err);
+			prog_call (L, prog, 2);
+		} else
+			prog_call (L, prog, 1);
+
+	} else {
+		lua_pushlstring (L, s, len);
+		prog_call (L, prog, 1);
 	}
+	prog->records++;
 
 	// restore top of stack
 	lua_settop (L, top);
 }
 
-static int loop_handle_event (lua_State *L, struct lel_program *prog)
+/* finds the next record in the buffer: returns 1 and sets the offset and
+ * length of the record and how many bytes it takes up in the buffer, 0 if
+ * more data is needed, or -1 after setting prog->error */
+static int frame_next (struct lel_program *prog, size_t *off, size_t *len,
+		size_t *used)
 {
-	char *s, *e, *cr;
+	unsigned char *s = (unsigned char*)prog->buf + prog->buf_pos;
+	size_t avail = prog->buf_len;
+	size_t n, i;
+	long e;
+
+	switch (prog->framing) {
+	case LEL_FRAME_LINE:
+	case LEL_FRAME_JSON:
+	case LEL_FRAME_NUL:
+		// a record may not be longer than max_record; the cursor
+		// finds the delimiters of a whole batch in one pass
+		n = avail <= prog->max_record ? avail : prog->max_record + 1;
+		e = lscan_find (&prog->scan, prog->buf, prog->buf_pos,
+				prog->buf_pos + n,
+				prog->framing == LEL_FRAME_NUL ? '\0' : '\n');
+		if (e >= 0) {
+			*off = 0;
+			*len = e - prog->buf_pos;
+			*used = *len + 1;
+			return 1;
+		}
+
+		if (avail >= prog->max_record || prog->read_rc == 0) {
+			// too long to wait for the rest, or the last one;
+			// pass on what we have
+			*off = 0;
+			*len = *used = avail < prog->max_record
+				? avail : prog->max_record;
+			return 1;
+		}
+		return 0;
+
+	case LEL_FRAME_NETSTRING:
+		for (n=0, i=0; i<avail && isdigit (s[i]); i++) {
+			n = n*10 + (s[i] - '0');
+			if (n > prog->max_record) {
+				prog->error = "record too long";
+				return -1;
+			}
+		}
+		if (i == avail)
+			goto need_more;
+		if (!i || s[i] != ':') {
+			prog->error = "bad netstring length";
+			return -1;
+		}
+		if (avail < i + 1 + n + 1)
+			goto need_more;
+		if (s[i + 1 + n] != ',') {
+			prog->error = "netstring is missing a trailing comma";
+			return -1;
+		}
+		*off = i + 1;
+		*len = n;
+		*used = i + 1 + n + 1;
+		return 1;
+
+	case LEL_FRAME_LENGTH:
+		if (avail < 4)
+			goto need_more;
+		n = ((size_t)s[0] << 24) | ((size_t)s[1] << 16)
+			| ((size_t)s[2] << 8) | (size_t)s[3];
+		if (n > prog->max_record) {
+			prog->error = "record too long";
+			return -1;
+		}
+		if (avail < 4 + n)
+			goto need_more;
+		*off = 4;
+		*len = n;
+		*used = 4 + n;
+		return 1;
+	}
 
-	prog_read_more (L, prog);
+	prog->error = "unknown framing";
+	return -1;
 
-	while (prog->buf_len) {
-		// as long as we have some data we try to find a full line 
-		s = prog->buf + prog->buf_pos;
-		e = s + prog->buf_len;
+need_more:
+	if (prog->read_rc == 0) {
+		prog->error = "stream ended in the middle of a record";
+		return -1;
+	}
+	return 0;
+}
 
-		cr = strchr (s, '\n');
-		if (cr) {
-			// we have a match: s..cr is our substring
-			int len = (cr-s) + 1;
-			*cr = 0;
+/* lets a pull program's callback take the records that came in; it is
+ * called again in the next batch while complete ones are left */
+static int pull_handle_event (lua_State *L, struct lel_eventloop *el,
+		struct lel_program *prog)
+{
+	size_t off, len, used;
+	int top, rc;
+
+	if (prog->buf_len) {
+		top = lua_gettop (L);
+		lua_push_callback (L, prog);
+		lua_pushboolean (L, 1);
+		prog_call (L, prog, 1);
+		lua_settop (L, top);
+		if (prog->dead)
+			return 0;
+
+		if (prog->buf_len) {
+			rc = frame_next (prog, &off, &len, &used);
+			if (rc < 0)
+				return -1;
+			prog->backlog = rc;
+		}
+	}
 
-			lua_issue_callback (L, prog, s);
+	prog_watch (el, prog);
 
-			prog->buf_pos += len;
-			prog->buf_len -= len;
+	if (prog->backlog)
+		return 1;
+	return prog->read_rc;
+}
 
-		} else if (!prog->buf_pos) {
-			// no match and we cannot even read more out of 
-			// the buffer; we have to return the partial buffer
-			lua_issue_callback (L, prog, s);
+static int loop_handle_event (lua_State *L, struct lel_eventloop *el,
+		struct lel_program *prog)
+{
+	size_t off, len, used, count = 0;
+	size_t last_off = 0, last_len = 0;
+	int rc;
 
-			prog->buf_len = 0;
+	// with records left over from the last batch we do not read; that
+	// is what keeps a fast producer blocked on the pipe
+	if (!prog->backlog)
+		prog_read_more (prog);
+	prog->backlog = 0;
+
+	if (prog->pull)
+		return pull_handle_event (L, el, prog);
+
+	// as long as we have some data we try to find full records; a
+	// callback may kill the program, which stops the loop
+	while (prog->buf_len && !prog->dead) {
+		if (prog->keep == LEL_KEEP_ALL && prog->high_water
+				&& count >= prog->high_water) {
+			// pass on the rest in the next batch
+			prog->backlog = 1;
+			break;
+		}
 
-		} else {
-			// no match, we will try to read more on next select()
-			// read event
+		rc = frame_next (prog, &off, &len, &used);
+		if (rc < 0)
+			return -1;
+		if (!rc)
+			// we will try to read more on next select() read event
 			break;
+
+		prog->buf_pos += used;
+		prog->buf_len -= used;
+
+		if (prog->keep == LEL_KEEP_LATEST) {
+			// only remember where it is; the buffer is not touched
+			// until we read again
+			if (count)
+				prog->dropped++;
+			last_off = prog->buf_pos - used + off;
+			last_len = len;
+			count++;
+			continue;
 		}
+
+		count++;
+		issue_record (L, prog, prog->buf + prog->buf_pos - used + off,
+				len);
 	}
 
+	if (prog->keep == LEL_KEEP_LATEST && count && !prog->dead)
+		issue_record (L, prog, prog->buf + last_off, last_len);
+
+	if (!prog->dead)
+		prog_watch (el, prog);
+
+	// the stream only ends once everything was passed on
+	if (prog->backlog)
+		return 1;
 	return prog->read_rc;
 }
 
@@ -3,10 +3,16 @@
 
 #include <lua.h>
 
+#include "lscan.h"
+#include "lel_timer.h"
+#include "lel_psi.h"
+#include "lel_sock.h"
+
 #define L_EVENTLOOP_MT "eventloop.eventloop_mt"
 
 /* the C representation of a eventloop instance object */
 struct lel_program;
+struct lel_child;
 struct lel_eventloop {
 	struct lel_program **progs;	// array of programs, sorted by fd
 	size_t progs_size;		// number allocated entries
@@ -14,6 +20,17 @@ struct lel_eventloop {
 
 	fd_set all_fds;
 	int max_fd;
+
+	struct lel_child *children;	// see lel_children.h
+	size_t children_size;
+	size_t children_count;
+	char *cgroup_base;		// delegated cgroup v2 directory, or NULL
+	unsigned cgroup_seq;		// names the cgroups made under it
+
+	struct lel_wall wall;		// see lel_timer.h
+	struct lel_pressure pressure;	// see lel_psi.h
+	struct lel_sockets sockets;	// see lel_sock.h
+	unsigned long batch;		// counts the select() calls of run_loop()
 };
 #define LEL_PROGS_ARRAY_GROWS_BY 32
 
@@ -23,20 +40,66 @@ struct lel_program {
 	int pid;
 	int read_rc;
 	int read_errno;
+	const char *error;	// framing error, reported instead of read_errno
+	int framing;		// one of LEL_FRAME_*
+	int busy;		// callbacks running for this program
+	int dead;		// killed by a callback, freed once it returns
+	int paused;		// not read until el:resume()
+	int backlog;		// records left over from the last batch
+	int keep;		// one of LEL_KEEP_*
+	int pull;		// the callback takes the records, see next_record()
+	int priority;		// passed on first in each run_loop() batch
+	unsigned long served;	// the batch el:service() last took it in
+	size_t high_water;	// most records passed on per batch, 0 for all
+	size_t max_record;	// the buffer does not grow beyond this
+	unsigned long records;	// records passed to the callback
+	unsigned long dropped;	// records skipped by LEL_KEEP_LATEST
+	unsigned long bytes;	// bytes read
+	size_t buf_size;	// allocated size of buf, without the terminator
 	size_t buf_pos;
 	size_t buf_len;
-	char buf[0];		// this has to be last in the structure
+	char *buf;
+	struct lscan_cursor scan;	// delimiters found ahead in buf
+};
+
+/* how the output of a program is split into records */
+enum {
+	LEL_FRAME_LINE = 0,	// newline terminated
+	LEL_FRAME_NUL,		// NUL terminated
+	LEL_FRAME_NETSTRING,	// <length>:<data>,
+	LEL_FRAME_LENGTH,	// 4 byte big endian length, then data
+	LEL_FRAME_JSON,		// one JSON value per line, decoded to lua
 };
-#define LEL_PROGRAM_IO_BUF_SIZE 4096
+#define LEL_PROGRAM_MAX_RECORD 65536
+
+/* which records of a batch are passed on */
+enum {
+	LEL_KEEP_ALL = 0,	// every record
+	LEL_KEEP_LATEST,	// only the last complete one, the rest are dropped
+};
+
+#define LEL_PROGRAM_IO_BUF_SIZE 4096		// initial size of the read buffer
 
 extern struct lel_eventloop *lel_checkeventloop (lua_State *L, int narg);
 extern int l_eventloop_tostring (lua_State *L);
 
+/* takes the next record of a pull program out of its buffer; returns 1
+ * with *s and *len set, 0 if there is no complete one, or -1 if fd is not
+ * a pull program or its output cannot be split.  The record is not
+ * terminated, and stays valid until the program is read again. */
+extern int lel_next_record (struct lel_eventloop *el, int fd,
+		const char **s, size_t *len);
+
 /* exported api */
 extern int l_eventloop_add_exec (lua_State *L);
 extern int l_eventloop_check_exec (lua_State *L);
 extern int l_eventloop_kill_exec (lua_State *L);
 extern int l_eventloop_run_loop (lua_State *L);
 extern int l_eventloop_kill_all (lua_State *L);
+extern int l_eventloop_pause (lua_State *L);
+extern int l_eventloop_resume (lua_State *L);
+extern int l_eventloop_stats (lua_State *L);
+extern int l_eventloop_next_record (lua_State *L);
+extern int l_eventloop_service (lua_State *L);
 
 #endif // __LUAIXP_INSTANCE_H__
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lel_json.h"
+
+/*
+ * A small JSON decoder that builds lua values straight from the read
+ * buffer of a program.  Strings without escapes are pushed from the
+ * buffer as they are; only strings with escapes are copied first.
+ */
+
+struct json {
+	const char *p;
+	const char *end;
+	const char *err;
+	int depth;
+};
+
+static int json_value (lua_State *L, struct json *j);
+
+static void json_skip_ws (struct json *j)
+{
+	while (j->p < j->end && (*j->p == ' ' || *j->p == '\t'
+				|| *j->p == '\n' || *j->p == '\r'))
+		j->p++;
+}
+
+static int json_fail (struct json *j, const char *err)
+{
+	if (!j->err)
+		j->err = err;
+	return -1;
+}
+
+static int json_hex4 (const char *p)
+{
+	int i, v = 0;
+
+	for (i=0; i<4; i++) {
+		char c = p[i];
+		v <<= 4;
+		if (c >= '0' && c <= '9')
+			v |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v |= c - 'A' + 10;
+		else
+			return -1;
+	}
+	return v;
+}
+
+static void json_add_utf8 (luaL_Buffer *b, unsigned long c)
+{
+	if (c < 0x80) {
+		luaL_addchar (b, c);
+	} else if (c < 0x800) {
+		luaL_addchar (b, 0xC0 | (c >> 6));
+		luaL_addchar (b, 0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		luaL_addchar (b, 0xE0 | (c >> 12));
+		luaL_addchar (b, 0x80 | ((c >> 6) & 0x3F));
+		luaL_addchar (b, 0x80 | (c & 0x3F));
+	} else {
+		luaL_addchar (b, 0xF0 | (c >> 18));
+		luaL_addchar (b, 0x80 | ((c >> 12) & 0x3F));
+		luaL_addchar (b, 0x80 | ((c >> 6) & 0x3F));
+		luaL_addchar (b, 0x80 | (c & 0x3F));
+	}
+}
+
+/* j->p is just past the opening quote */
+static int json_string (lua_State *L, struct json *j)
+{
+	const char *s = j->p;
+	luaL_Buffer b;
+
+	/* the common case, nothing to unescape */
+	while (s < j->end && *s != '"' && *s != '\\') {
+		if ((unsigned char)*s < 0x20)
+			return json_fail (j, "control character in string");
+		s++;
+	}
+	if (s >= j->end)
+		return json_fail (j, "unterminated string");
+	if (*s == '"') {
+		lua_pushlstring (L, j->p, s - j->p);
+		j->p = s + 1;
+		return 0;
+	}
+
+	luaL_buffinit (L, &b);
+	luaL_addlstring (&b, j->p, s - j->p);
+
+	while (s < j->end && *s != '"') {
+		unsigned long c;
+		int h;
+
+		if ((unsigned char)*s < 0x20) {
+			luaL_pushresult (&b);
+			lua_pop (L, 1);
+			return json_fail (j, "control character in string");
+		}
+		if (*s != '\\') {
+			luaL_addchar (&b, *s++);
+			continue;
+		}
+		if (++s >= j->end)
+			break;
+		switch (*s++) {
+		case '"':  luaL_addchar (&b, '"');  break;
+		case '\\': luaL_addchar (&b, '\\'); break;
+		case '/':  luaL_addchar (&b, '/');  break;
+		case 'b':  luaL_addchar (&b, '\b'); break;
+		case 'f':  luaL_addchar (&b, '\f'); break;
+		case 'n':  luaL_addchar (&b, '\n'); break;
+		case 'r':  luaL_addchar (&b, '\r'); break;
+		case 't':  luaL_addchar (&b, '\t'); break;
+		case 'u':
+			if (j->end - s < 4 || (h = json_hex4 (s)) < 0)
+				goto bad_escape;
+			s += 4;
+			c = h;
+			if (c >= 0xD800 && c <= 0xDBFF) {
+				/* a surrogate pair */
+				if (j->end - s < 6 || s[0] != '\\' || s[1] != 'u'
+						|| (h = json_hex4 (s + 2)) < 0
+						|| h < 0xDC00 || h > 0xDFFF)
+					goto bad_escape;
+				s += 6;
+				c = 0x10000 + ((c - 0xD800) << 10) + (h - 0xDC00);
+			} else if (c >= 0xDC00 && c <= 0xDFFF) {
+				goto bad_escape;
+			}
+			json_add_utf8 (&b, c);
+			break;
+		default:
+			goto bad_escape;
+		}
+	}
+
+	luaL_pushresult (&b);
+	if (s >= j->end) {
+		lua_pop (L, 1);
+		return json_fail (j, "unterminated string");
+	}
+	j->p = s + 1;
+	return 0;
+
+bad_escape:
+	luaL_pushresult (&b);
+	lua_pop (L, 1);
+	return json_fail (j, "bad escape in string");
+}
+
+static int json_number (lua_State *L, struct json *j)
+{
+	const char *s = j->p;
+	char *e;
+	double d;
+
+	/* strtod() takes more than JSON does, so check the first digit */
+	if (*s == '-')
+		s++;
+	if (s >= j->end || *s < '0' || *s > '9')
+		return json_fail (j, "bad number");
+
+	d = strtod (j->p, &e);
+	if (e == j->p || e > j->end)
+		return json_fail (j, "bad number");
+
+	lua_pushnumber (L, d);
+	j->p = e;
+	return 0;
+}
+
+static int json_literal (lua_State *L, struct json *j, const char *word)
+{
+	size_t len = strlen (word);
+
+	if ((size_t)(j->end - j->p) < len || memcmp (j->p, word, len))
+		return json_fail (j, "unexpected character");
+
+	j->p += len;
+	switch (*word) {
+	case 't': lua_pushboolean (L, 1); break;
+	case 'f': lua_pushboolean (L, 0); break;
+	default:  lua_pushlightuserdata (L, NULL); break;
+	}
+	return 0;
+}
+
+static int json_array (lua_State *L, struct json *j)
+{
+	int i = 0;
+
+	lua_newtable (L);
+	json_skip_ws (j);
+	if (j->p < j->end && *j->p == ']') {
+		j->p++;
+		return 0;
+	}
+
+	for (;;) {
+		if (json_value (L, j) < 0)
+			goto fail;
+		lua_rawseti (L, -2, ++i);
+
+		json_skip_ws (j);
+		if (j->p >= j->end)
+			break;
+		if (*j->p == ']') {
+			j->p++;
+			return 0;
+		}
+		if (*j->p++ != ',')
+			break;
+	}
+	json_fail (j, "expected , or ] in array");
+fail:
+	lua_pop (L, 1);
+	return -1;
+}
+
+static int json_object (lua_State *L, struct json *j)
+{
+	lua_newtable (L);
+	json_skip_ws (j);
+	if (j->p < j->end && *j->p == '}') {
+		j->p++;
+		return 0;
+	}
+
+	for (;;) {
+		json_skip_ws (j);
+		if (j->p >= j->end || *j->p != '"') {
+			json_fail (j, "expected a string key in object");
+			goto fail;
+		}
+		j->p++;
+		if (json_string (L, j) < 0)
+			goto fail;
+
+		json_skip_ws (j);
+		if (j->p >= j->end || *j->p != ':') {
+			lua_pop (L, 1);
+			json_fail (j, "expected : in object");
+			goto fail;
+		}
+		j->p++;
+
+		if (json_value (L, j) < 0) {
+			lua_pop (L, 1);
+			goto fail;
+		}
+		lua_rawset (L, -3);
+
+		json_skip_ws (j);
+		if (j->p >= j->end)
+			break;
+		if (*j->p == '}') {
+			j->p++;
+			return 0;
+		}
+		if (*j->p++ != ',')
+			break;
+	}
+	json_fail (j, "expected , or } in object");
+fail:
+	lua_pop (L, 1);
+	return -1;
+}
+
+static int json_value (lua_State *L, struct json *j)
+{
+	int rc;
+
+	json_skip_ws (j);
+	if (j->p >= j->end)
+		return json_fail (j, "unexpected end of input");
+
+	if (!lua_checkstack (L, 4))
+		return json_fail (j, "out of stack space");
+
+	switch (*j->p) {
+	case '{':
+	case '[':
+		if (++j->depth > LEL_JSON_MAX_DEPTH)
+			return json_fail (j, "nested too deeply");
+		rc = (*j->p++ == '{') ? json_object (L, j) : json_array (L, j);
+		j->depth--;
+		return rc;
+	case '"':
+		j->p++;
+		return json_string (L, j);
+	case 't':
+		return json_literal (L, j, "true");
+	case 'f':
+		return json_literal (L, j, "false");
+	case 'n':
+		return json_literal (L, j, "null");
+	default:
+		return json_number (L, j);
+	}
+}
+
+int lel_json_push (lua_State *L, const char *s, size_t len, const char **err)
+{
+	struct json j = { s, s + len, NULL, 0 };
+
+	if (json_value (L, &j) < 0) {
+		*err = j.err;
+		return -1;
+	}
+
+	json_skip_ws (&j);
+	if (j.p != j.end) {
+		lua_pop (L, 1);
+		*err = "trailing characters after value";
+		return -1;
+	}
+	return 0;
+}
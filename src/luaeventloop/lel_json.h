@@ -0,0 +1,16 @@
+#ifndef __LUAIXP_JSON_H__
+#define __LUAIXP_JSON_H__
+
+#include <stddef.h>
+#include <lua.h>
+
+#define LEL_JSON_MAX_DEPTH 64
+
+/* decodes the JSON value in s[0..len) and pushes it; objects and arrays
+ * become tables, null becomes eventloop.null (a NULL light userdata).
+ * s[len] must be readable and NUL.  Returns 0, or -1 with *err set and
+ * nothing pushed. */
+extern int lel_json_push (lua_State *L, const char *s, size_t len,
+		const char **err);
+
+#endif // __LUAIXP_JSON_H__
@@ -9,9 +9,16 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "lcompat.h"
 #include "lel_debug.h"
 #include "lel_util.h"
 #include "lel_instance.h"
+#include "lel_spawn.h"
+#include "lel_children.h"
+#include "lel_timer.h"
+#include "lel_psi.h"
+#include "lel_sock.h"
+#include "lel_ffi.h"
 
 
 /* ------------------------------------------------------------------------
@@ -30,10 +37,25 @@ static int l_new (lua_State *L)
 
 	memset (el, 0, sizeof(*el));
 	FD_ZERO (&el->all_fds);
+	el->wall.fd = -1;
 
 	return 1;
 }
 
+/* ------------------------------------------------------------------------
+ * lua: t = eventloop.now() -- monotonic time in seconds, with sub-second part
+ */
+static int l_now (lua_State *L)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0)
+		return lel_pusherror (L, "clock_gettime failed");
+
+	lua_pushnumber (L, (lua_Number)ts.tv_sec + (lua_Number)ts.tv_nsec / 1e9);
+	return 1;
+}
+
 static int l_eventloop_gc (lua_State *L)
 {
 	struct lel_eventloop *el;
@@ -42,6 +64,11 @@ static int l_eventloop_gc (lua_State *L)
 
 	DBGF("** eventloop:__gc (%p) **\n", el);
 
+	lel_children_free (el);
+	lel_timer_free (el);
+	lel_psi_free (el);
+	lel_sock_free (el);
+
 	return 0;
 }
 
@@ -51,6 +78,11 @@ static int l_eventloop_gc (lua_State *L)
 static const luaL_reg class_table[] =
 {
 	{ "new",		l_new },
+	{ "now",		l_now },
+	{ "walltime",		l_eventloop_walltime },
+	{ "pressure",		l_eventloop_pressure },
+	{ "spawner",		l_spawner_new },
+	{ "ffi_api",		l_eventloop_ffi_api },
 	
 	{ NULL,			NULL },
 };
@@ -68,8 +100,23 @@ static const luaL_reg instance_table[] =
 	{ "kill_exec",		l_eventloop_kill_exec },
 
 	{ "run_loop",		l_eventloop_run_loop },
+	{ "wake_at",		l_eventloop_wake_at },
+	{ "add_pressure",	l_eventloop_add_pressure },
+	{ "remove_pressure",	l_eventloop_remove_pressure },
+	{ "add_socket",		l_eventloop_add_socket },
+	{ "remove_socket",	l_eventloop_remove_socket },
+	{ "socket_stats",	l_eventloop_socket_stats },
 
 	{ "kill_all",		l_eventloop_kill_all },
+	{ "pause",		l_eventloop_pause },
+	{ "resume",		l_eventloop_resume },
+	{ "stats",		l_eventloop_stats },
+	{ "next_record",	l_eventloop_next_record },
+	{ "service",		l_eventloop_service },
+
+	{ "children",		l_eventloop_children },
+	{ "watch_pid",		l_eventloop_watch_pid },
+	{ "set_cgroup",		l_eventloop_set_cgroup },
 
 	{ NULL,			NULL },
 };
@@ -79,6 +126,8 @@ static const luaL_reg instance_table[] =
  */
 static int lel_init_eventloop_class (lua_State *L)
 {
+	lel_init_spawner_class(L);
+
 	luaL_newmetatable(L, L_EVENTLOOP_MT);
 
 	// setup the __index and __gc field
@@ -89,6 +138,10 @@ static int lel_init_eventloop_class (lua_State *L)
 	luaL_openlib (L, NULL, instance_table, 0);
 	luaL_openlib (L, "eventloop", class_table, 0);
 
+	// JSON null, as passed to callbacks of programs with json framing
+	lua_pushlightuserdata (L, NULL);
+	lua_setfield (L, -2, "null");
+
 #if 0
 	luaL_register (L, MYNAME, R);
 	lua_pushliteral (L, "version");
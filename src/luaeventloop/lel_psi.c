@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/select.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lel_debug.h"
+#include "lel_util.h"
+#include "lel_instance.h"
+#include "lel_psi.h"
+
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+/* pushes the contents of a pressure file, as
+ *    { some = { avg10 = 0.12, avg60 = ..., avg300 = ..., total = ... },
+ *      full = { ... } }
+ * buf is taken apart in the process */
+static void push_pressure (lua_State *L, char *buf)
+{
+	char *line, *lsave;
+
+	lua_createtable (L, 0, 2);
+	for (line = strtok_r (buf, "\n", &lsave); line;
+			line = strtok_r (NULL, "\n", &lsave)) {
+		char *kind, *word, *wsave;
+
+		kind = strtok_r (line, " ", &wsave);
+		if (!kind)
+			continue;
+
+		lua_createtable (L, 0, 4);
+		while ((word = strtok_r (NULL, " ", &wsave))) {
+			char *eq = strchr (word, '=');
+			if (!eq)
+				continue;
+			*eq = 0;
+			lua_pushnumber (L, strtod (eq + 1, NULL));
+			lua_setfield (L, -2, word);
+		}
+		lua_setfield (L, -2, kind);
+	}
+}
+
+static ssize_t read_pressure (int fd, char *buf, size_t size)
+{
+	ssize_t rc;
+
+	do {
+		rc = pread (fd, buf, size - 1, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	buf[rc > 0 ? rc : 0] = 0;
+	return rc;
+}
+
+static struct lel_psi_watch *psi_find (struct lel_eventloop *el, int fd)
+{
+	size_t i;
+
+	for (i=0; i<el->pressure.count; i++)
+		if (el->pressure.watches[i].fd == fd)
+			return &el->pressure.watches[i];
+	return NULL;
+}
+
+static void psi_remove (struct lel_eventloop *el, struct lel_psi_watch *w)
+{
+	size_t i = w - el->pressure.watches;
+
+	close (w->fd);
+	free (w->file);
+	free (w->trigger);
+
+	el->pressure.count--;
+	memmove (w, w + 1, (el->pressure.count - i) * sizeof (*w));
+}
+
+/* ------------------------------------------------------------------------
+ * select() integration
+ */
+
+int lel_psi_fds (struct lel_eventloop *el, fd_set *xfds, int max_fd)
+{
+	size_t i;
+
+	for (i=0; i<el->pressure.count; i++) {
+		int fd = el->pressure.watches[i].fd;
+		FD_SET (fd, xfds);
+		if (fd > max_fd)
+			max_fd = fd;
+	}
+	return max_fd;
+}
+
+void lel_psi_handle (lua_State *L, struct lel_eventloop *el, fd_set *xfds)
+{
+	size_t i, n = 0, count = el->pressure.count;
+	int fired[count ? count : 1];
+
+	// callbacks can add and remove triggers, so we go by fd
+	for (i=0; i<count; i++)
+		if (FD_ISSET (el->pressure.watches[i].fd, xfds))
+			fired[n++] = el->pressure.watches[i].fd;
+
+	for (i=0; i<n; i++) {
+		struct lel_psi_watch *w = psi_find (el, fired[i]);
+		char buf[LEL_PSI_READ_SIZE];
+		int top = lua_gettop (L);
+
+		if (!w)
+			continue;
+		w->events++;
+
+		DBGF("** eventloop: pressure on %s (%s) **\n",
+				w->file, w->trigger);
+
+		luaL_getmetatable (L, L_EVENTLOOP_MT);
+		lua_pushinteger (L, w->fd);
+		lua_gettable (L, -2);		// push (eventloop[fd])
+		lua_pushinteger (L, w->fd);
+		if (read_pressure (w->fd, buf, sizeof (buf)) < 0) {
+			lua_pushnil (L);
+			lua_pushstring (L, strerror (errno));
+		} else {
+			push_pressure (L, buf);
+			lua_pushnil (L);
+		}
+		lua_call (L, 3, 0);
+
+		lua_settop (L, top);
+	}
+}
+
+void lel_psi_free (struct lel_eventloop *el)
+{
+	while (el->pressure.count)
+		psi_remove (el, &el->pressure.watches[0]);
+
+	free (el->pressure.watches);
+	el->pressure.watches = NULL;
+	el->pressure.size = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: t = eventloop.pressure(file) -- reads a pressure file
+ *
+ *    file - /proc/pressure/cpu, memory or io, or a cgroup's cpu.pressure
+ *           and so on
+ *
+ * Returns { some = { avg10, avg60, avg300, total }, full = { ... } }: the
+ * percentage of time some (or all) tasks stalled on the resource over the
+ * last 10, 60 and 300 seconds, and the total stall time in microseconds.
+ * Returns nil and an error if the kernel has no pressure accounting.
+ */
+int l_eventloop_pressure (lua_State *L)
+{
+	const char *file = luaL_checkstring (L, 1);
+	char buf[LEL_PSI_READ_SIZE];
+	ssize_t rc;
+	int fd;
+
+	fd = open (file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return lel_pusherror (L, file);
+
+	rc = read_pressure (fd, buf, sizeof (buf));
+	close (fd);
+	if (rc < 0)
+		return lel_pusherror (L, file);
+
+	push_pressure (L, buf);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: fd = el:add_pressure(file, trigger, fn) -- calls fn when tasks stall
+ *
+ *    file - as for eventloop.pressure()
+ *    trigger - "some <stall> <window>" or "full <stall> <window>", in
+ *              microseconds, as "some 150000 1000000" for 150ms of stall
+ *              within any second
+ *    fn - called as fn(fd, t) from run_loop(), t being what
+ *         eventloop.pressure() returns, or fn(fd, nil, error)
+ *
+ * The window is from 500ms to 10s; the kernel takes a window of whole 2s
+ * from unprivileged users only.  A trigger fires at most once per window.
+ * Returns the fd to pass to remove_pressure(), or nil and an error; the
+ * error is EPERM or EINVAL if the kernel will not take the trigger.
+ */
+int l_eventloop_add_pressure (lua_State *L)
+{
+	struct lel_eventloop *el;
+	struct lel_psi_watch *w;
+	const char *file, *trigger;
+	size_t len;
+	ssize_t rc;
+	int fd;
+
+	el = lel_checkeventloop (L, 1);
+	file = luaL_checkstring (L, 2);
+	trigger = luaL_checklstring (L, 3, &len);
+	luaL_checktype (L, 4, LUA_TFUNCTION);
+
+	DBGF("** eventloop:add_pressure (%s, %s) **\n", file, trigger);
+
+	if (el->pressure.count == el->pressure.size) {
+		size_t size = el->pressure.size + LEL_PSI_GROWS_BY;
+		void *n = realloc (el->pressure.watches,
+				size * sizeof (*el->pressure.watches));
+		if (!n)
+			return lel_pusherror (L, "out of memory");
+		el->pressure.watches = n;
+		el->pressure.size = size;
+	}
+
+	fd = open (file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return lel_pusherror (L, file);
+
+	// the kernel wants the terminating NUL as well
+	do {
+		rc = write (fd, trigger, len + 1);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) {
+		int err = errno;
+		close (fd);
+		errno = err;
+		return lel_pusherror (L, trigger);
+	}
+
+	w = &el->pressure.watches[el->pressure.count];
+	memset (w, 0, sizeof (*w));
+	w->fd = fd;
+	w->file = strdup (file);
+	w->trigger = strdup (trigger);
+	el->pressure.count++;
+
+	// the callback is kept in the metatable by fd, as for add_exec()
+	luaL_getmetatable (L, L_EVENTLOOP_MT);
+	lua_pushinteger (L, fd);
+	lua_pushvalue (L, 4);
+	lua_settable (L, -3);			// eventloop[fd] = function
+
+	lua_pushinteger (L, fd);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: events = el:remove_pressure(fd) -- removes a trigger
+ *
+ * Returns the number of times it fired, or nil if there is no such
+ * trigger.
+ */
+int l_eventloop_remove_pressure (lua_State *L)
+{
+	struct lel_eventloop *el;
+	struct lel_psi_watch *w;
+	int fd;
+
+	el = lel_checkeventloop (L, 1);
+	fd = luaL_checkinteger (L, 2);
+
+	DBGF("** eventloop:remove_pressure (%d) **\n", fd);
+
+	w = psi_find (el, fd);
+	if (!w) {
+		lua_pushnil (L);
+		return 1;
+	}
+	lua_pushnumber (L, w->events);
+	psi_remove (el, w);
+
+	luaL_getmetatable (L, L_EVENTLOOP_MT);
+	lua_pushinteger (L, fd);
+	lua_pushnil (L);
+	lua_settable (L, -3);			// eventloop[fd] = nil
+	lua_pop (L, 1);
+
+	return 1;
+}
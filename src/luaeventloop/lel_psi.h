@@ -0,0 +1,43 @@
+#ifndef __LUAIXP_PSI_H__
+#define __LUAIXP_PSI_H__
+
+#include <sys/select.h>
+#include <lua.h>
+
+struct lel_eventloop;
+
+/* A pressure stall trigger: a /proc/pressure/<resource> file (or a cgroup's
+ * <resource>.pressure) opened read-write, with a "some|full <stall us>
+ * <window us>" line written to it.  The kernel then flags the fd with
+ * POLLPRI, which select() reports as an exception, whenever tasks stalled
+ * for that long within the window; nothing happens while they do not. */
+struct lel_psi_watch {
+	int fd;
+	char *file;
+	char *trigger;
+	unsigned long events;		// times it fired
+};
+
+struct lel_pressure {
+	struct lel_psi_watch *watches;
+	size_t count;
+	size_t size;
+};
+#define LEL_PSI_GROWS_BY 4
+#define LEL_PSI_READ_SIZE 256		// a pressure file is two short lines
+
+/* adds the trigger fds to xfds, and returns the highest fd to select() on */
+extern int lel_psi_fds (struct lel_eventloop *el, fd_set *xfds, int max_fd);
+
+/* after select(): calls the callbacks of the triggers that fired */
+extern void lel_psi_handle (lua_State *L, struct lel_eventloop *el,
+		fd_set *xfds);
+
+extern void lel_psi_free (struct lel_eventloop *el);
+
+/* exported api */
+extern int l_eventloop_pressure (lua_State *L);
+extern int l_eventloop_add_pressure (lua_State *L);
+extern int l_eventloop_remove_pressure (lua_State *L);
+
+#endif // __LUAIXP_PSI_H__
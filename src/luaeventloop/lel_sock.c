@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lel_debug.h"
+#include "lel_util.h"
+#include "lel_instance.h"
+#include "lel_sock.h"
+
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+static struct lel_socket *sock_find (struct lel_eventloop *el, int fd)
+{
+	size_t i;
+
+	for (i=0; i<el->sockets.count; i++)
+		if (el->sockets.socks[i].fd == fd)
+			return &el->sockets.socks[i];
+	return NULL;
+}
+
+static void sock_remove (struct lel_eventloop *el, struct lel_socket *s)
+{
+	size_t i = s - el->sockets.socks;
+
+	close (s->fd);
+	unlink (s->path);
+	free (s->path);
+
+	el->sockets.count--;
+	memmove (s, s + 1, (el->sockets.count - i) * sizeof (*s));
+}
+
+/* a socket file left behind by a process that is gone can be replaced,
+ * one that is still being listened on cannot; returns 0 if path is free */
+static int clear_path (const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd, rc;
+
+	if (lstat (addr->sun_path, &st) < 0)
+		return errno == ENOENT ? 0 : -1;
+
+	if (!S_ISSOCK (st.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	rc = connect (fd, (const struct sockaddr*)addr, sizeof (*addr));
+	close (fd);
+	if (!rc) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+
+	return unlink (addr->sun_path);
+}
+
+/* ------------------------------------------------------------------------
+ * select() integration
+ */
+
+int lel_sock_fds (struct lel_eventloop *el, fd_set *rfds, int max_fd)
+{
+	size_t i;
+
+	for (i=0; i<el->sockets.count; i++) {
+		int fd = el->sockets.socks[i].fd;
+		FD_SET (fd, rfds);
+		if (fd > max_fd)
+			max_fd = fd;
+	}
+	return max_fd;
+}
+
+/* calls the callback of fd with the arguments on the stack */
+static void sock_call (lua_State *L, int fd, int nargs)
+{
+	luaL_getmetatable (L, L_EVENTLOOP_MT);
+	lua_pushinteger (L, fd);
+	lua_gettable (L, -2);		// push (eventloop[fd])
+	lua_remove (L, -2);
+	lua_insert (L, -(nargs + 1));
+	lua_call (L, nargs, 0);
+}
+
+void lel_sock_handle (lua_State *L, struct lel_eventloop *el, fd_set *rfds)
+{
+	size_t i, n = 0, count = el->sockets.count;
+	int ready[count ? count : 1];
+
+	// callbacks can add and remove sockets, so we go by fd
+	for (i=0; i<count; i++)
+		if (FD_ISSET (el->sockets.socks[i].fd, rfds))
+			ready[n++] = el->sockets.socks[i].fd;
+
+	for (i=0; i<n; i++) {
+		struct lel_socket *s;
+		char buf[LEL_SOCK_MAX_MSG];
+		size_t taken;
+		int top = lua_gettop (L);
+
+		for (taken=0; (s = sock_find (el, ready[i])); taken++) {
+			ssize_t rc;
+
+			if (taken == s->max_batch)
+				// the rest waits for the next pass
+				break;
+
+			rc = recv (s->fd, buf, sizeof (buf),
+					MSG_DONTWAIT | MSG_TRUNC);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+
+			if (rc < 0) {
+				lua_pushnil (L);
+				lua_pushstring (L, strerror (errno));
+				sock_call (L, s->fd, 2);
+				break;
+			}
+
+			if ((size_t)rc > sizeof (buf)) {
+				// a bad message is reported, the socket goes on
+				s->truncated++;
+				lua_pushboolean (L, 0);
+				lua_pushstring (L, "message too long");
+				sock_call (L, s->fd, 2);
+				continue;
+			}
+
+			s->received++;
+			s->bytes += rc;
+			lua_pushlstring (L, buf, rc);
+			sock_call (L, s->fd, 1);
+		}
+
+		DBGF("** eventloop: %lu messages on fd %d **\n",
+				(unsigned long)taken, ready[i]);
+
+		lua_settop (L, top);
+	}
+}
+
+void lel_sock_free (struct lel_eventloop *el)
+{
+	while (el->sockets.count)
+		sock_remove (el, &el->sockets.socks[0]);
+
+	free (el->sockets.socks);
+	el->sockets.socks = NULL;
+	el->sockets.size = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: fd = el:add_socket(path, fn [, options]) -- listens for messages
+ *
+ *    path - where to make the unix datagram socket; a socket left there by
+ *           a process that is gone is replaced
+ *    fn - called as fn(message) from run_loop() for each datagram, with
+ *         false and an error for one longer than LEL_SOCK_MAX_MSG, which is
+ *         dropped, or with nil and an error if the socket fails
+ *    options - an optional table with
+ *        max_batch - most messages passed on per run_loop() pass (64); the
+ *                    rest wait in the kernel, and once that queue is full
+ *                    the senders wait too
+ *        mode - permissions of the socket file, 0600 by default
+ *
+ * Returns the fd to pass to remove_socket(), or nil and an error.
+ */
+int l_eventloop_add_socket (lua_State *L)
+{
+	struct lel_eventloop *el;
+	struct lel_socket *s;
+	struct sockaddr_un addr;
+	const char *path;
+	size_t len;
+	lua_Number max_batch = LEL_SOCK_MAX_BATCH;
+	int mode = 0600;
+	mode_t old_umask;
+	int fd, rc;
+
+	el = lel_checkeventloop (L, 1);
+	path = luaL_checklstring (L, 2, &len);
+	luaL_checktype (L, 3, LUA_TFUNCTION);
+	luaL_argcheck (L, len < sizeof (addr.sun_path), 2, "path is too long");
+
+	if (!lua_isnoneornil (L, 4)) {
+		luaL_checktype (L, 4, LUA_TTABLE);
+
+		lua_getfield (L, 4, "max_batch");
+		max_batch = luaL_optnumber (L, -1, max_batch);
+		luaL_argcheck (L, max_batch >= 1, 4,
+				"max_batch must be positive");
+		lua_getfield (L, 4, "mode");
+		mode = luaL_optint (L, -1, mode);
+		lua_pop (L, 2);
+	}
+
+	DBGF("** eventloop:add_socket (%s) **\n", path);
+
+	if (el->sockets.count == el->sockets.size) {
+		size_t size = el->sockets.size + LEL_SOCK_GROWS_BY;
+		void *n = realloc (el->sockets.socks,
+				size * sizeof (*el->sockets.socks));
+		if (!n)
+			return lel_pusherror (L, "out of memory");
+		el->sockets.socks = n;
+		el->sockets.size = size;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	memcpy (addr.sun_path, path, len);
+
+	if (clear_path (&addr) < 0)
+		return lel_pusherror (L, path);
+
+	fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return lel_pusherror (L, "socket");
+
+	// the socket file is made with these permissions from the start
+	old_umask = umask (~mode & 0777);
+	rc = bind (fd, (const struct sockaddr*)&addr, sizeof (addr));
+	umask (old_umask);
+	if (rc < 0) {
+		int err = errno;
+		close (fd);
+		errno = err;
+		return lel_pusherror (L, path);
+	}
+
+	s = &el->sockets.socks[el->sockets.count];
+	memset (s, 0, sizeof (*s));
+	s->fd = fd;
+	s->path = strdup (path);
+	s->max_batch = (size_t)max_batch;
+	el->sockets.count++;
+
+	// the callback is kept in the metatable by fd, as for add_exec()
+	luaL_getmetatable (L, L_EVENTLOOP_MT);
+	lua_pushinteger (L, fd);
+	lua_pushvalue (L, 3);
+	lua_settable (L, -3);			// eventloop[fd] = function
+
+	lua_pushinteger (L, fd);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: received = el:remove_socket(fd) -- closes and removes a socket
+ *
+ * Returns the number of messages it passed on, or nil if there is no such
+ * socket.
+ */
+int l_eventloop_remove_socket (lua_State *L)
+{
+	struct lel_eventloop *el;
+	struct lel_socket *s;
+	int fd;
+
+	el = lel_checkeventloop (L, 1);
+	fd = luaL_checkinteger (L, 2);
+
+	DBGF("** eventloop:remove_socket (%d) **\n", fd);
+
+	s = sock_find (el, fd);
+	if (!s) {
+		lua_pushnil (L);
+		return 1;
+	}
+	lua_pushinteger (L, s->received);
+	sock_remove (el, s);
+
+	luaL_getmetatable (L, L_EVENTLOOP_MT);
+	lua_pushinteger (L, fd);
+	lua_pushnil (L);
+	lua_settable (L, -3);			// eventloop[fd] = nil
+	lua_pop (L, 1);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: t = el:socket_stats(fd)
+ *
+ *    t - a table with path, received (messages passed on), truncated
+ *        (dropped as too long) and bytes, or nil if there is no such
+ *        socket
+ */
+int l_eventloop_socket_stats (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct lel_socket *s = sock_find (el, luaL_checkinteger (L, 2));
+
+	if (!s) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_newtable (L);
+	lua_pushstring (L, s->path);
+	lua_setfield (L, -2, "path");
+	lua_pushinteger (L, s->received);
+	lua_setfield (L, -2, "received");
+	lua_pushinteger (L, s->truncated);
+	lua_setfield (L, -2, "truncated");
+	lua_pushinteger (L, s->bytes);
+	lua_setfield (L, -2, "bytes");
+	return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef __LUAIXP_SOCK_H__
+#define __LUAIXP_SOCK_H__
+
+#include <sys/select.h>
+#include <lua.h>
+
+struct lel_eventloop;
+
+/* A unix datagram socket that other programs send short messages to.  Each
+ * datagram is one message, so there is nothing to frame and no connection
+ * to keep; while we are busy they queue up in the kernel, and once that
+ * queue is full the senders block or get EAGAIN. */
+struct lel_socket {
+	int fd;
+	char *path;			// unlinked when the socket is closed
+	size_t max_batch;		// most messages taken per run_loop() pass
+	unsigned long received;		// messages passed on
+	unsigned long truncated;	// messages too long to pass on
+	unsigned long bytes;
+};
+
+struct lel_sockets {
+	struct lel_socket *socks;
+	size_t count;
+	size_t size;
+};
+#define LEL_SOCK_GROWS_BY 2
+#define LEL_SOCK_MAX_MSG 4096		// longer messages are dropped
+#define LEL_SOCK_MAX_BATCH 64
+
+/* adds the socket fds to rfds, and returns the highest fd to select() on */
+extern int lel_sock_fds (struct lel_eventloop *el, fd_set *rfds, int max_fd);
+
+/* after select(): passes the messages that came in to the callbacks */
+extern void lel_sock_handle (lua_State *L, struct lel_eventloop *el,
+		fd_set *rfds);
+
+extern void lel_sock_free (struct lel_eventloop *el);
+
+/* exported api */
+extern int l_eventloop_add_socket (lua_State *L);
+extern int l_eventloop_remove_socket (lua_State *L);
+extern int l_eventloop_socket_stats (lua_State *L);
+
+#endif // __LUAIXP_SOCK_H__
@@ -0,0 +1,656 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lel_debug.h"
+#include "lel_util.h"
+#include "lel_spawn.h"
+
+/*
+ * The spawner is a small helper process that is forked while wmiirc is
+ * still small.  Later fork()s happen in the helper, so the page tables of
+ * the (by then much larger) Lua process are never copied.  Requests go
+ * over a SOCK_SEQPACKET socket pair, one request per packet; stdio file
+ * descriptors are passed along with SCM_RIGHTS.
+ */
+
+extern char **environ;
+
+#define LEL_SPAWN_MAX_FDS 3
+
+union lel_spawn_cmsg {
+	struct cmsghdr h;
+	char buf[CMSG_SPACE(sizeof(int) * LEL_SPAWN_MAX_FDS)];
+};
+
+/* ------------------------------------------------------------------------
+ * helper process side
+ */
+
+static void spawner_sigchld (int sig)
+{
+	/* only here to interrupt recvmsg(), children are reaped in the loop */
+	(void)sig;
+}
+
+static void spawner_reap (void)
+{
+	while (waitpid (-1, NULL, WNOHANG) > 0);
+}
+
+static void spawner_close_fds (int keep)
+{
+	struct rlimit rl;
+	int fd, max = 1024;
+
+	if (!getrlimit (RLIMIT_NOFILE, &rl)
+			&& rl.rlim_cur != RLIM_INFINITY
+			&& rl.rlim_cur < 65536)
+		max = rl.rlim_cur;
+
+	for (fd = 3; fd < max; fd++)
+		if (fd != keep)
+			close (fd);
+}
+
+/* split the string area of a request into cwd, argv and envp; the arrays
+ * point into the message buffer */
+static int spawner_parse (struct lel_spawn_req *req, char *strs,
+		char **cwd, char ***argv, char ***envp)
+{
+	int count = 1 + req->argc + (req->envc > 0 ? req->envc : 0);
+	char **v, *p = strs, *end = strs + req->len;
+	int i;
+
+	if (req->argc < 1 || req->envc < -1 || !req->len || end[-1])
+		return -1;
+
+	v = calloc (count + 2, sizeof (char*));
+	if (!v)
+		return -1;
+
+	for (i=0; i<count; i++) {
+		if (p >= end) {
+			free (v);
+			return -1;
+		}
+		v[i < 1 + req->argc ? i : i + 1] = p;
+		p += strlen (p) + 1;
+	}
+
+	/* v = cwd, argv..., NULL, envp..., NULL */
+	*cwd = v[0];
+	*argv = v + 1;
+	*envp = req->envc >= 0 ? v + 1 + req->argc + 1 : NULL;
+	return 0;
+}
+
+static void spawner_exec (struct lel_spawn_req *req, const char *cwd,
+		char **argv, char **envp, int *fds, int errfd)
+{
+	sigset_t set;
+	int i, err;
+
+	signal (SIGCHLD, SIG_DFL);
+	signal (SIGPIPE, SIG_DFL);
+	sigemptyset (&set);
+	sigprocmask (SIG_SETMASK, &set, NULL);
+
+	if (req->flags & LEL_SPAWN_SETSID)
+		setsid ();
+
+	for (i=0; i<3; i++) {
+		if (req->fdmap[i] >= 0 && dup2 (fds[req->fdmap[i]], i) < 0)
+			goto fail;
+	}
+
+	if (*cwd && chdir (cwd) < 0)
+		goto fail;
+
+	if (envp && (req->flags & LEL_SPAWN_KEEP_ENV)) {
+		for (; *envp; envp++)
+			putenv (*envp);
+	} else if (envp) {
+		environ = envp;
+	}
+
+	execvp (argv[0], argv);
+
+fail:
+	err = errno;
+	if (write (errfd, &err, sizeof (err)) < 0) {
+		/* nothing we can do */
+	}
+	_exit (127);
+}
+
+static void spawner_handle (int sock, struct lel_spawn_req *req, char *strs,
+		int *fds, int nfds)
+{
+	struct lel_spawn_rep rep;
+	char *cwd, **argv, **envp, **vec = NULL;
+	int ep[2] = { -1, -1 };
+	int i, n, err, status;
+	pid_t pid;
+
+	memset (&rep, 0, sizeof (rep));
+	rep.seq = req->seq;
+	rep.pid = -1;
+
+	for (i=0; i<3; i++) {
+		if (req->fdmap[i] >= nfds) {
+			rep.err = EBADF;
+			goto reply;
+		}
+	}
+
+	if (spawner_parse (req, strs, &cwd, &argv, &envp) < 0) {
+		rep.err = EINVAL;
+		goto reply;
+	}
+	vec = argv - 1;
+
+	/* the child reports a failed exec through this pipe, a successful
+	 * exec closes it */
+	if (pipe2 (ep, O_CLOEXEC) < 0) {
+		rep.err = errno;
+		goto reply;
+	}
+
+	pid = fork ();
+	if (pid < 0) {
+		rep.err = errno;
+		goto reply;
+	}
+	if (!pid) {
+		close (ep[0]);
+		spawner_exec (req, cwd, argv, envp, fds, ep[1]);
+	}
+
+	close (ep[1]);
+	ep[1] = -1;
+	do {
+		n = read (ep[0], &err, sizeof (err));
+	} while (n < 0 && errno == EINTR);
+
+	if (n == sizeof (err)) {
+		rep.err = err;
+		while (waitpid (pid, NULL, 0) < 0 && errno == EINTR);
+		goto reply;
+	}
+
+	rep.pid = pid;
+	if (req->flags & LEL_SPAWN_WAIT) {
+		while (waitpid (pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+		rep.status = status;
+	}
+
+reply:
+	if (ep[0] >= 0)
+		close (ep[0]);
+	if (ep[1] >= 0)
+		close (ep[1]);
+	free (vec);
+	send (sock, &rep, sizeof (rep), MSG_NOSIGNAL);
+}
+
+static void spawner_main (int sock)
+{
+	struct sigaction sa;
+	union lel_spawn_cmsg cm;
+	struct lel_spawn_req req;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *c;
+	int fds[LEL_SPAWN_MAX_FDS];
+	int i, nfds;
+	ssize_t n;
+	char *msg;
+
+	spawner_close_fds (sock);
+
+	/* no SA_RESTART, a SIGCHLD wakes up recvmsg() to reap the child */
+	memset (&sa, 0, sizeof (sa));
+	sa.sa_handler = spawner_sigchld;
+	sigemptyset (&sa.sa_mask);
+	sa.sa_flags = SA_NOCLDSTOP;
+	sigaction (SIGCHLD, &sa, NULL);
+	signal (SIGPIPE, SIG_IGN);
+
+	msg = malloc (LEL_SPAWN_MSG_MAX);
+	if (!msg)
+		_exit (1);
+
+	for (;;) {
+		/* a child that exits between here and recvmsg() stays a
+		 * zombie until the next request or SIGCHLD */
+		spawner_reap ();
+
+		iov.iov_base = msg;
+		iov.iov_len = LEL_SPAWN_MSG_MAX;
+		memset (&mh, 0, sizeof (mh));
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = cm.buf;
+		mh.msg_controllen = sizeof (cm.buf);
+
+		n = recvmsg (sock, &mh, MSG_CMSG_CLOEXEC);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			/* wmiirc went away */
+			_exit (0);
+
+		nfds = 0;
+		for (c = CMSG_FIRSTHDR (&mh); c; c = CMSG_NXTHDR (&mh, c)) {
+			if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+				int cnt = (c->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+				int *p = (int*)CMSG_DATA (c);
+				for (i=0; i<cnt; i++) {
+					if (nfds < LEL_SPAWN_MAX_FDS)
+						fds[nfds++] = p[i];
+					else
+						close (p[i]);
+				}
+			}
+		}
+
+		if ((size_t)n >= sizeof (req)) {
+			memcpy (&req, msg, sizeof (req));
+			if (sizeof (req) + req.len != (size_t)n)
+				req.len = 0;	/* rejected by spawner_parse */
+			spawner_handle (sock, &req, msg + sizeof (req), fds, nfds);
+		}
+
+		for (i=0; i<nfds; i++)
+			close (fds[i]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * wmiirc side
+ */
+
+static struct lel_spawner *lel_checkspawner (lua_State *L, int narg)
+{
+	void *ud = luaL_checkudata (L, narg, L_SPAWNER_MT);
+	luaL_argcheck (L, ud != NULL, 1, "`spawner' expected");
+	return (struct lel_spawner*)ud;
+}
+
+static void spawner_shutdown (struct lel_spawner *sp)
+{
+	if (sp->sock < 0)
+		return;
+
+	/* the helper exits when it sees the socket close */
+	close (sp->sock);
+	sp->sock = -1;
+	while (waitpid (sp->pid, NULL, 0) < 0 && errno == EINTR);
+}
+
+/* ------------------------------------------------------------------------
+ * lua: sp = eventloop.spawner() -- fork the spawn helper
+ */
+int l_spawner_new (lua_State *L)
+{
+	struct lel_spawner *sp;
+	int sv[2];
+	pid_t pid;
+
+	DBGF("** eventloop.spawner () **\n");
+
+	if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+		return lel_pusherror (L, "spawner: socketpair failed");
+
+	pid = fork ();
+	if (pid < 0) {
+		close (sv[0]);
+		close (sv[1]);
+		return lel_pusherror (L, "spawner: fork failed");
+	}
+	if (!pid) {
+		close (sv[0]);
+		spawner_main (sv[1]);
+		_exit (0);
+	}
+	close (sv[1]);
+
+	sp = (struct lel_spawner*)lua_newuserdata (L, sizeof (struct lel_spawner));
+	luaL_getmetatable (L, L_SPAWNER_MT);
+	lua_setmetatable (L, -2);
+
+	sp->sock = sv[0];
+	sp->pid = pid;
+	sp->seq = 0;
+
+	return 1;
+}
+
+/* append a NUL terminated string to the request */
+static void spawn_add (lua_State *L, char *msg, size_t *pos,
+		const char *s, size_t len)
+{
+	if (memchr (s, 0, len))
+		luaL_error (L, "spawn: strings cannot contain NUL characters");
+	if (*pos + len + 1 > LEL_SPAWN_MSG_MAX)
+		luaL_error (L, "spawn: request is too large");
+
+	memcpy (msg + *pos, s, len);
+	msg[*pos + len] = 0;
+	*pos += len + 1;
+}
+
+static int spawn_flag (lua_State *L, int idx, const char *name)
+{
+	int rc;
+	lua_getfield (L, idx, name);
+	rc = lua_toboolean (L, -1);
+	lua_pop (L, 1);
+	return rc;
+}
+
+static int spawn_status (int status)
+{
+	if (WIFEXITED (status))
+		return WEXITSTATUS (status);
+	if (WIFSIGNALED (status))
+		return 128 + WTERMSIG (status);
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: pid [,status [,output]] = sp:spawn{ argv = {...}, ... }
+ *
+ *      argv    - program and arguments, the program is looked up in PATH
+ *      cwd     - working directory
+ *      env     - replacement environment, { "K=V", ... } or { K = "V", ... }
+ *      keep_env - add env to the inherited environment instead of replacing it
+ *      setsid  - run the program in a new session
+ *      wait    - wait for the program to exit and return its exit status
+ *      capture - collect standard output and return it, implies wait
+ *      stdin, stdout, stderr - file descriptors for the program's stdio
+ *
+ * The exit status is the exit code, or 128 plus the signal number.
+ */
+static int l_spawner_spawn (lua_State *L)
+{
+	static char msg[LEL_SPAWN_MSG_MAX];
+	static const char *stdio[3] = { "stdin", "stdout", "stderr" };
+	struct lel_spawner *sp;
+	struct lel_spawn_req req;
+	struct lel_spawn_rep rep;
+	union lel_spawn_cmsg cm;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *c;
+	int fds[LEL_SPAWN_MAX_FDS];
+	int cp[2] = { -1, -1 };
+	int i, nfds = 0, capture, out = 0;
+	size_t pos = sizeof (req);
+	ssize_t n;
+
+	sp = lel_checkspawner (L, 1);
+	luaL_checktype (L, 2, LUA_TTABLE);
+
+	if (sp->sock < 0) {
+		errno = 0;
+		return lel_pusherror (L, "spawn: spawner is closed");
+	}
+
+	memset (&req, 0, sizeof (req));
+	req.seq = ++sp->seq;
+	req.envc = -1;
+	for (i=0; i<3; i++)
+		req.fdmap[i] = -1;
+
+	capture = spawn_flag (L, 2, "capture");
+	if (spawn_flag (L, 2, "setsid"))
+		req.flags |= LEL_SPAWN_SETSID;
+	if (capture || spawn_flag (L, 2, "wait"))
+		req.flags |= LEL_SPAWN_WAIT;
+	if (spawn_flag (L, 2, "keep_env"))
+		req.flags |= LEL_SPAWN_KEEP_ENV;
+
+	/* cwd */
+	lua_getfield (L, 2, "cwd");
+	if (lua_isnil (L, -1)) {
+		spawn_add (L, msg, &pos, "", 0);
+	} else {
+		size_t len;
+		const char *s = luaL_checklstring (L, -1, &len);
+		spawn_add (L, msg, &pos, s, len);
+	}
+	lua_pop (L, 1);
+
+	/* argv */
+	lua_getfield (L, 2, "argv");
+	if (!lua_istable (L, -1) || !lua_objlen (L, -1))
+		return luaL_error (L, "spawn: argv must be a non-empty table of strings");
+	req.argc = lua_objlen (L, -1);
+	for (i=1; i<=req.argc; i++) {
+		size_t len;
+		const char *s;
+		lua_rawgeti (L, -1, i);
+		if (!(s = lua_tolstring (L, -1, &len)))
+			return luaL_error (L, "spawn: argv[%d] is not a string", i);
+		spawn_add (L, msg, &pos, s, len);
+		lua_pop (L, 1);
+	}
+	lua_pop (L, 1);
+
+	/* env */
+	lua_getfield (L, 2, "env");
+	if (lua_istable (L, -1)) {
+		req.envc = 0;
+		lua_pushnil (L);
+		while (lua_next (L, -2)) {
+			size_t len;
+			const char *s;
+			if (lua_type (L, -2) == LUA_TSTRING) {
+				if (!lua_tostring (L, -1))
+					return luaL_error (L, "spawn: env.%s is not a string",
+							lua_tostring (L, -2));
+				lua_pushfstring (L, "%s=%s", lua_tostring (L, -2),
+						lua_tostring (L, -1));
+			} else if (lua_type (L, -1) == LUA_TSTRING) {
+				lua_pushvalue (L, -1);
+			} else {
+				return luaL_error (L, "spawn: bad env entry");
+			}
+			s = lua_tolstring (L, -1, &len);
+			spawn_add (L, msg, &pos, s, len);
+			req.envc++;
+			lua_pop (L, 2);
+		}
+	} else if (!lua_isnil (L, -1)) {
+		return luaL_error (L, "spawn: env must be a table");
+	}
+	lua_pop (L, 1);
+
+	/* stdio */
+	for (i=0; i<3; i++) {
+		lua_getfield (L, 2, stdio[i]);
+		if (!lua_isnil (L, -1)) {
+			fds[nfds] = luaL_checkint (L, -1);
+			req.fdmap[i] = nfds++;
+		}
+		lua_pop (L, 1);
+	}
+
+	if (capture) {
+		if (pipe2 (cp, O_CLOEXEC) < 0)
+			return lel_pusherror (L, "spawn: pipe failed");
+		if (req.fdmap[1] < 0)
+			req.fdmap[1] = nfds++;
+		fds[req.fdmap[1]] = cp[1];
+	}
+
+	req.len = pos - sizeof (req);
+	memcpy (msg, &req, sizeof (req));
+
+	iov.iov_base = msg;
+	iov.iov_len = pos;
+	memset (&mh, 0, sizeof (mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (nfds) {
+		memset (&cm, 0, sizeof (cm));
+		mh.msg_control = cm.buf;
+		mh.msg_controllen = CMSG_SPACE(sizeof (int) * nfds);
+		c = CMSG_FIRSTHDR (&mh);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(sizeof (int) * nfds);
+		memcpy (CMSG_DATA (c), fds, sizeof (int) * nfds);
+	}
+
+	do {
+		n = sendmsg (sp->sock, &mh, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+
+	if (cp[1] >= 0)
+		close (cp[1]);
+
+	if (n < 0) {
+		int err = errno;
+		if (cp[0] >= 0)
+			close (cp[0]);
+		errno = err;
+		return lel_pusherror (L, "spawn: send failed");
+	}
+
+	/* drain the output before waiting for the reply, or a chatty
+	 * program would block on a full pipe */
+	if (capture) {
+		luaL_Buffer b;
+		luaL_buffinit (L, &b);
+		for (;;) {
+			char *p = luaL_prepbuffer (&b);
+			n = read (cp[0], p, LUAL_BUFFERSIZE);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			luaL_addsize (&b, n);
+		}
+		luaL_pushresult (&b);
+		out = lua_gettop (L);
+		close (cp[0]);
+	}
+
+	for (;;) {
+		n = recv (sp->sock, &rep, sizeof (rep), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n != sizeof (rep)) {
+			spawner_shutdown (sp);
+			errno = 0;
+			return lel_pusherror (L, "spawn: spawner went away");
+		}
+		if (rep.seq == req.seq)
+			break;
+		/* a reply to a request we gave up on */
+	}
+
+	if (rep.pid < 0) {
+		errno = rep.err;
+		return lel_pusherror (L, "spawn");
+	}
+
+	lua_pushinteger (L, rep.pid);
+	if (!(req.flags & LEL_SPAWN_WAIT))
+		return 1;
+
+	lua_pushinteger (L, spawn_status (rep.status));
+	if (!capture)
+		return 2;
+
+	lua_pushvalue (L, out);
+	return 3;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: pid = sp:pid() -- pid of the helper process
+ */
+static int l_spawner_pid (lua_State *L)
+{
+	struct lel_spawner *sp = lel_checkspawner (L, 1);
+
+	if (sp->sock < 0)
+		return 0;
+
+	lua_pushinteger (L, sp->pid);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: sp:close() -- stop the helper process
+ */
+static int l_spawner_close (lua_State *L)
+{
+	struct lel_spawner *sp = lel_checkspawner (L, 1);
+
+	DBGF("** spawner:close (%p) **\n", sp);
+
+	spawner_shutdown (sp);
+	return 0;
+}
+
+static int l_spawner_tostring (lua_State *L)
+{
+	struct lel_spawner *sp = lel_checkspawner (L, 1);
+	lua_pushfstring (L, "spawner instance %p", sp);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * the instance method table
+ */
+static const luaL_reg spawner_table[] =
+{
+	{ "__tostring",		l_spawner_tostring },
+	{ "__gc",		l_spawner_close },
+
+	{ "spawn",		l_spawner_spawn },
+	{ "pid",		l_spawner_pid },
+	{ "close",		l_spawner_close },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the spawner metatable, leaves the stack as it found it
+ */
+int lel_init_spawner_class (lua_State *L)
+{
+	luaL_newmetatable(L, L_SPAWNER_MT);
+
+	lua_pushstring (L, "__index");
+	lua_pushvalue (L, -2);
+	lua_settable (L, -3);
+
+	luaL_openlib (L, NULL, spawner_table, 0);
+	lua_pop (L, 1);
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef __LUAIXP_SPAWN_H__
+#define __LUAIXP_SPAWN_H__
+
+#include <stdint.h>
+#include <lua.h>
+
+#define L_SPAWNER_MT "eventloop.spawner_mt"
+
+/* the C representation of a spawner object; the helper process is forked
+ * when the object is created and lives until the socket is closed */
+struct lel_spawner {
+	int sock;		// our end of the socket pair, -1 when closed
+	int pid;		// pid of the helper process
+	uint32_t seq;		// sequence number of the last request
+};
+
+/* a request, followed by len bytes of NUL terminated strings:
+ * cwd (empty to inherit), argc arguments, envc environment entries */
+struct lel_spawn_req {
+	uint32_t seq;
+	uint32_t flags;
+	int32_t argc;
+	int32_t envc;		// -1 to inherit the helper's environment
+	int32_t fdmap[3];	// index into the passed fds for 0,1,2; -1 to inherit
+	uint32_t len;
+};
+#define LEL_SPAWN_SETSID	0x01	// run the child in a new session
+#define LEL_SPAWN_WAIT		0x02	// reply when the child exits
+#define LEL_SPAWN_KEEP_ENV	0x04	// add env entries to the inherited environment
+
+/* the reply to a request */
+struct lel_spawn_rep {
+	uint32_t seq;
+	int32_t pid;		// -1 on failure
+	int32_t err;		// errno of the failing step
+	int32_t status;		// wait status, if LEL_SPAWN_WAIT was given
+};
+
+#define LEL_SPAWN_MSG_MAX	65536
+
+extern int l_spawner_new (lua_State *L);
+extern int lel_init_spawner_class (lua_State *L);
+
+#endif // __LUAIXP_SPAWN_H__
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/timerfd.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lel_debug.h"
+#include "lel_util.h"
+#include "lel_instance.h"
+#include "lel_timer.h"
+
+
+/* ------------------------------------------------------------------------
+ * select() integration
+ */
+
+int lel_timer_fds (struct lel_eventloop *el, fd_set *rfds, int max_fd)
+{
+	if (el->wall.fd < 0 || !el->wall.at)
+		return max_fd;
+
+	FD_SET (el->wall.fd, rfds);
+	return el->wall.fd > max_fd ? el->wall.fd : max_fd;
+}
+
+int lel_timer_handle (struct lel_eventloop *el, fd_set *rfds)
+{
+	uint64_t expired;
+	ssize_t rc;
+
+	if (el->wall.fd < 0 || !el->wall.at || !FD_ISSET (el->wall.fd, rfds))
+		return 0;
+
+	do {
+		rc = read (el->wall.fd, &expired, sizeof (expired));
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc < 0 && errno == ECANCELED) {
+		// the clock was set; the caller works out the new schedule
+		// and arms the timer again
+		DBGF("** eventloop: wall clock was set **\n");
+		el->wall.clock_sets++;
+		el->wall.at = 0;
+		return 1;
+	}
+	if (rc < 0)
+		return 0;	// EAGAIN, it was disarmed under us
+
+	DBGF("** eventloop: wall clock timer fired **\n");
+	el->wall.wakeups++;
+	el->wall.at = 0;
+	return 1;
+}
+
+void lel_timer_free (struct lel_eventloop *el)
+{
+	if (el->wall.fd >= 0)
+		close (el->wall.fd);
+	el->wall.fd = -1;
+	el->wall.at = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: t = eventloop.walltime() -- wall clock time in seconds since the
+ * epoch, with sub-second part
+ */
+int l_eventloop_walltime (lua_State *L)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_REALTIME, &ts) < 0)
+		return lel_pusherror (L, "clock_gettime failed");
+
+	lua_pushnumber (L, (lua_Number)ts.tv_sec + (lua_Number)ts.tv_nsec / 1e9);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: wakeups, sets = el:wake_at([t]) -- makes run_loop() return at a wall
+ * clock time
+ *
+ *    t - seconds since the epoch, as eventloop.walltime(); nil disarms
+ *
+ * run_loop() also returns as soon as the clock is set, be it by hand or by
+ * NTP stepping it, so aligned schedules can be worked out again.  Returns
+ * the number of times the timer fired and the number of times the clock
+ * was set so far, or nil and an error.
+ */
+int l_eventloop_wake_at (lua_State *L)
+{
+	struct lel_eventloop *el = lel_checkeventloop (L, 1);
+	struct itimerspec its;
+	lua_Number at = luaL_optnumber (L, 2, 0);
+
+	memset (&its, 0, sizeof (its));
+
+	if (at > 0) {
+		if (el->wall.fd < 0) {
+			el->wall.fd = timerfd_create (CLOCK_REALTIME,
+					TFD_NONBLOCK | TFD_CLOEXEC);
+			if (el->wall.fd < 0)
+				return lel_pusherror (L, "timerfd_create failed");
+		}
+		its.it_value.tv_sec = (time_t)at;
+		its.it_value.tv_nsec = (long)((at - its.it_value.tv_sec) * 1e9);
+	}
+
+	DBGF("** eventloop:wake_at (%f) **\n", (double)at);
+
+	if (el->wall.fd >= 0 && timerfd_settime (el->wall.fd,
+				TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+				&its, NULL) < 0) {
+		el->wall.at = 0;
+		return lel_pusherror (L, "timerfd_settime failed");
+	}
+	el->wall.at = at > 0 ? at : 0;
+
+	lua_pushnumber (L, el->wall.wakeups);
+	lua_pushnumber (L, el->wall.clock_sets);
+	return 2;
+}
@@ -0,0 +1,31 @@
+#ifndef __LUAIXP_TIMER_H__
+#define __LUAIXP_TIMER_H__
+
+#include <sys/select.h>
+#include <lua.h>
+
+struct lel_eventloop;
+
+/* A wall clock wakeup for run_loop(): a CLOCK_REALTIME timerfd armed at an
+ * absolute time.  Unlike the select() timeout it fires on time after a
+ * suspend, and it is cancelled, waking the loop, when the clock is set. */
+struct lel_wall {
+	int fd;				// the timerfd, -1 until first armed
+	double at;			// when it fires, 0 if disarmed
+	unsigned long wakeups;		// times it fired
+	unsigned long clock_sets;	// times the clock was set under it
+};
+
+/* adds the timerfd to rfds, and returns the highest fd to select() on */
+extern int lel_timer_fds (struct lel_eventloop *el, fd_set *rfds, int max_fd);
+
+/* after select(): returns 1 if the timer fired or the clock was set */
+extern int lel_timer_handle (struct lel_eventloop *el, fd_set *rfds);
+
+extern void lel_timer_free (struct lel_eventloop *el);
+
+/* exported api */
+extern int l_eventloop_walltime (lua_State *L);
+extern int l_eventloop_wake_at (lua_State *L);
+
+#endif // __LUAIXP_TIMER_H__
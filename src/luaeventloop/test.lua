@@ -6,19 +6,261 @@ el = eventloop.new()
 
 io.stderr:write("---- adding dsat --load\n")
 el:add_exec ("dstat --load --nocolor --noheaders --noupdate",
-                function (line)
+                function (line, err)
+                        if not line then
+                                print ("    ** load: " .. tostring(err))
+                                return
+                        end
                         local line = line:gsub("\n$","")
                         print ("    ** load: " .. line)
                 end)
 
 io.stderr:write("---- adding dstat --int\n")
 el:add_exec ("dstat --int --nocolor --noheaders --noupdate",
-                function (line)
+                function (line, err)
+                        if not line then
+                                print ("    ** int: " .. tostring(err))
+                                return
+                        end
                         local line = line:gsub("\n$","")
                         print ("    ** int: " .. line)
                 end)
 
+io.stderr:write("---- adding a short lived program\n")
+local started = eventloop.now()
+el:add_exec ("echo hello",
+                function (line, err)
+                        print (string.format("    ** echo: %s (%.3fs)",
+                                tostring(line or err), eventloop.now() - started))
+                end)
+
+io.stderr:write("---- adding framed programs\n")
+local function show_records (name)
+        return function (rec, err)
+                if type(rec) == "table" then
+                        local keys = {}
+                        for k,v in pairs(rec) do
+                                table.insert (keys, tostring(k) .. "=" .. tostring(v))
+                        end
+                        table.sort (keys)
+                        rec = "{" .. table.concat (keys, ",") .. "}"
+                end
+                print (string.format ("    ** %s: %s %s", name,
+                        tostring(rec), tostring(err or "")))
+        end
+end
+el:add_exec ("printf 'one\\nline\\0two\\0'",
+                show_records ("nul"), { framing = "nul" })
+el:add_exec ("printf '5:hello,0:,3:a\\nb,'",
+                show_records ("netstring"), { framing = "netstring" })
+el:add_exec ("printf '\\0\\0\\0\\002hi'",
+                show_records ("length"), { framing = "length" })
+el:add_exec ("printf '{\"a\":1,\"b\":null}\\n[1,\\n\"x\\\\u00e9\"\\n'",
+                show_records ("json"), { framing = "json" })
+
+io.stderr:write("---- adding a fast producer\n")
+local latest, fast
+fast = el:add_exec ("seq 1 100000",
+                function (line, err)
+                        if line then
+                                latest = line
+                                return
+                        end
+                        local st = el:stats (fast)
+                        print (string.format ("    ** seq: latest %s, %d passed on, %d dropped",
+                                tostring(latest), st.records, st.dropped))
+                end, { keep = "latest" })
+
+io.stderr:write("---- adding a pull program\n")
+local pulled
+pulled = el:add_exec ("printf 'a\\nb\\nc\\nd'",
+                function (ready, err)
+                        if ready ~= true then
+                                print ("    ** pull: " .. tostring(err))
+                                return
+                        end
+                        -- takes two at a time, the rest comes in the next batch
+                        local recs = {}
+                        for i=1,2 do
+                                recs[#recs+1] = el:next_record (pulled)
+                        end
+                        print ("    ** pull: " .. table.concat (recs, ","))
+                end, { pull = true })
+
+io.stderr:write("---- adding a paused program\n")
+local paused = el:add_exec ("echo resumed",
+                function (line, err)
+                        print ("    ** paused: " .. tostring(line or err))
+                end, { high_water = 1 })
+el:pause (paused)
+
+io.stderr:write("---- spawning through the helper\n")
+local sp = assert(eventloop.spawner())
+local pid, rc, out = sp:spawn { argv = { "sh", "-c", "echo $FOO; exit 3" },
+                                env = { FOO = "from spawn" }, capture = true }
+print (string.format("    ** spawn: pid=%s rc=%s out=%s", tostring(pid),
+        tostring(rc), tostring(out):gsub("\n$","")))
+print ("    ** spawn missing: " .. tostring(select(2, sp:spawn { argv = { "/nonexistent" } })))
+sp:close()
+
 io.stderr:write("---- running loop\n")
-el:run_loop(10)
+-- run_loop() returns after each batch of events
+local stop = eventloop.now() + 10
+while eventloop.now() < stop do
+        el:run_loop(math.min (1, stop - eventloop.now()))
+        if paused and eventloop.now() > stop - 5 then
+                el:resume (paused)
+                paused = nil
+        end
+end
+
+io.stderr:write("---- waking up on the wall clock\n")
+-- run_loop() returns at the next whole second, well before its timeout
+local sleeper = el:add_exec ("sleep 5", function () end)
+local at = math.floor (eventloop.walltime ()) + 1
+el:wake_at (at)
+el:run_loop (3)
+local fired, sets = el:wake_at ()
+print (string.format ("    ** woke %.3fs from the deadline, fired %d, clock set %d",
+        eventloop.walltime () - at, fired, sets))
+el:kill_exec (sleeper)
+
+io.stderr:write("---- pressure stall triggers\n")
+local p, err = eventloop.pressure ("/proc/pressure/cpu")
+if not p then
+        print ("    ** no pressure accounting: " .. tostring(err))
+else
+        print (string.format ("    ** cpu some avg10=%.2f total=%d", p.some.avg10, p.some.total))
+        -- twice as many spinners as cpus keeps some of them waiting
+        local stalled = nil
+        local psi, err = el:add_pressure ("/proc/pressure/cpu", "some 50000 2000000",
+                function (fd, t, err)
+                        stalled = t and t.some.avg10 or err
+                end)
+        if not psi then
+                print ("    ** cannot add a trigger: " .. tostring(err))
+        else
+                local spin = el:add_exec ("n=$(($(nproc) * 2)); while [ $n -gt 0 ]; do "
+                        .. "timeout 4 sh -c 'while :; do :; done' & n=$((n-1)); done; wait",
+                        function () end)
+                local stop = eventloop.now () + 6
+                while not stalled and eventloop.now () < stop do
+                        el:run_loop (stop - eventloop.now ())
+                end
+                print ("    ** stalled: " .. tostring(stalled) .. ", fired "
+                        .. tostring(el:remove_pressure (psi)) .. " times")
+                el:kill_exec (spin)
+        end
+end
+
+io.stderr:write("---- message socket\n")
+local path = os.tmpname ()
+os.remove (path)
+local got = {}
+local sock, err = el:add_socket (path, function (msg, err)
+        got[#got+1] = msg or ("error: " .. tostring(err))
+end, { max_batch = 2 })
+-- os.execute() returns 0 on 5.1 and true on later versions
+local rc = os.execute ("command -v socat >/dev/null")
+if not sock then
+        print ("    ** cannot add a socket: " .. tostring(err))
+elseif rc ~= 0 and rc ~= true then
+        print ("    ** socat is needed to send to the socket")
+        el:remove_socket (sock)
+else
+        el:add_exec ("for m in one two three; do printf $m | socat - UNIX-SENDTO:"
+                .. path .. "; done", function () end)
+        local stop = eventloop.now () + 3
+        while #got < 3 and eventloop.now () < stop do
+                el:run_loop (stop - eventloop.now ())
+        end
+        local st = el:socket_stats (sock)
+        print (string.format ("    ** got %s, %d bytes, removed after %d",
+                table.concat (got, ","), st.bytes, el:remove_socket (sock)))
+end
+
+io.stderr:write("---- priority and service\n")
+-- the priority program is passed on first, though its fd is higher
+local order = {}
+local function note (line)
+        if line then
+                order[#order+1] = line
+        end
+end
+local chatty = el:add_exec ("echo status1; echo status2", note)
+local input = el:add_exec ("echo key", note, { priority = true })
+os.execute ("sleep 0.2")
+el:run_loop (1)
+-- el:service() takes what a program has without waiting
+local late = el:add_exec ("sleep 0.1; echo late", note)
+local early = el:service (late)
+os.execute ("sleep 0.2")
+local served = el:service (late)
+print (string.format ("    ** order %s, served %s then %s", table.concat (order, ","),
+        tostring(early), tostring(served)))
+
+io.stderr:write("---- failing callbacks\n")
+-- an error leaves the program usable, or freed if the callback killed it
+local failing
+failing = el:add_exec ("echo one; sleep 0.2; echo two", function (line)
+        if line == "two" then
+                el:kill_exec (failing)
+        end
+        if line then
+                error ("failed on " .. line)
+        end
+end)
+os.execute ("sleep 0.1")
+local ok1, err1 = pcall (el.service, el, failing)
+os.execute ("sleep 0.2")
+local ok2, err2 = pcall (el.service, el, failing)
+print (string.format ("    ** %s, then %s, then service=%s", tostring(err1),
+        tostring(err2), tostring(el:service (failing))))
+
+io.stderr:write("---- child accounting\n")
+-- each burns some cpu, then holds its own amount of memory for a while;
+-- our own peak is pushed up, so that one passed on to them would show
+local ballast = string.rep ("x", 100 * 1000000)
+for _, mb in ipairs ({ 10, 40 }) do
+        el:add_exec ("i=0; while [ $i -lt " .. mb * 5000 .. " ]; do i=$((i+1)); done; "
+                .. "x=$(head -c " .. mb * 1000000 .. " /dev/zero | tr '\\0' x); sleep 0.5",
+                function () end)
+end
+local function sized ()
+        local t, running = {}, false
+        for _, c in ipairs (el:children ()) do
+                local bytes = c.name:match ("head %-c (%d+)")
+                if bytes then
+                        t[#t+1] = c
+                        c.mb = bytes / 1000000
+                        running = running or c.running
+                end
+        end
+        return t, running
+end
+-- looking at them while they run is what tells their rss
+local stop = eventloop.now () + 5
+while select (2, sized ()) and eventloop.now () < stop do
+        el:run_loop (0.1)
+end
+local t = sized ()
+for _, c in ipairs (t) do
+        local rss = "holds it"
+        if c.rss * 1024 < c.mb * 1000000 or c.rss > (c.mb + 30) * 1024 then
+                rss = string.format ("%dk", c.rss)
+        end
+        print (string.format ("    ** %d MB: cpu %s, rss %s, status=%s", c.mb,
+                c.cpu > 0.05 and "used" or "none", rss, tostring(c.status)))
+end
+print ("    ** rss differs: " .. tostring(#t == 2 and t[1].rss ~= t[2].rss))
+ballast = nil
+
+io.stderr:write("---- children\n")
+for _, c in ipairs (el:children ()) do
+        print (string.format ("    ** %5d %-8s cpu=%.2fs rss=%dk status=%s  %s",
+                c.pid, c.running and "running" or "exited", c.cpu, c.rss,
+                tostring(c.status), c.name))
+end
+el:kill_all ()
 
 io.stderr:write("---- finished\n")
@@ -0,0 +1,57 @@
+#!/usr/bin/env lua
+
+-- ranks a large set of path-like candidates the way a menu would: the
+-- whole query at once, and one character at a time as it is typed, with
+-- and without the SSE2 scanner.
+
+require "fuzzy"
+
+local count = tonumber (arg[1]) or 50000
+local rounds = tonumber (arg[2]) or 20
+
+math.randomseed (42)
+local words = { "usr", "local", "bin", "share", "lib", "x11", "terminal",
+                "firefox", "config", "wmii", "lua", "plugins", "python3",
+                "gnome", "settings", "daemon", "helper", "view", "workdir" }
+local candidates = {}
+for i = 1, count do
+        local t = {}
+        for j = 1, math.random (2, 6) do
+                t[j] = words[math.random (#words)]
+        end
+        candidates[i] = table.concat (t, "/") .. i
+end
+
+local m = fuzzy.new (candidates)
+-- none extends the one before it, so whole queries are full scans
+local queries = { "wmlua", "usrbinfire", "xterm", "plgcfg", "q" }
+
+local function run (name, incremental)
+        local t = os.clock ()
+        local matched = 0
+        for r = 1, rounds do
+                for _, q in ipairs (queries) do
+                        if incremental then
+                                for k = 1, #q do
+                                        local _, n = m:match (q:sub (1, k), 20)
+                                        matched = matched + n
+                                end
+                        else
+                                local _, n = m:match (q, 20)
+                                matched = matched + n
+                        end
+                end
+        end
+        t = os.clock () - t
+        print (string.format ("  %-28s %8.3f ms/round, %d matched",
+                name, 1000 * t / rounds, matched / rounds))
+end
+
+print (string.format ("%d candidates, %d rounds", #m, rounds))
+for _, on in ipairs { true, false } do
+        local simd = fuzzy.simd (on)
+        local label = simd and "sse2" or "plain"
+        run (label .. " whole query", false)
+        run (label .. " typed a char at a time", true)
+end
+fuzzy.simd (true)
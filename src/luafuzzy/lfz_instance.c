@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lfz_debug.h"
+#include "lfz_instance.h"
+#include "lfz_match.h"
+
+#define LFZ_MAX_QUERY 256		// longer queries are cut short
+#define LFZ_WEIGHT_SCALE 16		// score points per unit of weight
+
+#define LFZ_ADD_FAILED ((unsigned)-1)
+
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+struct lfz_matcher *lfz_checkmatcher (lua_State *L, int narg)
+{
+	void *ud = luaL_checkudata (L, narg, L_FUZZY_MT);
+	luaL_argcheck (L, ud != NULL, narg, "`matcher' expected");
+	return (struct lfz_matcher*)ud;
+}
+
+struct lfz_matcher *lfz_matcher_new (lua_State *L)
+{
+	struct lfz_matcher *m;
+
+	m = (struct lfz_matcher*)lua_newuserdata (L, sizeof (*m));
+	memset (m, 0, sizeof (*m));
+
+	luaL_getmetatable (L, L_FUZZY_MT);
+	lua_setmetatable (L, -2);
+
+	return m;
+}
+
+static unsigned hash (const char *s, size_t len)
+{
+	unsigned h = 2166136261u;
+	size_t i;
+
+	for (i=0; i<len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h;
+}
+
+/* finds the index slot for the text; it holds 0 if the text is not there */
+static unsigned *index_slot (struct lfz_matcher *m, const char *s, size_t len)
+{
+	unsigned mask = m->index_size - 1;
+	unsigned i = hash (s, len) & mask;
+
+	for (;; i = (i + 1) & mask) {
+		struct lfz_entry *e;
+		if (!m->index[i])
+			return &m->index[i];
+		e = &m->entries[m->index[i] - 1];
+		if (e->len == len && !memcmp (m->orig + e->off, s, len))
+			return &m->index[i];
+	}
+}
+
+static int grow_index (struct lfz_matcher *m)
+{
+	unsigned size = m->index_size ? m->index_size * 2 : 64;
+	unsigned *old = m->index;
+	unsigned i;
+
+	m->index = calloc (size, sizeof (unsigned));
+	if (!m->index) {
+		m->index = old;
+		return -1;
+	}
+	m->index_size = size;
+
+	for (i=0; i<m->count; i++) {
+		struct lfz_entry *e = &m->entries[i];
+		*index_slot (m, m->orig + e->off, e->len) = i + 1;
+	}
+	free (old);
+	return 0;
+}
+
+/* makes room for need items of each bytes in every one of the arrays,
+ * which all hold *alloc items; they grow in step */
+static int grow (void **arrays[], const size_t each[], int narrays,
+		size_t *alloc, size_t need)
+{
+	size_t n = *alloc ? *alloc : 64;
+	int i;
+
+	if (need <= *alloc)
+		return 0;
+	while (n < need)
+		n *= 2;
+	for (i=0; i<narrays; i++) {
+		void *np = realloc (*arrays[i], n * each[i]);
+		if (!np)
+			return -1;
+		*arrays[i] = np;
+	}
+	*alloc = n;
+	return 0;
+}
+
+unsigned lfz_matcher_add (struct lfz_matcher *m, const char *s, size_t len,
+		double weight)
+{
+	struct lfz_entry *e;
+	unsigned *slot;
+
+	if (2 * (m->count + 1) > m->index_size && grow_index (m))
+		return LFZ_ADD_FAILED;
+
+	slot = index_slot (m, s, len);
+	if (*slot) {
+		e = &m->entries[*slot - 1];
+		if (weight > e->weight)
+			e->weight = weight;
+		return *slot - 1;
+	}
+
+	/* hits and scores need room for every entry */
+	{
+		void **arrays[] = { (void**)&m->entries, (void**)&m->hits,
+			(void**)&m->scores };
+		const size_t each[] = { sizeof (*e), sizeof (unsigned),
+			sizeof (int32_t) };
+		if (grow (arrays, each, 3, &m->alloc, m->count + 1))
+			return LFZ_ADD_FAILED;
+	}
+	{
+		void **arrays[] = { (void**)&m->orig, (void**)&m->lower };
+		const size_t each[] = { 1, 1 };
+		if (grow (arrays, each, 2, &m->text_size, m->text_len + len))
+			return LFZ_ADD_FAILED;
+	}
+
+	e = &m->entries[m->count];
+	e->off = m->text_len;
+	e->len = len;
+	e->weight = weight;
+	memcpy (m->orig + e->off, s, len);
+	lfz_lower (m->lower + e->off, s, len);
+	e->mask = lfz_charmask (m->lower + e->off, len);
+	m->text_len += len;
+
+	*slot = ++m->count;
+
+	// the last query's hits do not cover the new entry
+	m->have_last = 0;
+
+	return m->count - 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = m:add(string [, weight]) -- adds a candidate
+ *
+ * Adding a candidate that is already there keeps the larger weight.
+ * Returns the candidate's position, from 1.
+ */
+int l_fuzzy_add (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+	size_t len;
+	const char *s = luaL_checklstring (L, 2, &len);
+	double weight = luaL_optnumber (L, 3, 0);
+	unsigned n;
+
+	n = lfz_matcher_add (m, s, len, weight);
+	if (n == LFZ_ADD_FAILED)
+		return luaL_error (L, "fuzzy: out of memory");
+
+	lua_pushinteger (L, n + 1);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = m:count() -- number of candidates
+ */
+int l_fuzzy_count (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+
+	lua_pushinteger (L, m->count);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = m:weights(table) -- sets weights from a table
+ *
+ * For each string key of table that is a candidate, sets its weight to
+ * the number it maps to; other candidates keep theirs.  Returns how many
+ * were set.
+ */
+int l_fuzzy_weights (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+	unsigned set = 0;
+
+	luaL_checktype (L, 2, LUA_TTABLE);
+
+	if (!m->count) {
+		lua_pushinteger (L, 0);
+		return 1;
+	}
+
+	lua_pushnil (L);
+	while (lua_next (L, 2)) {
+		size_t len;
+		const char *s;
+		unsigned *slot;
+
+		if (lua_type (L, -2) != LUA_TSTRING
+				|| lua_type (L, -1) != LUA_TNUMBER) {
+			lua_pop (L, 1);
+			continue;
+		}
+
+		s = lua_tolstring (L, -2, &len);
+		slot = index_slot (m, s, len);
+		if (*slot) {
+			m->entries[*slot - 1].weight = lua_tonumber (L, -1);
+			set++;
+		}
+		lua_pop (L, 1);
+	}
+
+	lua_pushinteger (L, set);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: list, n = m:match(query [, limit]) -- ranks the candidates
+ *
+ * Returns an array of the candidates that contain the query's characters
+ * in order, ignoring case, best first, and how many matched in all; the
+ * array holds at most limit of them.  The rank is the match score plus
+ * the weight, so with an empty query candidates come by weight alone.
+ * Ties keep the order the candidates were added in.
+ *
+ * A query that extends the previous one only looks at what that one
+ * matched, so typing a character at a time stays cheap.
+ */
+struct ranked {
+	double rank;
+	unsigned n;
+};
+
+static int cmp_ranked (const void *a, const void *b)
+{
+	const struct ranked *x = a, *y = b;
+
+	if (x->rank != y->rank)
+		return x->rank > y->rank ? -1 : 1;
+	return x->n < y->n ? -1 : x->n > y->n;
+}
+
+int l_fuzzy_match (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+	size_t qlen;
+	const char *q = luaL_optlstring (L, 2, "", &qlen);
+	lua_Integer limit = luaL_optinteger (L, 3, 0);
+	char query[LFZ_MAX_QUERY];
+	uint64_t qmask;
+	struct ranked *order;
+	unsigned i, n, total, incremental;
+
+	if (qlen > sizeof (query))
+		qlen = sizeof (query);
+	lfz_lower (query, q, qlen);
+	qmask = lfz_charmask (query, qlen);
+
+	incremental = m->have_last && m->last_len <= qlen
+		&& !memcmp (m->last, query, m->last_len);
+
+	DBGF("** matcher:match (%.*s) %s of %u **\n", (int)qlen, query,
+			incremental ? "incremental" : "full", m->count);
+
+	/* hits is a subset of what it held before, so it can be filtered
+	 * in place */
+	n = 0;
+	total = incremental ? m->nhits : m->count;
+	for (i=0; i<total; i++) {
+		unsigned k = incremental ? m->hits[i] : i;
+		struct lfz_entry *e = &m->entries[k];
+		int32_t score;
+
+		if ((e->mask & qmask) != qmask)
+			continue;
+		score = lfz_score (query, qlen, m->lower + e->off,
+				m->orig + e->off, e->len);
+		if (score == LFZ_NO_MATCH)
+			continue;
+		m->hits[n] = k;
+		m->scores[n] = score;
+		n++;
+	}
+	m->nhits = n;
+
+	if (!m->last || m->last_len < qlen) {
+		char *last = realloc (m->last, qlen ? qlen : 1);
+		if (!last) {
+			m->have_last = 0;
+			return luaL_error (L, "fuzzy: out of memory");
+		}
+		m->last = last;
+	}
+	memcpy (m->last, query, qlen);
+	m->last_len = qlen;
+	m->have_last = 1;
+
+	order = malloc ((n ? n : 1) * sizeof (*order));
+	if (!order)
+		return luaL_error (L, "fuzzy: out of memory");
+	for (i=0; i<n; i++) {
+		order[i].n = m->hits[i];
+		order[i].rank = m->scores[i]
+			+ LFZ_WEIGHT_SCALE * m->entries[m->hits[i]].weight;
+	}
+	qsort (order, n, sizeof (*order), cmp_ranked);
+
+	if (limit <= 0 || (lua_Integer)n < limit)
+		limit = n;
+
+	lua_createtable (L, limit, 0);
+	for (i=0; i<(unsigned)limit; i++) {
+		struct lfz_entry *e = &m->entries[order[i].n];
+		lua_pushlstring (L, m->orig + e->off, e->len);
+		lua_rawseti (L, -2, i + 1);
+	}
+	free (order);
+
+	lua_pushinteger (L, n);
+	return 2;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: tostring(m), and the garbage collector
+ */
+int l_fuzzy_tostring (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+
+	lua_pushfstring (L, "fuzzy.matcher{%d candidates}", (int)m->count);
+	return 1;
+}
+
+int l_fuzzy_gc (lua_State *L)
+{
+	struct lfz_matcher *m = lfz_checkmatcher (L, 1);
+
+	DBGF("** matcher:__gc (%p) **\n", m);
+
+	free (m->orig);
+	free (m->lower);
+	free (m->entries);
+	free (m->index);
+	free (m->hits);
+	free (m->scores);
+	free (m->last);
+	memset (m, 0, sizeof (*m));
+	return 0;
+}
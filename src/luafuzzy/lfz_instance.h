@@ -0,0 +1,60 @@
+#ifndef __LUAFUZZY_INSTANCE_H__
+#define __LUAFUZZY_INSTANCE_H__
+
+#include <stdint.h>
+#include <lua.h>
+
+#define L_FUZZY_MT "fuzzy.matcher_mt"
+
+/* one candidate; its text lives in the matcher's text buffers */
+struct lfz_entry {
+	size_t off;			// into orig and lower
+	unsigned len;
+	uint64_t mask;			// lfz_charmask() of the text
+	double weight;			// frecency, added to the score
+};
+
+/* the C representation of a matcher instance object
+ *
+ * Candidates are kept in two flat buffers, as given and lowercased, so a
+ * match runs over contiguous memory.  hits holds the candidates that
+ * matched the last query; a query that extends it only rescans those. */
+struct lfz_matcher {
+	char *orig;
+	char *lower;
+	size_t text_len;
+	size_t text_size;
+
+	struct lfz_entry *entries;
+	unsigned count;
+	size_t alloc;
+
+	unsigned *index;		// open addressing, entry number + 1
+	unsigned index_size;		// power of two, at least twice count
+
+	unsigned *hits;			// entries matching last, by number
+	int32_t *scores;		// and their scores
+	unsigned nhits;
+
+	char *last;			// the last query, lowercased
+	size_t last_len;
+	int have_last;
+};
+
+extern struct lfz_matcher *lfz_checkmatcher (lua_State *L, int narg);
+extern struct lfz_matcher *lfz_matcher_new (lua_State *L);
+
+/* adds a candidate, or raises the weight of the one with the same text;
+ * returns its number, from 0 */
+extern unsigned lfz_matcher_add (struct lfz_matcher *m, const char *s,
+		size_t len, double weight);
+
+/* exported api */
+extern int l_fuzzy_tostring (lua_State *L);
+extern int l_fuzzy_gc (lua_State *L);
+extern int l_fuzzy_add (lua_State *L);
+extern int l_fuzzy_count (lua_State *L);
+extern int l_fuzzy_weights (lua_State *L);
+extern int l_fuzzy_match (lua_State *L);
+
+#endif // __LUAFUZZY_INSTANCE_H__
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lfz_debug.h"
+#include "lfz_instance.h"
+#include "lfz_match.h"
+
+
+/* ------------------------------------------------------------------------
+ * lua: m = fuzzy.new([candidates]) -- create a new matcher
+ *
+ *    candidates - an array of strings to start with
+ */
+static int l_new (lua_State *L)
+{
+	struct lfz_matcher *m;
+	int i, n;
+
+	DBGF("** fuzzy.new () **\n");
+
+	if (lua_isnoneornil (L, 1)) {
+		lfz_matcher_new (L);
+		return 1;
+	}
+
+	luaL_checktype (L, 1, LUA_TTABLE);
+	m = lfz_matcher_new (L);
+	n = lua_objlen (L, 1);
+	for (i = 1; i <= n; i++) {
+		size_t len;
+		const char *s;
+
+		lua_rawgeti (L, 1, i);
+		s = lua_tolstring (L, -1, &len);
+		if (!s)
+			return luaL_error (L, "fuzzy.new: candidate %d is not "
+					"a string", i);
+		if (lfz_matcher_add (m, s, len, 0) == (unsigned)-1)
+			return luaL_error (L, "fuzzy: out of memory");
+		lua_pop (L, 1);
+	}
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: score = fuzzy.score(query, string) -- score one candidate
+ *
+ * Returns nil if string does not contain the characters of query in order.
+ */
+static int l_score (lua_State *L)
+{
+	size_t qlen, len;
+	const char *q = luaL_checklstring (L, 1, &qlen);
+	const char *s = luaL_checklstring (L, 2, &len);
+	char *buf;
+	int32_t score;
+
+	buf = malloc (qlen + len + 1);
+	if (!buf)
+		return luaL_error (L, "fuzzy: out of memory");
+
+	lfz_lower (buf, q, qlen);
+	lfz_lower (buf + qlen, s, len);
+	score = lfz_score (buf, qlen, buf + qlen, s, len);
+	free (buf);
+
+	if (score == LFZ_NO_MATCH)
+		lua_pushnil (L);
+	else
+		lua_pushinteger (L, score);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: on = fuzzy.simd([enable]) -- query or pick the byte scanner
+ *
+ * Only there to compare the two in benchmarks; returns whether the SSE2
+ * scanner is used, which is false where it was not compiled in.
+ */
+static int l_simd (lua_State *L)
+{
+	static int on = -1;
+
+	if (on < 0)
+		on = lfz_use_simd (1);
+	if (!lua_isnoneornil (L, 1))
+		on = lfz_use_simd (lua_toboolean (L, 1));
+
+	lua_pushboolean (L, on);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * the class method table
+ */
+static const luaL_reg class_table[] =
+{
+	{ "new",		l_new },
+	{ "score",		l_score },
+	{ "simd",		l_simd },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the instance method table
+ */
+static const luaL_reg instance_table[] =
+{
+	{ "__tostring",		l_fuzzy_tostring },
+	{ "__len",		l_fuzzy_count },
+	{ "__gc",		l_fuzzy_gc },
+
+	{ "add",		l_fuzzy_add },
+	{ "count",		l_fuzzy_count },
+	{ "weights",		l_fuzzy_weights },
+	{ "match",		l_fuzzy_match },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the class metatable
+ */
+static int lfz_init_fuzzy_class (lua_State *L)
+{
+	luaL_newmetatable(L, L_FUZZY_MT);
+
+	// setup the __index and __gc field
+	lua_pushstring (L, "__index");
+	lua_pushvalue (L, -2);		// pushes the new metatable
+	lua_settable (L, -3);		// metatable.__index = metatable
+
+	luaL_openlib (L, NULL, instance_table, 0);
+
+	luaL_openlib (L, "fuzzy", class_table, 0);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * library entry
+ */
+LUALIB_API int luaopen_fuzzy (lua_State *L)
+{
+	return lfz_init_fuzzy_class (L);
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lfz_match.h"
+
+
+/* ------------------------------------------------------------------------
+ * byte scanners
+ */
+static const char *find_byte_plain (const char *p, const char *end,
+		unsigned char c)
+{
+	return end > p ? memchr (p, c, end - p) : NULL;
+}
+
+#ifdef __SSE2__
+/* compares 16 bytes at a time; candidates are short, so this mostly pays
+ * off on the long ones, and on skipping past the prefix of a path */
+static const char *find_byte_sse2 (const char *p, const char *end,
+		unsigned char c)
+{
+	__m128i needle = _mm_set1_epi8 ((char)c);
+
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128 ((const __m128i*)p);
+		int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, needle));
+		if (mask)
+			return p + __builtin_ctz (mask);
+		p += 16;
+	}
+	for (; p < end; p++)
+		if ((unsigned char)*p == c)
+			return p;
+	return NULL;
+}
+#endif
+
+#ifdef __SSE2__
+const char *(*lfz_find_byte) (const char *, const char *, unsigned char)
+	= find_byte_sse2;
+#else
+const char *(*lfz_find_byte) (const char *, const char *, unsigned char)
+	= find_byte_plain;
+#endif
+
+int lfz_use_simd (int enable)
+{
+#ifdef __SSE2__
+	lfz_find_byte = enable ? find_byte_sse2 : find_byte_plain;
+	return enable;
+#else
+	lfz_find_byte = find_byte_plain;
+	return 0;
+#endif
+}
+
+/* ------------------------------------------------------------------------
+ * prefilter
+ */
+static inline uint64_t char_bit (unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return 1ULL << (c - 'a');
+	if (c >= '0' && c <= '9')
+		return 1ULL << (26 + c - '0');
+	return 1ULL << (36 + c % 28);
+}
+
+uint64_t lfz_charmask (const char *lower, size_t len)
+{
+	uint64_t mask = 0;
+	size_t i;
+
+	for (i=0; i<len; i++)
+		mask |= char_bit ((unsigned char)lower[i]);
+	return mask;
+}
+
+void lfz_lower (char *dst, const char *src, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		unsigned char c = src[i];
+		dst[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * scoring
+ */
+static inline int is_boundary (const char *orig, size_t i)
+{
+	unsigned char prev, cur;
+
+	if (i == 0)
+		return 1;
+	prev = orig[i-1];
+	cur = orig[i];
+	if (strchr ("/-_. :", prev) && prev)
+		return 1;
+	return prev >= 'a' && prev <= 'z' && cur >= 'A' && cur <= 'Z';
+}
+
+int32_t lfz_score (const char *query, size_t qlen,
+		const char *lower, const char *orig, size_t len)
+{
+	const char *end = lower + len;
+	const char *p;
+	size_t qi, start = 0, last, pos;
+	int32_t score;
+
+	if (!qlen)
+		return 0;
+	if (qlen > len)
+		return LFZ_NO_MATCH;
+
+	/* the leftmost match ends as early as any can */
+	p = lower;
+	for (qi=0; qi<qlen; qi++) {
+		p = lfz_find_byte (p, end, query[qi]);
+		if (!p)
+			return LFZ_NO_MATCH;
+		p++;
+	}
+	last = p - 1 - lower;
+
+	/* walk back from there for the tightest window ending at it */
+	pos = last;
+	for (qi=qlen; qi-- > 0; ) {
+		while (lower[pos] != query[qi])
+			pos--;
+		start = pos;
+		if (qi)
+			pos--;
+	}
+
+	/* and score the greedy match inside the window */
+	score = 0;
+	last = start;
+	pos = start;
+	for (qi=0; qi<qlen; qi++, pos++) {
+		while (lower[pos] != query[qi])
+			pos++;
+
+		score += LFZ_SCORE_MATCH;
+		if (pos == 0)
+			score += LFZ_BONUS_FIRST;
+		if (is_boundary (orig, pos))
+			score += LFZ_BONUS_BOUNDARY;
+		if (qi && pos == last + 1)
+			score += LFZ_BONUS_CONSECUTIVE;
+		else if (qi)
+			score -= LFZ_PENALTY_GAP_START
+				+ (pos - last - 2) * LFZ_PENALTY_GAP;
+		last = pos;
+	}
+
+	/* prefer matches near the front, and shorter candidates */
+	score -= (start < 8 ? start : 8) * LFZ_PENALTY_GAP;
+	score -= len >> 4;
+
+	return score;
+}
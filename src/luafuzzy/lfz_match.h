@@ -0,0 +1,38 @@
+#ifndef __LUAFUZZY_MATCH_H__
+#define __LUAFUZZY_MATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LFZ_NO_MATCH INT32_MIN
+
+/* score of a matched character, and the bonuses on top of it */
+#define LFZ_SCORE_MATCH 16
+#define LFZ_BONUS_CONSECUTIVE 12	// right after the previous match
+#define LFZ_BONUS_BOUNDARY 8		// starts a word: after / - _ . space, or camelCase
+#define LFZ_BONUS_FIRST 8		// the candidate's first character
+#define LFZ_PENALTY_GAP_START 3		// first skipped character of a gap
+#define LFZ_PENALTY_GAP 1		// every further one
+
+/* a bit for each letter and digit, and a few shared ones for the rest; a
+ * candidate can only match if it has all of the query's bits */
+extern uint64_t lfz_charmask (const char *lower, size_t len);
+
+/* lowercases ascii; other bytes are copied as they are */
+extern void lfz_lower (char *dst, const char *src, size_t len);
+
+/* scores query, which has to be lowercase, as a subsequence of the
+ * candidate; lower is the lowercased candidate, orig the candidate itself
+ * (for camelCase).  Returns LFZ_NO_MATCH if it is not one. */
+extern int32_t lfz_score (const char *query, size_t qlen,
+		const char *lower, const char *orig, size_t len);
+
+/* finds c in [p, end), with SSE2 where the compiler has it; returns NULL
+ * if it is not there */
+extern const char *(*lfz_find_byte) (const char *p, const char *end,
+		unsigned char c);
+
+/* picks the SSE2 or the plain scanner; returns whether SSE2 is used */
+extern int lfz_use_simd (int enable);
+
+#endif // __LUAFUZZY_MATCH_H__
@@ -0,0 +1,44 @@
+#!/usr/bin/env lua
+
+require "fuzzy"
+
+local function show (list, n)
+        return table.concat (list, " ") .. "  (" .. tostring(n) .. ")"
+end
+
+print ("scoring...")
+for _, p in ipairs { { "ff", "firefox" }, { "ff", "xfontsel" },
+                     { "vw", "ViewWorkdir" }, { "vw", "previews" },
+                     { "fox", "firefox" }, { "xf", "firefox" } } do
+        print (string.format ("  %-4s %-12s %s", p[1], p[2],
+                tostring (fuzzy.score (p[1], p[2]))))
+end
+
+print ("matching...")
+local m = fuzzy.new { "firefox", "xfontsel", "xterm", "gimp", "mutt", "xfce4-terminal" }
+print ("  " .. tostring(m) .. ", #m = " .. #m)
+print ("  ''     " .. show (m:match ("")))
+print ("  x      " .. show (m:match ("x")))
+print ("  xt     " .. show (m:match ("xt")))
+print ("  xte    " .. show (m:match ("xte")))
+print ("  XTE    " .. show (m:match ("XTE")))
+print ("  f, 2   " .. show (m:match ("f", 2)))
+print ("  zz     " .. show (m:match ("zz")))
+
+print ("weights...")
+print ("  set " .. m:weights { gimp = 3, mutt = 1, nothing = 5 })
+print ("  ''     " .. show (m:match ("")))
+print ("  add xterm again, weight 2 -> " .. m:add ("xterm", 2) .. ", #m = " .. #m)
+print ("  ''     " .. show (m:match ("")))
+print ("  add vim -> " .. m:add ("vim"))
+print ("  empty: " .. tostring (fuzzy.new ()) .. ", " .. show (fuzzy.new ():match ("x")))
+print ("  m      " .. show (m:match ("m")))
+
+print ("scanner...")
+local long = string.rep ("abcdefghijklmnop", 8) .. "q"
+for _, on in ipairs { true, false } do
+        fuzzy.simd (on)
+        print (string.format ("  simd %-5s %s %s", tostring (fuzzy.simd ()),
+                tostring (fuzzy.score ("aq", long)), tostring (fuzzy.score ("qa", long))))
+end
+fuzzy.simd (true)
@@ -0,0 +1,93 @@
+#!/usr/bin/env lua
+
+-- reads the same wmii files over and over, and shows how many times the
+-- read buffers had to be allocated; in steady state it should be none.
+-- Then reads them and lists the root directory over connections with
+-- different message sizes, counting the 9P requests each pass makes.
+
+require "ixp"
+
+local address = arg[1] or os.getenv ("WMII_ADDRESS")
+if not address then
+        io.stderr:write ("usage: " .. arg[0] .. " <ixp address>\n")
+        os.exit (1)
+end
+
+local x = assert (ixp.new (address))
+local files = { "/ctl", "/colrules", "/tagrules", "/lbar" }
+local rounds = tonumber (arg[2]) or 10000
+
+local function run (name, read)
+        local before = x:stats ()
+        local t = os.clock ()
+        for i = 1, rounds do
+                for _, f in ipairs (files) do
+                        read (f)
+                end
+        end
+        t = os.clock () - t
+        local after = x:stats ()
+        local reads = after.reads - before.reads
+        print (string.format ("%-12s %7d reads %8.1f us/read %7.1f kB/s  %d allocs (%.3f per read)",
+                name, reads, t * 1e6 / reads,
+                (after.bytes - before.bytes) / 1024 / t,
+                after.allocs - before.allocs,
+                (after.allocs - before.allocs) / reads))
+end
+
+-- warm up, so the buffers have grown to fit
+local buf = ixp.buffer ()
+for _, f in ipairs (files) do
+        x:read (f)
+        x:read_into (f, buf)
+end
+
+run ("read", function (f) return x:read (f) end)
+run ("read_into", function (f) return x:read_into (f, buf) end)
+
+-- through core/fastpath.lua, which under LuaJIT calls the plain C
+-- functions with the FFI and otherwise the methods used above
+package.path = "../core/?.lua;" .. package.path
+package.cpath = "../luaeventloop/?.so;" .. package.cpath
+require "compat"
+local fastpath = require "fastpath"
+local via = fastpath.enabled and "ffi" or "api"
+run ("fastpath " .. via, function (f) return fastpath.read (x, f) end)
+
+-- writes /ctl the border it already has, which changes nothing
+local function run_write (name, write)
+        local line = "border " .. (x:read ("/ctl"):match ("border (%d+)") or "1")
+        local t = os.clock ()
+        for i = 1, rounds do
+                write ("/ctl", line)
+        end
+        t = os.clock () - t
+        print (string.format ("%-12s %7d writes %7.1f us/write", name,
+                rounds, t * 1e6 / rounds))
+end
+
+run_write ("write", function (f, data) return x:write (f, data) end)
+run_write ("fastpath " .. via, function (f, data) return fastpath.write (x, f, data) end)
+run_write ("cached " .. via, function (f, data) return fastpath.write_ctl (x, f, data) end)
+
+print ()
+for _, msize in ipairs { 256, 1024, 4096, 8192, 65536 } do
+        local c = assert (ixp.new (address, { msize = msize, nodelay = true }))
+        local before = c:stats ()
+        local entries = 0
+        local passes = math.max (1, math.floor (rounds / 100))
+        local t = os.clock ()
+        for i = 1, passes do
+                for _, f in ipairs (files) do
+                        c:read (f)
+                end
+                for e in c:idir ("/") do
+                        entries = entries + 1
+                end
+        end
+        t = os.clock () - t
+        local after = c:stats ()
+        print (string.format ("msize %5d (got %5d) %6.1f requests/pass %8.1f us/pass  %d kB read, %d entries",
+                msize, after.msize, (after.rpcs - before.rpcs) / passes,
+                t * 1e6 / passes, (after.bytes - before.bytes) / 1024, entries))
+end
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lixp_debug.h"
+#include "lixp_util.h"
+#include "lixp_buffer.h"
+
+
+struct lixp_buffer *lixp_checkbuffer (lua_State *L, int narg)
+{
+	void *ud = luaL_checkudata (L, narg, L_IXP_BUFFER_MT);
+	luaL_argcheck (L, ud != NULL, narg, "`ixp.buffer' expected");
+	return (struct lixp_buffer*)ud;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: buf = ixp.buffer([size [, max]])
+ *
+ *    size - bytes to allocate up front; reads grow it as needed
+ *    max  - reads into this buffer stop at max bytes (no limit by default)
+ */
+int l_ixp_buffer_new (lua_State *L)
+{
+	struct lixp_buffer *b;
+	lua_Number size, max;
+
+	size = luaL_optnumber (L, 1, 0);
+	max = luaL_optnumber (L, 2, 0);
+	luaL_argcheck (L, size >= 0, 1, "size must not be negative");
+	luaL_argcheck (L, max >= 0, 2, "max must not be negative");
+
+	b = (struct lixp_buffer*)lua_newuserdata (L, sizeof (*b));
+	memset (b, 0, sizeof (*b));
+	b->max = max;
+
+	luaL_getmetatable (L, L_IXP_BUFFER_MT);
+	lua_setmetatable (L, -2);
+
+	if (size) {
+		b->data = malloc (size);
+		if (!b->data)
+			return lixp_pusherror (L, "count not allocate memory");
+		b->size = size;
+	}
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: s = buf:data() -- the bytes last read, as a string
+ */
+static int buffer_data (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	lua_pushlstring (L, b->data ? b->data : "", b->len);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: s = buf:sub(i [, j]) -- like string.sub(buf:data(), i, j), without
+ *      copying the rest of the buffer
+ */
+static int buffer_sub (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+	long len = b->len;
+	long i = luaL_checkinteger (L, 2);
+	long j = luaL_optinteger (L, 3, -1);
+
+	if (i < 0) i += len + 1;
+	if (j < 0) j += len + 1;
+	if (i < 1) i = 1;
+	if (j > len) j = len;
+
+	if (i > j)
+		lua_pushliteral (L, "");
+	else
+		lua_pushlstring (L, b->data + i - 1, j - i + 1);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = buf:len()   -- bytes last read
+ *      n = buf:size()  -- bytes allocated
+ */
+static int buffer_len (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	lua_pushnumber (L, b->len);
+	return 1;
+}
+
+static int buffer_size (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	lua_pushnumber (L, b->size);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: buf:clear([release]) -- empties the buffer, and frees its memory if
+ *      release is true
+ */
+static int buffer_clear (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	b->len = 0;
+	if (lua_toboolean (L, 2)) {
+		free (b->data);
+		b->data = NULL;
+		b->size = 0;
+	}
+	return 0;
+}
+
+static int buffer_tostring (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	lua_pushfstring (L, "ixp.buffer{%d/%d}", (int)b->len, (int)b->size);
+	return 1;
+}
+
+static int buffer_gc (lua_State *L)
+{
+	struct lixp_buffer *b = lixp_checkbuffer (L, 1);
+
+	DBGF("** ixp.buffer - gc **\n");
+
+	free (b->data);
+	b->data = NULL;
+	return 0;
+}
+
+static const luaL_reg buffer_table[] =
+{
+	{ "__tostring",		buffer_tostring },
+	{ "__gc",		buffer_gc },
+
+	{ "data",		buffer_data },
+	{ "sub",		buffer_sub },
+	{ "len",		buffer_len },
+	{ "size",		buffer_size },
+	{ "clear",		buffer_clear },
+
+	{ NULL,			NULL },
+};
+
+void lixp_init_buffer_mt (lua_State *L)
+{
+	luaL_newmetatable(L, L_IXP_BUFFER_MT);
+
+	lua_pushstring (L, "__index");
+	lua_pushvalue (L, -2);
+	lua_settable (L, -3);
+
+	luaL_openlib (L, NULL, buffer_table, 0);
+	lua_pop (L, 1);
+}
@@ -0,0 +1,22 @@
+#ifndef __LUAIXP_BUFFER_H__
+#define __LUAIXP_BUFFER_H__
+
+#include <lua.h>
+
+#define L_IXP_BUFFER_MT "ixp.buffer_mt"
+
+/* a reusable byte buffer, filled by ixp:read_into() and parsed in C or lua */
+struct lixp_buffer {
+	char *data;
+	size_t size;			// allocated
+	size_t len;			// used
+	size_t max;			// not grown beyond this by reads, 0 for no limit
+};
+
+extern struct lixp_buffer *lixp_checkbuffer (lua_State *L, int narg);
+extern void lixp_init_buffer_mt (lua_State *L);
+
+/* exported api */
+extern int l_ixp_buffer_new (lua_State *L);
+
+#endif // __LUAIXP_BUFFER_H__
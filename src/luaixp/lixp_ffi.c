@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <ixp.h>
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lixp_debug.h"
+#include "lixp_util.h"
+#include "lixp_instance.h"
+#include "lixp_ffi.h"
+
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+static char ffi_error[256];
+
+/* remembers what went wrong, as lixp_pusherror() would put it */
+static int set_error (const char *info)
+{
+	if (errno)
+		snprintf (ffi_error, sizeof (ffi_error), "%s; %s",
+				strerror (errno), info);
+	else
+		snprintf (ffi_error, sizeof (ffi_error), "%s", info);
+	return -1;
+}
+
+static void fid_drop (struct lixp_cached_fid *c)
+{
+	if (c->fid)
+		ixp_close (c->fid);
+	free (c->file);
+	c->fid = NULL;
+	c->file = NULL;
+}
+
+/* the cached fid of file, opened if it is not there yet */
+static struct lixp_cached_fid *fid_lookup (struct ixp *ixp, const char *file)
+{
+	struct lixp_cached_fid *c;
+	IxpCFid *fid;
+	char *name;
+	int i;
+
+	for (i=0; i<LIXP_FID_CACHE_SIZE; i++)
+		if (ixp->fids[i].fid && !strcmp (ixp->fids[i].file, file))
+			return &ixp->fids[i];
+
+	fid = ixp_open (ixp->client, file, P9_OWRITE);
+	if (!fid)
+		return NULL;
+
+	name = strdup (file);
+	if (!name) {
+		ixp_close (fid);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	c = &ixp->fids[ixp->fid_next++ % LIXP_FID_CACHE_SIZE];
+	fid_drop (c);
+	c->fid = fid;
+	c->file = name;
+	return c;
+}
+
+void lixp_ffi_free (struct ixp *ixp)
+{
+	int i;
+
+	for (i=0; i<LIXP_FID_CACHE_SIZE; i++)
+		fid_drop (&ixp->fids[i]);
+}
+
+/* ------------------------------------------------------------------------
+ * the functions
+ */
+
+/* as write(file, data) */
+static int ffi_write (void *_ixp, const char *file, const char *data,
+		size_t len)
+{
+	struct ixp *ixp = _ixp;
+	IxpCFid *fid;
+	int rc;
+
+	DBGF("** ixp ffi write (%s) **\n", file);
+
+	errno = 0;
+	fid = ixp_open (ixp->client, file, P9_OWRITE);
+	if (!fid)
+		return set_error ("could not open p9 file");
+
+	rc = lixp_pwrite_data (fid, data, len, 0);
+	ixp_close (fid);
+	if (rc < 0)
+		return set_error ("failed to write to p9 file");
+	return 0;
+}
+
+/* as write(), but the fid is kept open for the next write, which saves the
+ * walk, open and clunk.  That only suits files the server acts on as each
+ * write comes in: wmii takes the new contents of bar and rules files when
+ * the fid is clunked, and queues events for every fid open on /event. */
+static int ffi_write_cached (void *_ixp, const char *file, const char *data,
+		size_t len)
+{
+	struct ixp *ixp = _ixp;
+	struct lixp_cached_fid *c;
+	int tries;
+
+	DBGF("** ixp ffi write_cached (%s) **\n", file);
+
+	errno = 0;
+	for (tries=0; tries<2; tries++) {
+		c = fid_lookup (ixp, file);
+		if (!c)
+			return set_error ("could not open p9 file");
+
+		if (lixp_pwrite_data (c->fid, data, len, 0) >= 0)
+			return 0;
+
+		// the file may have gone away under the fid; a new one will
+		// tell
+		fid_drop (c);
+	}
+	return set_error ("failed to write to p9 file");
+}
+
+/* as read(file, size), into buf; returns the length read */
+static long ffi_read (void *_ixp, const char *file, char *buf, size_t size,
+		int *short_read)
+{
+	struct ixp *ixp = _ixp;
+	IxpCFid *fid;
+	size_t got = 0;
+
+	DBGF("** ixp ffi read (%s) **\n", file);
+
+	errno = 0;
+	fid = ixp_open (ixp->client, file, P9_OREAD);
+	ixp->rpcs += LIXP_RPCS_OPEN + LIXP_RPCS_CLOSE;
+	if (!fid)
+		return set_error ("could not open p9 file");
+
+	*short_read = 1;
+	while (got < size) {
+		long rc = ixp_read (fid, buf + got, size - got);
+		ixp->rpcs ++;
+		if (rc < 0) {
+			ixp_close (fid);
+			return set_error ("failed to read from p9 file");
+		}
+		if (!rc) {
+			*short_read = 0;
+			break;
+		}
+		got += rc;
+	}
+
+	ixp_close (fid);
+
+	ixp->reads ++;
+	ixp->read_bytes += got;
+	return got;
+}
+
+static const char *ffi_last_error (void)
+{
+	return ffi_error;
+}
+
+static const struct lixp_ffi_api ffi_api = {
+	.version	= LIXP_FFI_VERSION,
+	.write		= ffi_write,
+	.write_cached	= ffi_write_cached,
+	.read		= ffi_read,
+	.error		= ffi_last_error,
+};
+
+/* ------------------------------------------------------------------------
+ * lua: api = ixp.ffi_api() -- the plain C functions, as a pointer
+ *
+ * To be cast to a struct lixp_ffi_api pointer with LuaJIT's ffi.cast().
+ */
+int l_ixp_ffi_api (lua_State *L)
+{
+	lua_pushlightuserdata (L, (void*)&ffi_api);
+	return 1;
+}
@@ -0,0 +1,38 @@
+#ifndef __LUAIXP_FFI_H__
+#define __LUAIXP_FFI_H__
+
+#include <stddef.h>
+#include <lua.h>
+
+struct ixp;
+
+/* The hot calls as plain C functions, for LuaJIT's FFI to call from
+ * compiled code; through the lua_State API every call ends the trace.
+ * ixp.ffi_api() hands out a pointer to this table, so nothing has to be
+ * looked up with dlsym() in a module loaded RTLD_LOCAL.  The ixp argument
+ * is the userdata itself, which the FFI passes as a pointer to its
+ * contents.  core/fastpath.lua declares the same struct; bump the version
+ * when it changes.
+ *
+ * The functions return -1 on failure, and error() describes the last one.
+ */
+#define LIXP_FFI_VERSION 1
+
+struct lixp_ffi_api {
+	int version;
+	int (*write) (void *ixp, const char *file, const char *data,
+			size_t len);
+	int (*write_cached) (void *ixp, const char *file, const char *data,
+			size_t len);
+	long (*read) (void *ixp, const char *file, char *buf, size_t size,
+			int *short_read);
+	const char *(*error) (void);
+};
+
+/* closes the fids write_cached() kept open */
+extern void lixp_ffi_free (struct ixp *ixp);
+
+/* exported api */
+extern int l_ixp_ffi_api (lua_State *L);
+
+#endif // __LUAIXP_FFI_H__
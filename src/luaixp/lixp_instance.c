@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -10,9 +11,12 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "lcompat.h"
 #include "lixp_debug.h"
 #include "lixp_util.h"
 #include "lixp_instance.h"
+#include "lixp_buffer.h"
+#include "lscan.h"
 
 
 /* ------------------------------------------------------------------------
@@ -35,33 +39,73 @@ int l_ixp_tostring (lua_State *L)
 
 static int nil_iter (lua_State *L)
 {
+	(void)L;
 	return 0;
 }
 
 /* ------------------------------------------------------------------------
- * lua: write(file, data) -- writes data to a file 
+ * lua: write(file, data [, sep]) -- returns nothing on success
+ *
+ *    data - a string, or an array of strings that are written joined by
+ *           sep, without joining them in lua first
  */
 
+static void check_data (lua_State *L, int idx)
+{
+	int i, n;
+
+	if (lua_type (L, idx) != LUA_TTABLE) {
+		luaL_checkstring (L, idx);
+		return;
+	}
+
+	n = lua_objlen (L, idx);
+	for (i=1; i<=n; i++) {
+		lua_rawgeti (L, idx, i);
+		if (!lua_isstring (L, -1))
+			luaL_error (L, "chunk %d is not a string", i);
+		lua_pop (L, 1);
+	}
+}
+
+/* writes the string or chunk table at idx, at offset */
+static int write_data (lua_State *L, IxpCFid *fid, int idx,
+		const char *sep, size_t sep_len, long long offset)
+{
+	const char *data;
+	size_t data_len;
+
+	if (lua_type (L, idx) == LUA_TTABLE)
+		return lixp_write_chunks (L, fid, idx, sep, sep_len, offset);
+
+	data = lua_tolstring (L, idx, &data_len);
+
+	DBGF("** ixp.write (%s) **\n", data);
+
+	return lixp_pwrite_data (fid, data, data_len, offset);
+}
+
 int l_ixp_write (lua_State *L)
 {
 	struct ixp *ixp;
 	IxpCFid *fid;
 	const char *file;
-	const char *data;
-	size_t data_len;
+	const char *sep;
+	size_t sep_len = 0;
 	int rc;
 
 	ixp = lixp_checkixp (L, 1);
 	file = luaL_checkstring (L, 2);
-	data = luaL_checklstring (L, 3, &data_len);
+	check_data (L, 3);
+	sep = luaL_optlstring (L, 4, "", &sep_len);
 
 	fid = ixp_open(ixp->client, file, P9_OWRITE);
 	if(fid == NULL)
 		return lixp_pusherror (L, "count not open p9 file");
 
-	DBGF("** ixp.write (%s,%s) **\n", file, data);
+	DBGF("** ixp.write (%s) **\n", file);
 	
-	rc = lixp_write_data (fid, data, data_len);
+	rc = write_data (L, fid, 3, sep, sep_len, 0);
 	if (rc < 0) {
 		ixp_close(fid);
 		return lixp_pusherror (L, "failed to write to p9 file");
@@ -71,6 +115,100 @@ int l_ixp_write (lua_State *L)
 	return 0;
 }
 
+/* ------------------------------------------------------------------------
+ * lua: pwrite(file, offset, data [, sep]) -- returns nothing on success
+ *
+ *    data - a string, or an array of strings as for write()
+ */
+int l_ixp_pwrite (lua_State *L)
+{
+	struct ixp *ixp;
+	IxpCFid *fid;
+	const char *file;
+	const char *sep;
+	size_t sep_len = 0;
+	lua_Number offset;
+	int rc;
+
+	ixp = lixp_checkixp (L, 1);
+	file = luaL_checkstring (L, 2);
+	offset = luaL_checknumber (L, 3);
+	luaL_argcheck (L, offset >= 0, 3, "offset must not be negative");
+	check_data (L, 4);
+	sep = luaL_optlstring (L, 5, "", &sep_len);
+
+	fid = ixp_open(ixp->client, file, P9_OWRITE);
+	if(fid == NULL)
+		return lixp_pusherror (L, "count not open p9 file");
+
+	DBGF("** ixp.pwrite (%s, %.0f) **\n", file, offset);
+
+	rc = write_data (L, fid, 4, sep, sep_len, (long long)offset);
+	if (rc < 0) {
+		ixp_close(fid);
+		return lixp_pusherror (L, "failed to write to p9 file");
+	}
+
+	ixp_close(fid);
+	return 0;
+}
+
+static long read_to (lua_State *L, struct ixp *ixp, const char *file,
+		char **bufp, size_t *sizep, size_t max, long long offset,
+		int *short_read);
+static void scratch_trim (struct ixp *ixp);
+
+/* ------------------------------------------------------------------------
+ * lua: data = pread(file, offset [, len])
+ *
+ *    data - up to len bytes (IXP_READ_MAX_BUFFER_SIZE by default) from
+ *           offset; shorter at the end of the file
+ */
+int l_ixp_pread (lua_State *L)
+{
+	struct ixp *ixp;
+	const char *file;
+	lua_Number offset, len;
+	long got;
+	int short_read, top;
+
+	ixp = lixp_checkixp (L, 1);
+	file = luaL_checkstring (L, 2);
+	offset = luaL_checknumber (L, 3);
+	len = luaL_optnumber (L, 4, IXP_READ_MAX_BUFFER_SIZE);
+	luaL_argcheck (L, offset >= 0, 3, "offset must not be negative");
+	luaL_argcheck (L, len >= 0, 4, "length must not be negative");
+
+	DBGF("** ixp.pread (%s, %.0f, %.0f) **\n", file, offset, len);
+
+	top = lua_gettop (L);
+	if (!len) {
+		// read_to() takes a zero max as no limit; still tell a
+		// missing file
+		IxpCFid *fid = ixp_open(ixp->client, file, P9_OREAD);
+		ixp->rpcs += LIXP_RPCS_OPEN + LIXP_RPCS_CLOSE;
+		if(fid == NULL) {
+			lixp_pusherror (L, "count not open p9 file");
+			lua_settop (L, top + 2);
+			return 2;
+		}
+		ixp_close(fid);
+		lua_pushliteral (L, "");
+		return 1;
+	}
+
+	got = read_to (L, ixp, file, &ixp->scratch, &ixp->scratch_size,
+			(size_t)len, (long long)offset, &short_read);
+	if (got < 0) {
+		lua_settop (L, top + 2);
+		return 2;
+	}
+
+	lua_pushlstring (L, ixp->scratch, got);
+	scratch_trim (ixp);
+	return 1;
+}
+
 /* ------------------------------------------------------------------------
  * lua: data [,short_read]  = read(file, [max_buffer_size])
  *      -- returns contents of file
@@ -85,87 +223,431 @@ int l_ixp_write (lua_State *L)
  * If the file contents are expected to be large use l_ixp_iread(), which
  * iterates over the file.
  */
+static int read_file (lua_State *L, struct ixp *ixp, const char *file,
+		lua_Number max_buffer_size);
+
 int l_ixp_read (lua_State *L)
 {
 	struct ixp *ixp;
-	IxpCFid *fid;
 	const char *file;
-	char *buf, *_buf;
-	size_t buf_ofs, buf_size;
 	lua_Number max_buffer_size;
-	size_t realloc_size;
-	int short_read = 1;
 
 	ixp = lixp_checkixp (L, 1);
 	file = luaL_checkstring (L, 2);
 	max_buffer_size = luaL_optnumber (L, 3, IXP_READ_MAX_BUFFER_SIZE);
 
-	fid = ixp_open(ixp->client, file, P9_OREAD);
-	if(fid == NULL)
-		return lixp_pusherror (L, "count not open p9 file");
+	return read_file (L, ixp, file, max_buffer_size);
+}
 
-	buf_size = fid->iounit;
-	if (max_buffer_size && buf_size > max_buffer_size)
-		buf_size = max_buffer_size;
-	buf = malloc (buf_size);
-	if (!buf) {
-		ixp_close(fid);
-		return lixp_pusherror (L, "count not allocate memory");
+/* reads file from offset into *bufp, growing it (and *sizep) as needed but
+ * not beyond max, unless max is zero; the buffer is kept for the next read, so once it
+ * has grown to fit, reading costs no allocations.  Returns the number of
+ * bytes read, or -1 with an error message pushed. */
+static long read_to (lua_State *L, struct ixp *ixp, const char *file,
+		char **bufp, size_t *sizep, size_t max, long long offset,
+		int *short_read)
+{
+	IxpCFid *fid;
+	char *buf = *bufp;
+	size_t buf_ofs = 0, buf_size = *sizep;
+	size_t iounit, want;
+
+	fid = ixp_open(ixp->client, file, P9_OREAD);
+	ixp->rpcs += LIXP_RPCS_OPEN + LIXP_RPCS_CLOSE;
+	if(fid == NULL) {
+		lixp_pusherror (L, "count not open p9 file");
+		return -1;
 	}
-	buf_ofs = 0;
 
 	DBGF("** ixp.read (%s) **\n", file);
-	
+
+	iounit = fid->iounit ? fid->iounit : IXP_CHUNK_BUFFER_SIZE;
+	*short_read = 1;
 	for (;;) {
-		int rc = ixp_read (fid, buf+buf_ofs, buf_size-buf_ofs);
+		int rc;
+
+		/* make room for at least one more message */
+		want = buf_ofs + iounit;
+		if (max && want > max)
+			want = max;
+		if (want > buf_size) {
+			size_t realloc_size = buf_size ? buf_size : iounit;
+			char *_buf;
+
+			while (realloc_size < want)
+				realloc_size *= 2;
+			if (max && realloc_size > max)
+				realloc_size = max;
+
+			_buf = realloc (buf, realloc_size);
+			if (!_buf) {
+				ixp_close(fid);
+				lixp_pusherrorf(L, "failed to allocate %d bytes",
+						(int)realloc_size);
+				return -1;
+			}
+			*bufp = buf = _buf;
+			*sizep = buf_size = realloc_size;
+			ixp->allocs ++;
+		}
+
+		if (buf_ofs == want)
+			break;		/* hit max */
+
+		rc = ixp_pread (fid, buf+buf_ofs, want-buf_ofs,
+				offset + buf_ofs);
+		ixp->rpcs ++;
 		if (rc==0) {
-			short_read = 0;
+			*short_read = 0;
 			break;
 
 		} else if (rc<0) {
 			ixp_close(fid);
-			return lixp_pusherror (L, "failed to read from p9 file");
+			lixp_pusherror (L, "failed to read from p9 file");
+			return -1;
 		}
 
 		buf_ofs += rc;
+	}
 
-		if (buf_ofs > buf_size)
-			return lixp_pusherror (L, "internal error while reading");
+	ixp_close(fid);
 
-		if (buf_ofs == buf_size)
-			break;
+	ixp->reads ++;
+	ixp->read_bytes += buf_ofs;
 
-		if (max_buffer_size && buf_size >= max_buffer_size)
-			break;
+#ifdef DBG
+	if (memchr(buf, '\0', buf_ofs))
+		fprintf(stderr, "** WARNING: ixp.read (%s): result contains null characters **\n", file);
+#endif
 
-		realloc_size = max_buffer_size;
-		if (!max_buffer_size)
-			realloc_size = buf_size * 2;
+	return buf_ofs;
+}
 
-		_buf = NULL;
-		if (realloc_size > buf_size)
-			_buf = realloc (buf, realloc_size);
+/* pushes data and short_read, or nil and an error message; reads go
+ * through the connection's scratch buffer, so the only copy made is the
+ * lua string itself */
+static int read_file (lua_State *L, struct ixp *ixp, const char *file,
+		lua_Number max_buffer_size)
+{
+	long len;
+	int short_read;
+	int top = lua_gettop (L);
+
+	len = read_to (L, ixp, file, &ixp->scratch, &ixp->scratch_size,
+			(size_t)max_buffer_size, 0, &short_read);
+	if (len < 0) {
+		// just nil and the message, without the errno
+		lua_settop (L, top + 2);
+		return 2;
+	}
 
-		if (!_buf) {
-			ixp_close(fid);
-			free(buf);
-			return lixp_pusherrorf(L, "failed to allocate %u bytes",
-					realloc_size);
+	lua_pushlstring(L, ixp->scratch, len);
+	lua_pushboolean(L, short_read);
+	scratch_trim (ixp);
+	return 2;
+}
+
+/* don't hold on to a buffer grown for one unusually large file */
+static void scratch_trim (struct ixp *ixp)
+{
+	if (ixp->scratch_size > IXP_SCRATCH_KEEP_SIZE) {
+		free (ixp->scratch);
+		ixp->scratch = NULL;
+		ixp->scratch_size = 0;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * lua: len, short_read = read_into(file, buffer [, max_size])
+ *
+ * Like read(), but leaves the data in buffer, an ixp.buffer(), instead of
+ * returning a string.  The buffer keeps its memory between reads, so a
+ * buffer reused for the same files does not allocate at all; max_size
+ * defaults to the buffer's own limit.
+ */
+int l_ixp_read_into (lua_State *L)
+{
+	struct ixp *ixp;
+	struct lixp_buffer *b;
+	const char *file;
+	size_t max;
+	long len;
+	int short_read, top;
+
+	ixp = lixp_checkixp (L, 1);
+	file = luaL_checkstring (L, 2);
+	b = lixp_checkbuffer (L, 3);
+	max = (size_t)luaL_optnumber (L, 4, b->max);
+
+	b->len = 0;
+	top = lua_gettop (L);
+	len = read_to (L, ixp, file, &b->data, &b->size, max, 0, &short_read);
+	if (len < 0) {
+		lua_settop (L, top + 2);
+		return 2;
+	}
+
+	b->len = len;
+	lua_pushnumber (L, len);
+	lua_pushboolean (L, short_read);
+	return 2;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: stats = stats()
+ *
+ *    stats.reads       - files read with read(), read_into() and friends
+ *    stats.bytes       - bytes they returned
+ *    stats.allocs      - times a read buffer had to be allocated or grown
+ *    stats.scratch     - bytes held by the connection's read buffer
+ *    stats.rpcs        - 9P requests made by reads, listings and stats
+ *    stats.msize       - the message size agreed with the server
+ */
+int l_ixp_stats (lua_State *L)
+{
+	struct ixp *ixp = lixp_checkixp (L, 1);
+
+	lua_newtable (L);
+	lua_pushnumber (L, ixp->reads);
+	lua_setfield (L, -2, "reads");
+	lua_pushnumber (L, ixp->read_bytes);
+	lua_setfield (L, -2, "bytes");
+	lua_pushnumber (L, ixp->allocs);
+	lua_setfield (L, -2, "allocs");
+	lua_pushnumber (L, ixp->scratch_size);
+	lua_setfield (L, -2, "scratch");
+	lua_pushnumber (L, ixp->rpcs);
+	lua_setfield (L, -2, "rpcs");
+	lua_pushnumber (L, ixp->client->msize);
+	lua_setfield (L, -2, "msize");
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: data, errors = read_many({file, ...}, [max_size])
+ *
+ * Reads each of the files, like read() does, without returning to lua in
+ * between.  data is indexed by file name; files that could not be read are
+ * missing from it, and the error messages are in errors (nil if there were
+ * none).
+ */
+int l_ixp_read_many (lua_State *L)
+{
+	struct ixp *ixp;
+	lua_Number max_buffer_size;
+	int i, n, data, errors, nerrors = 0;
+
+	ixp = lixp_checkixp (L, 1);
+	luaL_checktype (L, 2, LUA_TTABLE);
+	max_buffer_size = luaL_optnumber (L, 3, IXP_READ_MAX_BUFFER_SIZE);
+
+	n = lua_objlen (L, 2);
+
+	DBGF("** ixp.read_many (%d files) **\n", n);
+
+	lua_createtable (L, 0, n);
+	data = lua_gettop (L);
+	lua_newtable (L);
+	errors = data + 1;
+
+	for (i=1; i<=n; i++) {
+		const char *file;
+
+		lua_rawgeti (L, 2, i);
+		file = lua_tostring (L, -1);
+		if (!file)
+			return luaL_error (L, "read_many: entry %d is not a string", i);
+
+		/* file is at errors+1, the results follow it */
+		read_file (L, ixp, file, max_buffer_size);
+		lua_pushvalue (L, errors + 1);
+		if (lua_isnil (L, errors + 2)) {
+			lua_pushvalue (L, errors + 3);
+			lua_settable (L, errors);
+			nerrors++;
+		} else {
+			lua_pushvalue (L, errors + 2);
+			lua_settable (L, data);
 		}
-		buf = _buf;
-		buf_size = realloc_size;
+		lua_settop (L, errors);
 	}
 
-	ixp_close(fid);
+	if (!nerrors) {
+		lua_pop (L, 1);
+		lua_pushnil (L);
+	}
+	return 2;
+}
 
-	if (memchr(buf, '\0', buf_ofs))
-		fprintf(stderr, "** WARNING: ixp.read (%s): result contains null characters **\n", file);
+/* ------------------------------------------------------------------------
+ * change detection
+ *
+ * A change token is the qid.version of a file.  wmii does not keep
+ * versions and leaves it at 0, so for such files the token is a hash of
+ * the contents, offset by LIXP_HASH_TOKEN so that it never equals a
+ * version.  Those files are read either way, but callers can skip parsing
+ * what did not change.  A hash token passed back in skips the stat.
+ */
 
-	lua_pushlstring(L, buf, buf_ofs);
-	lua_pushboolean(L, short_read);
+static uint32_t fnv1a (const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* finds the current token of file; returns 1 with the contents pushed if
+ * it had to read them, 0 with nothing pushed if a stat was enough, or -1
+ * with nil and an error message pushed */
+static int file_token (lua_State *L, struct ixp *ixp, const char *file,
+		lua_Number last, lua_Number *token)
+{
+	IxpStat *stat;
+	const char *data;
+	size_t len;
+	int top = lua_gettop (L);
+
+	if (last < LIXP_HASH_TOKEN) {
+		stat = ixp_stat (ixp->client, file);
+		ixp->rpcs += LIXP_RPCS_STAT;
+		if (!stat) {
+			lixp_pusherror (L, "cannot stat file");
+			lua_settop (L, top + 2);
+			return -1;
+		}
+		*token = stat->qid.version;
+		ixp_freestat (stat);
+		if (*token)
+			return 0;
+	}
+
+	read_file (L, ixp, file, IXP_READ_MAX_BUFFER_SIZE);
+	if (lua_isnil (L, top + 1)) {
+		lua_settop (L, top + 2);
+		return -1;
+	}
+	lua_settop (L, top + 1);
+
+	data = lua_tolstring (L, -1, &len);
+	*token = LIXP_HASH_TOKEN + fnv1a (data, len);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: data, token = read_if_changed(file, last_token)
+ *
+ *    data - the contents if the file changed since last_token was
+ *           returned, or false if it did not
+ *    token - to pass in next time; nil or no last_token always reads
+ */
+int l_ixp_read_if_changed (lua_State *L)
+{
+	struct ixp *ixp;
+	const char *file;
+	lua_Number last, token;
+	int rc, top;
+
+	ixp = lixp_checkixp (L, 1);
+	file = luaL_checkstring (L, 2);
+	last = lua_isnumber (L, 3) ? lua_tonumber (L, 3) : -1;
+
+	DBGF("** ixp.read_if_changed (%s, %.0f) **\n", file, last);
+
+	top = lua_gettop (L);
+	rc = file_token (L, ixp, file, last, &token);
+	if (rc < 0)
+		return 2;
+
+	if (token == last) {
+		lua_settop (L, top);
+		lua_pushboolean (L, 0);
+
+	} else if (rc == 0) {
+		// changed, and a stat was all we did so far
+		read_file (L, ixp, file, IXP_READ_MAX_BUFFER_SIZE);
+		if (lua_isnil (L, top + 1)) {
+			lua_settop (L, top + 2);
+			return 2;
+		}
+		lua_settop (L, top + 1);
+	}
+
+	lua_pushnumber (L, token);
 	return 2;
 }
 
+/* ------------------------------------------------------------------------
+ * lua: changed, data, errors = poll_changes({ [file] = last_token, ... })
+ *
+ *    changed - new tokens of the files that changed, indexed by file
+ *    data - contents of changed files that had to be read anyway
+ *    errors - error messages indexed by file, or nil
+ *
+ *    a last_token of false is never current
+ */
+int l_ixp_poll_changes (lua_State *L)
+{
+	struct ixp *ixp;
+	int changed, data, errors, key, nerrors = 0;
+
+	ixp = lixp_checkixp (L, 1);
+	luaL_checktype (L, 2, LUA_TTABLE);
+
+	DBGF("** ixp.poll_changes **\n");
+
+	lua_newtable (L);
+	changed = lua_gettop (L);
+	lua_newtable (L);
+	data = changed + 1;
+	lua_newtable (L);
+	errors = changed + 2;
+	key = changed + 3;
+
+	lua_pushnil (L);
+	while (lua_next (L, 2)) {
+		const char *file;
+		lua_Number last, token;
+		int rc;
+
+		if (lua_type (L, key) != LUA_TSTRING)
+			return luaL_error (L, "poll_changes: keys must be file names");
+
+		file = lua_tostring (L, key);
+		last = lua_isnumber (L, -1) ? lua_tonumber (L, -1) : -1;
+		lua_pop (L, 1);
+
+		rc = file_token (L, ixp, file, last, &token);
+		if (rc < 0) {
+			lua_pushvalue (L, key);
+			lua_pushvalue (L, key + 2);
+			lua_settable (L, errors);
+			nerrors++;
+
+		} else if (token != last) {
+			lua_pushvalue (L, key);
+			lua_pushnumber (L, token);
+			lua_settable (L, changed);
+			if (rc == 1) {
+				lua_pushvalue (L, key);
+				lua_pushvalue (L, key + 1);
+				lua_settable (L, data);
+			}
+		}
+
+		lua_settop (L, key);
+	}
+
+	if (!nerrors) {
+		lua_pop (L, 1);
+		lua_pushnil (L);
+	}
+	return 3;
+}
+
 /* ------------------------------------------------------------------------
  * lua: create(file, [data]) -- create a file, optionally write data to it 
  */
@@ -226,11 +708,13 @@ int l_ixp_remove (lua_State *L)
  */
 
 struct l_ixp_iread_s {
+	struct ixp *ixp;		// kept alive as the iterator's 2nd upvalue
 	IxpCFid *fid;
 	char *buf;
 	size_t buf_pos;
 	size_t buf_len;
 	size_t buf_size;
+	struct lscan_cursor scan;	// newlines found ahead in buf
 };
 
 static int iread_iter (lua_State *L);
@@ -252,7 +736,9 @@ int l_ixp_iread (lua_State *L)
 	}
 	memset (ctx, 0, sizeof (*ctx));
 
+	ctx->ixp = ixp;
 	ctx->fid = ixp_open(ixp->client, file, P9_OREAD);
+	ixp->rpcs += LIXP_RPCS_OPEN + LIXP_RPCS_CLOSE;
 	if(ctx->fid == NULL) {
 		DBGF("** ixp.iread (%s) - count not open p9 file", file);
 		lua_pushcclosure (L, nil_iter, 1);
@@ -266,15 +752,18 @@ int l_ixp_iread (lua_State *L)
 	DBGF("** ixp.iread (%s) - iterator ready **\n", file);
 
 	// create and return the iterator function
-	// the only argument is the userdata
-	lua_pushcclosure (L, iread_iter, 1);
+	// the upvalues are the context and the connection it reads from
+	lua_pushvalue (L, 1);
+	lua_pushcclosure (L, iread_iter, 2);
 	return 1;
 }
 
 static int iread_iter (lua_State *L)
 {
 	struct l_ixp_iread_s *ctx;
-	char *s, *cr;
+	char *s;
+	long cr;
+	size_t len;
 
 	ctx = (struct l_ixp_iread_s*)lua_touserdata (L, lua_upvalueindex(1));
 
@@ -291,7 +780,9 @@ static int iread_iter (lua_State *L)
 	if (!ctx->buf_len) {
 		int rc;
 		ctx->buf_pos = 0;
+		lscan_reset (&ctx->scan);
 		rc = ixp_read (ctx->fid, ctx->buf, ctx->buf_size);
+		ctx->ixp->rpcs ++;
 		if (rc <= 0) {
 			return 0; // we are done
 		}
@@ -300,27 +791,30 @@ static int iread_iter (lua_State *L)
 
 	s = ctx->buf + ctx->buf_pos;
 
-	cr = strchr (s, '\n');
-	if (!cr) {
+	// the newlines of the whole chunk are found in one pass, and
+	// handed out a line at a time
+	cr = lscan_find (&ctx->scan, ctx->buf, ctx->buf_pos,
+			ctx->buf_pos + ctx->buf_len, '\n');
+	if (cr < 0) {
 		// no match, just return the whole thing
 		// TODO: should read more upto a cr or some limit
-		if (memchr(s, '\0', ctx->buf_len))
-			fprintf(stderr, "** WARNING: ixp.iread - iter: result contains null characters **\n");
-		lua_pushlstring (L, s, ctx->buf_len);
-		ctx->buf_len = 0;
-		return 1;
-
+		len = ctx->buf_len;
 	} else {
 		// we have a match s..cr is our sub string
-		int len = cr-s;
-		if (memchr(s, '\0', len))
-			fprintf(stderr, "** WARNING: ixp.iread - iter: result contains null characters **\n");
-		lua_pushlstring (L, s, len);
-		len++;
-		ctx->buf_pos += len;
-		ctx->buf_len -= len;
-		return 1;
+		len = cr - ctx->buf_pos;
 	}
+
+#ifdef DBG
+	if (memchr(s, '\0', len))
+		fprintf(stderr, "** WARNING: ixp.iread - iter: result contains null characters **\n");
+#endif
+
+	lua_pushlstring (L, s, len);
+	if (cr >= 0)
+		len++;
+	ctx->buf_pos += len;
+	ctx->buf_len -= len;
+	return 1;
 }
 
 static int iread_gc (lua_State *L)
@@ -366,6 +860,7 @@ int l_ixp_stat (lua_State *L)
 	DBGF("** ixp.stat (%s) **\n", file);
 
 	stat = ixp_stat(ixp->client, file);
+	ixp->rpcs += LIXP_RPCS_STAT;
 	if(!stat)
 		return lixp_pusherror(L, "cannot stat file");
 
@@ -381,6 +876,7 @@ int l_ixp_stat (lua_State *L)
  */
 
 struct l_ixp_idir_s {
+	struct ixp *ixp;		// kept alive as the iterator's 2nd upvalue
 	IxpCFid *fid;
 	unsigned char *buf;
 	IxpMsg m;
@@ -407,7 +903,9 @@ int l_ixp_idir (lua_State *L)
 	}
 	memset(ctx, 0, sizeof (*ctx));
 
+	ctx->ixp = ixp;
 	ctx->fid = ixp_open(ixp->client, file, P9_OREAD);
+	ixp->rpcs += LIXP_RPCS_OPEN + LIXP_RPCS_CLOSE;
 	if(ctx->fid == NULL) {
 		DBGF("** ixp.idir (%s) - count not open p9 file", file);
 		lua_pushcclosure (L, nil_iter, 1);
@@ -430,8 +928,9 @@ int l_ixp_idir (lua_State *L)
 	DBGF("** ixp.idir (%s) - iterator ready **\n", file);
 
 	// create and return the iterator function
-	// the only argument is the userdata
-	lua_pushcclosure (L, idir_iter, 1);
+	// the upvalues are the context and the connection it reads from
+	lua_pushvalue (L, 1);
+	lua_pushcclosure (L, idir_iter, 2);
 	return 1;
 }
 
@@ -446,6 +945,7 @@ static int idir_iter (lua_State *L)
 
 	if (ctx->m.pos >= ctx->m.end) {
 		int rc = ixp_read (ctx->fid, ctx->buf, ctx->fid->iounit);
+		ctx->ixp->rpcs ++;
 		if (rc <= 0) {
 			return 0;
 		}
@@ -10,11 +10,40 @@ struct IxpClient;
 #define L_IXP_IREAD_MT "ixp.iread_mt"
 
 #define IXP_READ_MAX_BUFFER_SIZE 65536   // max returned by l_ixp_read
+#define IXP_SCRATCH_KEEP_SIZE IXP_READ_MAX_BUFFER_SIZE // larger read buffers are freed
+
+#define IXP_MIN_MSIZE 256		// smallest msize ixp.new() accepts
+
+/* 9P requests made by each client call, counted in stats().rpcs */
+#define LIXP_RPCS_OPEN 2		// Twalk, Topen
+#define LIXP_RPCS_CLOSE 1		// Tclunk
+#define LIXP_RPCS_STAT 3		// Twalk, Tstat, Tclunk
+
+#define LIXP_HASH_TOKEN 4294967296.0	// change tokens above this are content hashes
+
+#define LIXP_FID_CACHE_SIZE 4	// files kept open for the ffi fast path
+
+struct IxpCFid;
+struct lixp_cached_fid {
+	char *file;
+	struct IxpCFid *fid;		// NULL while the slot is free
+};
 
 /* the C representation of a ixp instance object */
 struct ixp {
 	const char *address;;
 	struct IxpClient *client;
+
+	char *scratch;			// read buffer, reused across reads
+	size_t scratch_size;
+
+	unsigned long reads;		// files read
+	unsigned long read_bytes;
+	unsigned long allocs;		// read buffers allocated or grown
+	unsigned long rpcs;		// requests made reading and listing
+
+	struct lixp_cached_fid fids[LIXP_FID_CACHE_SIZE];	// see lixp_ffi.c
+	unsigned fid_next;		// slot to take when all are in use
 };
 
 extern struct ixp *lixp_checkixp (lua_State *L, int narg);
@@ -26,7 +55,14 @@ extern void lixp_init_idir_mt (lua_State *L);
 
 /* exported api */
 extern int l_ixp_write (lua_State *L);
+extern int l_ixp_pwrite (lua_State *L);
+extern int l_ixp_pread (lua_State *L);
 extern int l_ixp_read (lua_State *L);
+extern int l_ixp_read_many (lua_State *L);
+extern int l_ixp_read_into (lua_State *L);
+extern int l_ixp_stats (lua_State *L);
+extern int l_ixp_read_if_changed (lua_State *L);
+extern int l_ixp_poll_changes (lua_State *L);
 extern int l_ixp_create (lua_State *L);
 extern int l_ixp_remove (lua_State *L);
 extern int l_ixp_iread (lua_State *L);
@@ -5,35 +5,106 @@
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <ixp.h>
 
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "lcompat.h"
 #include "lixp_debug.h"
 #include "lixp_util.h"
 #include "lixp_instance.h"
+#include "lixp_buffer.h"
+#include "lixp_ffi.h"
 
 
 /* ------------------------------------------------------------------------
  * lua: x = ixp.new("unix!/tmp/ns.bart.:0/wmii") -- create a new ixp object
+ *      x = ixp.new(address, { msize = 4096, timeout_ms = 500, nodelay = true })
+ *
+ *    msize      - largest 9P message to use; reads and directory listings
+ *                 are split into messages of this size.  libixp proposes
+ *                 its own maximum (IXP_MAX_MSG) when mounting, so only
+ *                 smaller sizes can be asked for
+ *    timeout_ms - give up on a request the server has not answered in this
+ *                 time; the connection is not usable after a timeout
+ *    nodelay    - disable Nagle's algorithm on tcp! connections
  */
+static int set_timeout (int fd, int optname, lua_Number ms)
+{
+	struct timeval tv;
+
+	tv.tv_sec = (long)ms / 1000;
+	tv.tv_usec = ((long)ms % 1000) * 1000;
+
+	return setsockopt (fd, SOL_SOCKET, optname, &tv, sizeof (tv));
+}
+
 static int l_new (lua_State *L)
 {
 	const char *adr;
 	IxpClient *cli;
 	struct ixp *ixp;
+	lua_Number msize = 0, timeout_ms = 0;
+	int nodelay = 0;
+	int fd;
 
 	adr = luaL_checkstring (L, 1);
 
-	DBGF("** ixp.new ([%s]) **\n", adr);
+	if (!lua_isnoneornil (L, 2)) {
+		luaL_checktype (L, 2, LUA_TTABLE);
+
+		lua_getfield (L, 2, "msize");
+		msize = luaL_optnumber (L, -1, 0);
+		lua_getfield (L, 2, "timeout_ms");
+		timeout_ms = luaL_optnumber (L, -1, 0);
+		lua_getfield (L, 2, "nodelay");
+		nodelay = lua_toboolean (L, -1);
+		lua_pop (L, 3);
 
-	cli = ixp_mount(adr);
+		luaL_argcheck (L, !msize || msize >= IXP_MIN_MSIZE, 2,
+				"msize is too small");
+		luaL_argcheck (L, timeout_ms >= 0, 2,
+				"timeout_ms must not be negative");
+	}
+
+	DBGF("** ixp.new ([%s], msize=%.0f timeout=%.0f nodelay=%d) **\n",
+			adr, msize, timeout_ms, nodelay);
+
+	fd = ixp_dial(adr);
+	if (fd < 0)
+		return lixp_pusherror (L, "could not open ixp connection");
+
+	if (timeout_ms && (set_timeout (fd, SO_RCVTIMEO, timeout_ms)
+				|| set_timeout (fd, SO_SNDTIMEO, timeout_ms))) {
+		close (fd);
+		return lixp_pusherror (L, NULL);
+	}
+
+	// fails with EOPNOTSUPP on unix! sockets, where there is no Nagle
+	if (nodelay) {
+		int one = 1;
+		if (setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one)))
+			DBGF("** ixp.new ([%s]) - no TCP_NODELAY: %s **\n",
+					adr, strerror (errno));
+	}
+
+	// closes fd if the server does not answer
+	cli = ixp_mountfd(fd);
 	if (!cli)
 		return lixp_pusherror (L, "could not open ixp connection");
 
+	// Tversion already agreed on a size; the client may always use less
+	if (msize && msize < cli->msize)
+		cli->msize = msize;
+
 	ixp = (struct ixp*)lua_newuserdata(L, sizeof (struct ixp));
+	memset (ixp, 0, sizeof (struct ixp));
 
 	luaL_getmetatable (L, L_IXP_MT);
 	lua_setmetatable (L, -2);
@@ -50,8 +121,10 @@ static int l_ixp_gc (lua_State *L)
 
 	DBGF("** ixp:__gc (%p [%s]) **\n", ixp, ixp->address);
 
+	lixp_ffi_free (ixp);
 	ixp_unmount (ixp->client);
 	free ((char*)ixp->address);
+	free (ixp->scratch);
 
 	return 0;
 }
@@ -62,6 +135,8 @@ static int l_ixp_gc (lua_State *L)
 static const luaL_reg class_table[] =
 {
 	{ "new",		l_new },
+	{ "buffer",		l_ixp_buffer_new },
+	{ "ffi_api",		l_ixp_ffi_api },
 	
 	{ NULL,			NULL },
 };
@@ -75,7 +150,13 @@ static const luaL_reg instance_table[] =
 	{ "__gc",		l_ixp_gc },
 
 	{ "write",		l_ixp_write },
+	{ "pwrite",		l_ixp_pwrite },
 	{ "read",		l_ixp_read },
+	{ "pread",		l_ixp_pread },
+	{ "read_many",		l_ixp_read_many },
+	{ "read_into",		l_ixp_read_into },
+	{ "read_if_changed",	l_ixp_read_if_changed },
+	{ "poll_changes",	l_ixp_poll_changes },
 
 	{ "create",		l_ixp_create },
 	{ "remove",		l_ixp_remove },
@@ -84,6 +165,7 @@ static const luaL_reg instance_table[] =
 	{ "idir",		l_ixp_idir },
 
 	{ "stat",		l_ixp_stat },
+	{ "stats",		l_ixp_stats },
 
 	{ NULL,			NULL },
 };
@@ -119,6 +201,7 @@ LUALIB_API int luaopen_ixp (lua_State *L)
 {
 	lixp_init_iread_mt (L);
 	lixp_init_idir_mt (L);
+	lixp_init_buffer_mt (L);
 
 	return lixp_init_ixp_class (L);
 }
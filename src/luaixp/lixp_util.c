@@ -9,6 +9,7 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "lcompat.h"
 #include "lixp_util.h"
 
 
@@ -100,7 +101,7 @@ int lixp_write_data (IxpCFid *fid, const char *data, size_t data_len)
 		if (rc < 0)
 			return rc;
 
-		else if (rc > left)
+		else if ((size_t)rc > left)
 			return -ENXIO;
 
 		left -= rc;
@@ -110,6 +111,122 @@ int lixp_write_data (IxpCFid *fid, const char *data, size_t data_len)
 	return data_len;
 }
 
+int lixp_pwrite_data (IxpCFid *fid, const char *data, size_t data_len,
+		long long offset)
+{
+	size_t left = data_len;
+
+	while (left) {
+		long rc = ixp_pwrite(fid, data, left, offset);
+		if (rc < 0)
+			return rc;
+
+		else if ((size_t)rc > left || !rc)
+			return -ENXIO;
+
+		left -= rc;
+		data += rc;
+		offset += rc;
+	}
+
+	return data_len;
+}
+
+/* ------------------------------------------------------------------------
+ * write an array of strings, joined by sep, without joining them first;
+ * small chunks are gathered into iounit sized writes, large ones are
+ * written straight from the lua strings
+ */
+struct chunk_writer {
+	IxpCFid *fid;
+	char *buf;
+	size_t size;
+	size_t fill;
+	long long offset;
+};
+
+static int chunk_flush (struct chunk_writer *w)
+{
+	int rc;
+
+	if (!w->fill)
+		return 0;
+
+	rc = lixp_pwrite_data (w->fid, w->buf, w->fill, w->offset);
+	if (rc < 0)
+		return rc;
+
+	w->offset += w->fill;
+	w->fill = 0;
+	return 0;
+}
+
+static int chunk_add (struct chunk_writer *w, const char *data, size_t len)
+{
+	while (len) {
+		size_t n;
+		int rc;
+
+		if (!w->fill && len >= w->size) {
+			n = len - len % w->size;
+			rc = lixp_pwrite_data (w->fid, data, n, w->offset);
+			if (rc < 0)
+				return rc;
+			w->offset += n;
+
+		} else {
+			n = w->size - w->fill;
+			if (n > len)
+				n = len;
+			memcpy (w->buf + w->fill, data, n);
+			w->fill += n;
+			if (w->fill == w->size && (rc = chunk_flush (w)) < 0)
+				return rc;
+		}
+
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int lixp_write_chunks (lua_State *L, IxpCFid *fid, int idx,
+		const char *sep, size_t sep_len, long long offset)
+{
+	struct chunk_writer w;
+	int i, n, rc = 0;
+
+	w.fid = fid;
+	w.size = fid->iounit ? fid->iounit : IXP_CHUNK_BUFFER_SIZE;
+	w.fill = 0;
+	w.offset = offset;
+	w.buf = malloc (w.size);
+	if (!w.buf)
+		return -ENOMEM;
+
+	n = lua_objlen (L, idx);
+	for (i=1; i<=n && rc>=0; i++) {
+		const char *data;
+		size_t len;
+
+		lua_rawgeti (L, idx, i);
+		data = lua_tolstring (L, -1, &len);
+
+		if (i > 1 && sep_len)
+			rc = chunk_add (&w, sep, sep_len);
+		if (rc >= 0 && data)
+			rc = chunk_add (&w, data, len);
+
+		lua_pop (L, 1);
+	}
+
+	if (rc >= 0)
+		rc = chunk_flush (&w);
+
+	free (w.buf);
+	return rc < 0 ? rc : (int)(w.offset - offset);
+}
+
 /* ------------------------------------------------------------------------
  * dump IXP status structure to lua table
  */
@@ -142,6 +259,23 @@ static void build_timestr(char *buf, const struct IxpStat *stat)
 }
 
 
+/* ------------------------------------------------------------------------
+ * dump IXP qid structure to lua table
+ */
+int lixp_pushqid (lua_State *L, const struct IxpQid *qid)
+{
+	lua_createtable (L, 0, 3);
+
+	lua_pushnumber (L, qid->path);
+	lua_setfield (L, -2, "path");
+	lua_pushnumber (L, qid->version);
+	lua_setfield (L, -2, "version");
+	lua_pushnumber (L, qid->type);
+	lua_setfield (L, -2, "type");
+
+	return 1;
+}
+
 #define setfield(type,name,value) \
 	lua_pushstring (L, name); \
 	lua_push##type (L, value); \
@@ -153,7 +287,13 @@ int lixp_pushstat (lua_State *L, const struct IxpStat *stat)
 
 	setfield(number, "type", stat->type);
 	setfield(number, "dev", stat->dev);
-	//setfield(Qid,    "qid", stat->qid);	// TODO: what is this?
+
+	// the qid identifies the file on the server; a server that keeps
+	// versions bumps qid.version whenever the file changes
+	lua_pushstring (L, "qid");
+	lixp_pushqid (L, &stat->qid);
+	lua_settable (L, -3);
+
 	setfield(number, "mode", stat->mode);
 	setfield(number, "atime", stat->atime);
 	setfield(number, "mtime", stat->mtime);
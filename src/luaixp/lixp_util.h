@@ -14,12 +14,20 @@
 
 struct IxpCFid;
 struct IxpStat;
+struct IxpQid;
 
 extern int lixp_pusherrorf(lua_State *L, const char *fmt, ...);
 extern int lixp_pusherror(lua_State *L, const char *info);
 
 extern int lixp_write_data (struct IxpCFid *fid, const char *data, size_t data_len);
+extern int lixp_pwrite_data (struct IxpCFid *fid, const char *data,
+		size_t data_len, long long offset);
+extern int lixp_write_chunks (lua_State *L, struct IxpCFid *fid, int idx,
+		const char *sep, size_t sep_len, long long offset);
+
+#define IXP_CHUNK_BUFFER_SIZE 8192	// gather size when a fid has no iounit
 
 extern int lixp_pushstat (lua_State *L, const struct IxpStat *stat);
+extern int lixp_pushqid (lua_State *L, const struct IxpQid *qid);
 
 #endif // __LUAIXP_UTIL_H__
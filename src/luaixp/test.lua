@@ -35,6 +35,49 @@ if not data then
 elseif short then
         print ("  ... short read")
 end
+-- a failed read is nil and a message, never the message as the contents
+local function failed (...)
+        return select ("#", ...) == 2 and select (1, ...) == nil
+                and type (select (2, ...)) == "string"
+end
+assert (failed (x:read ("/lbar/xxxxxxxxxxxxxxxxxxxxxxx")), "read")
+assert (failed (x:pread ("/lbar/xxxxxxxxxxxxxxxxxxxxxxx", 0)), "pread")
+assert (failed (x:read_into ("/lbar/xxxxxxxxxxxxxxxxxxxxxxx", ixp.buffer (16))),
+        "read_into")
+
+print ("writing chunks...")
+x:write ("/lbar/1", { '#FF0000', '#00FF00', '#0000FF', '1zzz' }, ' ')
+print ("  " .. x:read ("/lbar/1"))
+
+print ("ranged reads and writes...")
+x:pwrite ("/lbar/1", 24, 'ab')
+print ("  " .. x:pread ("/lbar/1", 22, 4))
+print ("  past the end: '" .. x:pread ("/lbar/1", 4096, 16) .. "'")
+
+print ("reading into a buffer...")
+local buf = ixp.buffer (256)
+len,short = x:read_into ("/lbar/1", buf)
+print ("  " .. tostring(len) .. " bytes: " .. buf:data () .. " [" .. buf:sub (1, 7) .. "]")
+len,short = x:read_into ("/lbar/1", buf, 8)
+print ("  limited to " .. buf:len () .. " bytes, short=" .. tostring(short))
+local st = x:stats ()
+print (string.format ("  %d reads, %d bytes, %d allocations, %d byte scratch",
+        st.reads, st.bytes, st.allocs, st.scratch))
+
+print ("connecting with a small msize...")
+local small = ixp.new ("unix!/tmp/ns.bart.:0/wmii", { msize = 512, timeout_ms = 1000 })
+for data in small:idir ("/") do end
+st = small:stats ()
+print (string.format ("  msize %d, %d requests to list /", st.msize, st.rpcs))
+
+print ("reading many...")
+data,errs = x:read_many ({ "/lbar/1", "/ctl", "/lbar/xxxxxxxxxxxxxxxxxxxxxxx" })
+for k,v in pairs(data) do
+        print ("  " .. k .. ": " .. v:gsub("\n.*", " ..."))
+end
+for k,v in pairs(errs or {}) do
+        print ("  " .. k .. ": error: " .. v)
+end
 
 print ("stating...")
 data = x:stat ("/event")
@@ -46,6 +89,32 @@ for k,v in pairs (data) do
         print ("  "..k.." = " .. tostring(v) .. hex)
 end
 
+print ("qid of /ctl...")
+data = x:stat ("/ctl")
+print (string.format ("  path=0x%x version=%d type=0x%x",
+        data.qid.path, data.qid.version, data.qid.type))
+
+print ("conditional reads...")
+data,token = x:read_if_changed ("/lbar/1")
+print ("  first: " .. tostring(data) .. " (token " .. tostring(token) .. ")")
+data,token = x:read_if_changed ("/lbar/1", token)
+print ("  again: " .. tostring(data))
+x:write ("/lbar/1", '#FF0000 #00FF00 #0000FF 1yyy')
+data,token = x:read_if_changed ("/lbar/1", token)
+print ("  after a write: " .. tostring(data))
+
+print ("polling for changes...")
+local _, ctl_token = x:read_if_changed ("/ctl")
+local changed,contents,errs = x:poll_changes ({ ["/lbar/1"] = token,
+                                               ["/ctl"] = ctl_token,
+                                               ["/lbar/xxxxxxxxxxxxxxxxxxxxxxx"] = false })
+for k,v in pairs(changed) do
+        print ("  " .. k .. ": changed, token " .. v)
+end
+for k,v in pairs(errs or {}) do
+        print ("  " .. k .. ": error: " .. v)
+end
+
 print ("directory list...")
 for data in x:idir ("/") do
         local slash = ""
@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lrb_debug.h"
+#include "lrb_instance.h"
+#include "lrb_log.h"
+
+
+/* ------------------------------------------------------------------------
+ * utility functions
+ */
+
+struct lrb_ring *lrb_checkring (lua_State *L, int narg)
+{
+	void *ud = luaL_checkudata (L, narg, L_RINGBUF_MT);
+	luaL_argcheck (L, ud != NULL, narg, "`ringbuf' expected");
+	return (struct lrb_ring*)ud;
+}
+
+static struct lrb_ring *check_numbers (lua_State *L, int narg)
+{
+	struct lrb_ring *r = lrb_checkring (L, narg);
+	luaL_argcheck (L, r->kind == LRB_NUMBERS, narg, "ring of numbers expected");
+	return r;
+}
+
+/* the ring and its arrays are one userdata; the 8 byte arrays go first */
+struct lrb_ring *lrb_ring_new (lua_State *L, unsigned size, enum lrb_kind kind)
+{
+	struct lrb_ring *r;
+	size_t bytes = sizeof (*r);
+	char *p;
+	unsigned i;
+
+	if (kind == LRB_NUMBERS)
+		bytes += size * sizeof (double);
+	else
+		bytes += (size + 1) * sizeof (unsigned long long)
+			+ (size + 1) * sizeof (unsigned)
+			+ size * sizeof (int) * 2;
+
+	r = (struct lrb_ring*)lua_newuserdata (L, bytes);
+	memset (r, 0, bytes);
+
+	luaL_getmetatable (L, L_RINGBUF_MT);
+	lua_setmetatable (L, -2);
+
+	r->kind = kind;
+	r->size = size;
+
+	p = (char*)(r + 1);
+	if (kind == LRB_NUMBERS) {
+		r->num = (double*)p;
+		return r;
+	}
+
+	r->newest = (unsigned long long*)p;
+	p += (size + 1) * sizeof (unsigned long long);
+	r->refs = (unsigned*)p;
+	p += (size + 1) * sizeof (unsigned);
+	r->ids = (int*)p;
+	p += size * sizeof (int);
+	r->free_ids = (int*)p;
+
+	// ids are handed out from 1 up
+	for (i = 0; i < size; i++)
+		r->free_ids[i] = size - i;
+	r->nfree = size;
+
+	// the interned strings: t[id] = string, t[string] = id
+	lua_newtable (L);
+	lua_setfenv (L, -2);
+
+	return r;
+}
+
+/* looks up the string at index str, in the ring at index ud; returns its
+ * id, or 0 if it is not in the ring */
+static int string_id (lua_State *L, int ud, int str)
+{
+	int id;
+
+	lua_getfenv (L, ud);
+	lua_pushvalue (L, str);
+	lua_rawget (L, -2);
+	id = lua_tointeger (L, -1);
+	lua_pop (L, 2);
+
+	return id;
+}
+
+/* like string_id(), but adds the string if needed; there is always a free
+ * id as the ring cannot hold more distinct strings than it has slots */
+static int intern (lua_State *L, struct lrb_ring *r, int ud, int str)
+{
+	int id = string_id (L, ud, str);
+	if (id)
+		return id;
+
+	id = r->free_ids[--r->nfree];
+
+	lua_getfenv (L, ud);
+	lua_pushvalue (L, str);
+	lua_pushinteger (L, id);
+	lua_rawset (L, -3);
+	lua_pushvalue (L, str);
+	lua_rawseti (L, -2, id);
+	lua_pop (L, 1);
+
+	return id;
+}
+
+/* drops one reference to id, forgetting the string with the last one */
+static void release (lua_State *L, struct lrb_ring *r, int ud, int id)
+{
+	if (--r->refs[id])
+		return;
+
+	lua_getfenv (L, ud);
+	lua_rawgeti (L, -1, id);
+	lua_pushnil (L);
+	lua_rawset (L, -3);
+	lua_pushnil (L);
+	lua_rawseti (L, -2, id);
+	lua_pop (L, 1);
+
+	r->free_ids[r->nfree++] = id;
+}
+
+/* pushes entry s, which has to be one the ring holds */
+void lrb_push_entry (lua_State *L, struct lrb_ring *r, int ud,
+		unsigned long long s)
+{
+	if (r->kind == LRB_NUMBERS) {
+		lua_pushnumber (L, r->num[SLOT(r,s)]);
+		return;
+	}
+
+	lua_getfenv (L, ud);
+	lua_rawgeti (L, -1, r->ids[SLOT(r,s)]);
+	lua_remove (L, -2);
+}
+
+/* true if no entry newer than s holds the same value */
+static int is_newest (struct lrb_ring *r, unsigned long long s)
+{
+	unsigned long long t;
+	double v;
+
+	if (r->kind == LRB_STRINGS)
+		return r->newest[r->ids[SLOT(r,s)]] == s;
+
+	v = r->num[SLOT(r,s)];
+	for (t = s + 1; t < r->head; t++)
+		if (r->num[SLOT(r,t)] == v)
+			return 0;
+	return 1;
+}
+
+/* finds the newest entry holding the value at index v; returns 0 if there
+ * is none, and sets *found */
+static int find_newest (lua_State *L, struct lrb_ring *r, int ud, int v,
+		unsigned long long *found)
+{
+	unsigned long long s;
+	double n;
+	int id;
+
+	if (r->kind == LRB_STRINGS) {
+		if (lua_type (L, v) != LUA_TSTRING)
+			return 0;
+		id = string_id (L, ud, v);
+		if (!id)
+			return 0;
+		*found = r->newest[id];
+		return 1;
+	}
+
+	if (lua_type (L, v) != LUA_TNUMBER)
+		return 0;
+	n = lua_tonumber (L, v);
+	for (s = r->head; s-- > LOW(r); ) {
+		if (r->num[SLOT(r,s)] == n) {
+			*found = s;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* min, max and sum of the newest n numbers; returns how many there were */
+static unsigned window (struct lrb_ring *r, lua_Number n,
+		double *min, double *max, double *sum)
+{
+	unsigned long long s;
+	unsigned count = r->count;
+
+	if (n >= 0 && n < count)
+		count = n;
+
+	*min = *max = *sum = 0;
+	for (s = r->head - count; s < r->head; s++) {
+		double v = r->num[SLOT(r,s)];
+		if (s == r->head - count || v < *min)
+			*min = v;
+		if (s == r->head - count || v > *max)
+			*max = v;
+		*sum += v;
+	}
+
+	return count;
+}
+
+/* adds the value at index v, a number or a string to suit the ring, to the
+ * ring at index ud */
+void lrb_push (lua_State *L, struct lrb_ring *r, int ud, int v)
+{
+	unsigned slot = SLOT(r, r->head);
+	int id;
+
+	if (r->kind == LRB_NUMBERS) {
+		r->num[slot] = lua_tonumber (L, v);
+		if (r->count < r->size)
+			r->count ++;
+		r->head ++;
+		return;
+	}
+
+	if (r->count == r->size) {
+		// the oldest entry is in the slot we are about to use
+		release (L, r, ud, r->ids[slot]);
+		r->count --;
+	}
+
+	id = intern (L, r, ud, v);
+	r->ids[slot] = id;
+	r->refs[id] ++;
+	r->newest[id] = r->head;
+
+	r->count ++;
+	r->head ++;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: rb:push(value) -- adds value, dropping the oldest entry when full;
+ *      also available as rb:add(value), as in the old history module
+ */
+int l_ringbuf_push (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	const char *data;
+	size_t len;
+	double n;
+
+	if (r->kind == LRB_NUMBERS) {
+		n = luaL_checknumber (L, 2);
+		data = (const char*)&n;
+		len = sizeof (n);
+	} else
+		data = luaL_checklstring (L, 2, &len);
+
+	lrb_push (L, r, 1, 2);
+
+	if (r->log)
+		lrb_log_append (r, LRB_OP_PUSH, data, len);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: v = rb:get(i)
+ *
+ *    i - 1 is the oldest entry, 2 the one after it...; -1 is the newest,
+ *        -2 the one before it...  Returns nil outside of the ring.
+ */
+int l_ringbuf_get (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	lua_Integer i = luaL_checkinteger (L, 2);
+
+	if (i > 0 && i <= r->count)
+		lrb_push_entry (L, r, 1, LOW(r) + i - 1);
+	else if (i < 0 && -i <= r->count)
+		lrb_push_entry (L, r, 1, r->head + i);
+	else
+		lua_pushnil (L);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: v = rb:newest() / v = rb:oldest() -- nil when empty
+ */
+int l_ringbuf_newest (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	if (!r->count) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lrb_push_entry (L, r, 1, r->head - 1);
+	return 1;
+}
+
+int l_ringbuf_oldest (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	if (!r->count) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lrb_push_entry (L, r, 1, LOW(r));
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = rb:count() -- entries held, also #rb
+ *      n = rb:size()  -- entries it can hold
+ */
+int l_ringbuf_count (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lua_pushinteger (L, r->count);
+	return 1;
+}
+
+int l_ringbuf_size (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lua_pushinteger (L, r->size);
+	return 1;
+}
+
+int l_ringbuf_tostring (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lua_pushfstring (L, "ringbuf{%s %d/%d}",
+			r->kind == LRB_NUMBERS ? "number" : "string",
+			(int)r->count, (int)r->size);
+	return 1;
+}
+
+/* drops all entries of the ring at index ud */
+void lrb_clear (lua_State *L, struct lrb_ring *r, int ud)
+{
+	unsigned i;
+
+	r->count = 0;
+
+	if (r->kind == LRB_STRINGS) {
+		memset (r->refs, 0, (r->size + 1) * sizeof (unsigned));
+		for (i = 0; i < r->size; i++)
+			r->free_ids[i] = r->size - i;
+		r->nfree = r->size;
+
+		lua_newtable (L);
+		lua_setfenv (L, ud);
+	}
+}
+
+/* drops every entry equal to the value at index v, from the ring at index
+ * ud; returns how many there were */
+unsigned lrb_remove (lua_State *L, struct lrb_ring *r, int ud, int v)
+{
+	unsigned long long s, w, low = LOW(r);
+	unsigned removed = 0;
+	double n = 0;
+	int id = 0;
+
+	if (r->kind == LRB_STRINGS) {
+		id = string_id (L, ud, v);
+		if (!id)
+			return 0;
+	} else
+		n = lua_tonumber (L, v);
+
+	// walk from the newest entry, moving the ones we keep up to fill the
+	// gaps; w never catches up with a slot that is still to be read
+	w = r->head;
+	for (s = r->head; s-- > low; ) {
+		unsigned from = SLOT(r,s);
+
+		if (r->kind == LRB_STRINGS ? r->ids[from] == id
+				: r->num[from] == n) {
+			removed ++;
+			continue;
+		}
+
+		w --;
+		if (w == s)
+			continue;
+
+		if (r->kind == LRB_NUMBERS) {
+			r->num[SLOT(r,w)] = r->num[from];
+		} else {
+			int other = r->ids[from];
+			if (r->newest[other] == s)
+				r->newest[other] = w;
+			r->ids[SLOT(r,w)] = other;
+		}
+	}
+
+	r->count -= removed;
+
+	if (id && removed) {
+		r->refs[id] = 1;
+		release (L, r, ud, id);
+	}
+
+	return removed;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: rb:clear() -- drops all entries
+ */
+int l_ringbuf_clear (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lrb_clear (L, r, 1);
+
+	if (r->log)
+		lrb_log_append (r, LRB_OP_CLEAR, NULL, 0);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: n = rb:remove(value) -- drops every entry equal to value, keeping
+ *      the order of the others; returns how many were dropped
+ */
+int l_ringbuf_remove (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	const char *data;
+	unsigned removed;
+	size_t len;
+	double n;
+
+	if (r->kind == LRB_NUMBERS) {
+		n = luaL_checknumber (L, 2);
+		data = (const char*)&n;
+		len = sizeof (n);
+	} else
+		data = luaL_checklstring (L, 2, &len);
+
+	removed = lrb_remove (L, r, 1, 2);
+
+	if (removed && r->log)
+		lrb_log_append (r, LRB_OP_REMOVE, data, len);
+
+	lua_pushinteger (L, removed);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: for v in rb:walk() do ... end          -- oldest to newest
+ *      for v in rb:walk_reverse() do ... end  -- newest to oldest
+ *
+ * Entries pushed while walking are not visited; once the walk falls
+ * behind the oldest entry it stops.
+ */
+static int walk_iter (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, lua_upvalueindex(1));
+	lua_Number pos = lua_tonumber (L, lua_upvalueindex(2));
+	lua_Number end = lua_tonumber (L, lua_upvalueindex(3));
+	unsigned long long s;
+
+	if (pos >= end || pos < (lua_Number)LOW(r))
+		return 0;
+
+	s = (unsigned long long)pos;
+	lua_pushnumber (L, pos + 1);
+	lua_replace (L, lua_upvalueindex(2));
+
+	lrb_push_entry (L, r, lua_upvalueindex(1), s);
+	return 1;
+}
+
+static int walk_reverse_iter (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, lua_upvalueindex(1));
+	lua_Number pos = lua_tonumber (L, lua_upvalueindex(2));
+	unsigned long long s;
+
+	if (pos < (lua_Number)LOW(r) || pos >= (lua_Number)r->head)
+		return 0;
+
+	s = (unsigned long long)pos;
+	lua_pushnumber (L, pos - 1);
+	lua_replace (L, lua_upvalueindex(2));
+
+	lrb_push_entry (L, r, lua_upvalueindex(1), s);
+	return 1;
+}
+
+int l_ringbuf_walk (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lua_pushvalue (L, 1);
+	lua_pushnumber (L, LOW(r));
+	lua_pushnumber (L, r->head);
+	lua_pushcclosure (L, walk_iter, 3);
+	return 1;
+}
+
+int l_ringbuf_walk_reverse (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lua_pushvalue (L, 1);
+	lua_pushnumber (L, (lua_Number)r->head - 1);
+	lua_pushcclosure (L, walk_reverse_iter, 2);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: for v in rb:walk_reverse_unique() do ... end
+ *
+ * Newest to oldest, skipping values already seen.  The iterator keeps no
+ * state of its own: each value is looked up to find where it is newest,
+ * and the walk carries on from there, so nothing is allocated.  For rings
+ * of strings that lookup is a table access, for numbers a scan.
+ */
+static int unique_iter (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	unsigned long long s;
+
+	if (lua_isnoneornil (L, 2))
+		s = r->head;
+	else if (!find_newest (L, r, 1, 2, &s))
+		return 0;
+
+	while (s-- > LOW(r)) {
+		if (is_newest (r, s)) {
+			lrb_push_entry (L, r, 1, s);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int l_ringbuf_walk_reverse_unique (lua_State *L)
+{
+	lrb_checkring (L, 1);
+
+	// the iterator is kept in the metatable, so we don't make a new one
+	lua_getmetatable (L, 1);
+	lua_getfield (L, -1, "__unique_iter");
+	lua_pushvalue (L, 1);
+	lua_pushnil (L);
+	return 3;
+}
+
+void lrb_init_unique_iter (lua_State *L)
+{
+	lua_pushcfunction (L, unique_iter);
+	lua_setfield (L, -2, "__unique_iter");
+}
+
+/* ------------------------------------------------------------------------
+ * lua: v = rb:min([n]) / v = rb:max([n]) / v = rb:mean([n])
+ *
+ * Of the newest n entries, all of them by default, in a ring of numbers;
+ * nil when it is empty.
+ */
+int l_ringbuf_min (lua_State *L)
+{
+	struct lrb_ring *r = check_numbers (L, 1);
+	double min, max, sum;
+
+	if (!window (r, luaL_optnumber (L, 2, -1), &min, &max, &sum)) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_pushnumber (L, min);
+	return 1;
+}
+
+int l_ringbuf_max (lua_State *L)
+{
+	struct lrb_ring *r = check_numbers (L, 1);
+	double min, max, sum;
+
+	if (!window (r, luaL_optnumber (L, 2, -1), &min, &max, &sum)) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_pushnumber (L, max);
+	return 1;
+}
+
+int l_ringbuf_mean (lua_State *L)
+{
+	struct lrb_ring *r = check_numbers (L, 1);
+	double min, max, sum;
+	unsigned count;
+
+	count = window (r, luaL_optnumber (L, 2, -1), &min, &max, &sum);
+	if (!count) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_pushnumber (L, sum / count);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: s = rb:render(chars [, lo [, hi [, pad]]])
+ *
+ * Draws a ring of numbers as a string, oldest first, one character per
+ * entry.  Values from lo to hi (by default the smallest and largest held)
+ * are spread evenly over chars, so ".oO" puts the bottom third at ".".
+ * If pad is given, it is repeated for each slot not yet used, so the
+ * result always has the same length.
+ */
+int l_ringbuf_render (lua_State *L)
+{
+	struct lrb_ring *r = check_numbers (L, 1);
+	size_t nchars, pad_len = 0;
+	const char *chars = luaL_checklstring (L, 2, &nchars);
+	const char *pad = luaL_optlstring (L, 5, NULL, &pad_len);
+	double lo, hi, sum;
+	unsigned long long s;
+	luaL_Buffer b;
+	unsigned i;
+
+	luaL_argcheck (L, nchars > 0, 2, "no characters to draw with");
+
+	window (r, -1, &lo, &hi, &sum);
+	lo = luaL_optnumber (L, 3, lo);
+	hi = luaL_optnumber (L, 4, hi);
+
+	luaL_buffinit (L, &b);
+
+	if (pad)
+		for (i = r->count; i < r->size; i++)
+			luaL_addlstring (&b, pad, pad_len);
+
+	for (s = LOW(r); s < r->head; s++) {
+		double v = r->num[SLOT(r,s)];
+		long c = 0;
+
+		if (hi > lo)
+			c = (long)((v - lo) / (hi - lo) * nchars);
+		if (c < 0)
+			c = 0;
+		if (c >= (long)nchars)
+			c = nchars - 1;
+
+		luaL_addchar (&b, chars[c]);
+	}
+
+	luaL_pushresult (&b);
+	return 1;
+}
@@ -0,0 +1,73 @@
+#ifndef __LUARINGBUF_INSTANCE_H__
+#define __LUARINGBUF_INSTANCE_H__
+
+#include <lua.h>
+
+#define L_RINGBUF_MT "ringbuf.ringbuf_mt"
+
+struct lrb_log;
+
+enum lrb_kind {
+	LRB_NUMBERS,
+	LRB_STRINGS,
+};
+
+/* the C representation of a ringbuf instance object
+ *
+ * Every push gets the next sequence number; the entries held are those
+ * numbered head-count .. head-1, and entry s lives in slot s % size.
+ * Strings are interned: a slot holds a small id, and the userdata's
+ * environment table maps ids to strings and strings to ids. */
+struct lrb_ring {
+	enum lrb_kind kind;
+	unsigned size;			// slots
+	unsigned count;			// slots in use
+	unsigned long long head;	// pushes so far, the newest is head-1
+
+	double *num;			// numbers, by slot
+	int *ids;			// strings: interned id, by slot
+	unsigned long long *newest;	// strings: newest entry, by id
+	unsigned *refs;			// strings: slots holding it, by id
+	int *free_ids;			// strings: ids not in use
+	unsigned nfree;
+
+	struct lrb_log *log;		// where changes are logged, or NULL
+};
+
+#define SLOT(r,s) ((unsigned)((s) % (r)->size))
+#define LOW(r) ((r)->head - (r)->count)
+
+extern struct lrb_ring *lrb_checkring (lua_State *L, int narg);
+
+extern struct lrb_ring *lrb_ring_new (lua_State *L, unsigned size,
+		enum lrb_kind kind);
+extern void lrb_init_unique_iter (lua_State *L);
+
+/* pushes entry s, which has to be one the ring holds */
+extern void lrb_push_entry (lua_State *L, struct lrb_ring *r, int ud,
+		unsigned long long s);
+
+/* change the ring at index ud, without logging the change */
+extern void lrb_push (lua_State *L, struct lrb_ring *r, int ud, int v);
+extern unsigned lrb_remove (lua_State *L, struct lrb_ring *r, int ud, int v);
+extern void lrb_clear (lua_State *L, struct lrb_ring *r, int ud);
+
+/* exported api */
+extern int l_ringbuf_tostring (lua_State *L);
+extern int l_ringbuf_push (lua_State *L);
+extern int l_ringbuf_get (lua_State *L);
+extern int l_ringbuf_newest (lua_State *L);
+extern int l_ringbuf_oldest (lua_State *L);
+extern int l_ringbuf_count (lua_State *L);
+extern int l_ringbuf_size (lua_State *L);
+extern int l_ringbuf_clear (lua_State *L);
+extern int l_ringbuf_remove (lua_State *L);
+extern int l_ringbuf_walk (lua_State *L);
+extern int l_ringbuf_walk_reverse (lua_State *L);
+extern int l_ringbuf_walk_reverse_unique (lua_State *L);
+extern int l_ringbuf_min (lua_State *L);
+extern int l_ringbuf_max (lua_State *L);
+extern int l_ringbuf_mean (lua_State *L);
+extern int l_ringbuf_render (lua_State *L);
+
+#endif // __LUARINGBUF_INSTANCE_H__
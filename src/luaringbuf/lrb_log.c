@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lrb_debug.h"
+#include "lrb_util.h"
+#include "lrb_instance.h"
+#include "lrb_log.h"
+
+
+/* ------------------------------------------------------------------------
+ * record encoding
+ */
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32 (const unsigned char *p, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+
+	if (!crc_table[1]) {
+		uint32_t i, j, c;
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static void put_u32 (unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_u32 (const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* numbers are stored as the little endian bits of the double */
+static void put_double (unsigned char *p, const void *d)
+{
+	uint64_t v;
+
+	memcpy (&v, d, sizeof (v));
+	put_u32 (p, v);
+	put_u32 (p + 4, v >> 32);
+}
+
+static double get_double (const unsigned char *p)
+{
+	uint64_t v = get_u32 (p) | (uint64_t)get_u32 (p + 4) << 32;
+	double d;
+
+	memcpy (&d, &v, sizeof (d));
+	return d;
+}
+
+static int write_all (int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t rc = write (fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+/* writes one record with a single write(2), so a crash leaves at most
+ * one torn record at the end; returns its size, or 0 with errno set */
+static size_t write_record (int fd, enum lrb_kind kind, enum lrb_log_op op,
+		const void *data, size_t len)
+{
+	unsigned char small[256], *rec = small;
+	size_t size = len + LRB_LOG_RECORD_OVERHEAD;
+	int rc;
+
+	if (size > sizeof (small)) {
+		rec = malloc (size);
+		if (!rec)
+			return 0;
+	}
+
+	put_u32 (rec, len);
+	rec[4] = op;
+	if (kind == LRB_NUMBERS && len)
+		put_double (rec + 5, data);
+	else if (len)
+		memcpy (rec + 5, data, len);
+	put_u32 (rec + 5 + len, crc32 (rec + 4, len + 1));
+
+	rc = write_all (fd, rec, size);
+
+	if (rec != small)
+		free (rec);
+
+	return rc ? 0 : size;
+}
+
+static int write_header (int fd, enum lrb_kind kind)
+{
+	unsigned char hdr[LRB_LOG_HEADER_SIZE] = { 0 };
+
+	memcpy (hdr, LRB_LOG_MAGIC, 4);
+	hdr[4] = LRB_LOG_VERSION;
+	hdr[5] = kind;
+
+	return write_all (fd, hdr, sizeof (hdr));
+}
+
+/* ------------------------------------------------------------------------
+ * logging changes
+ */
+
+void lrb_log_append (struct lrb_ring *r, enum lrb_log_op op,
+		const void *data, size_t len)
+{
+	struct lrb_log *log = r->log;
+	size_t size;
+
+	size = write_record (log->fd, r->kind, op, data, len);
+	if (!size) {
+		log->error = errno;
+		return;
+	}
+
+	log->bytes += size;
+	log->records ++;
+}
+
+void lrb_log_close (struct lrb_ring *r)
+{
+	struct lrb_log *log = r->log;
+
+	if (!log)
+		return;
+
+	close (log->fd);
+	free (log->path);
+	free (log);
+	r->log = NULL;
+}
+
+/* applies the records of a mapped log to the ring at index ud; returns
+ * where the last good record ends */
+static size_t replay (lua_State *L, struct lrb_ring *r, int ud,
+		const unsigned char *map, size_t size, unsigned long *records)
+{
+	size_t pos = LRB_LOG_HEADER_SIZE;
+
+	while (size - pos >= LRB_LOG_RECORD_OVERHEAD) {
+		const unsigned char *rec = map + pos;
+		size_t len = get_u32 (rec);
+		int op = rec[4];
+
+		if (len > size - pos - LRB_LOG_RECORD_OVERHEAD)
+			break;
+		if (crc32 (rec + 4, len + 1) != get_u32 (rec + 5 + len))
+			break;
+
+		if (op == LRB_OP_CLEAR) {
+			lrb_clear (L, r, ud);
+
+		} else if (op == LRB_OP_PUSH || op == LRB_OP_REMOVE) {
+			if (r->kind == LRB_NUMBERS) {
+				if (len != sizeof (double))
+					break;
+				lua_pushnumber (L, get_double (rec + 5));
+			} else
+				lua_pushlstring (L, (const char*)rec + 5, len);
+
+			if (op == LRB_OP_PUSH)
+				lrb_push (L, r, ud, lua_gettop (L));
+			else
+				lrb_remove (L, r, ud, lua_gettop (L));
+			lua_pop (L, 1);
+
+		} else
+			break;
+
+		pos += len + LRB_LOG_RECORD_OVERHEAD;
+		(*records) ++;
+	}
+
+	return pos;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: ok = rb:attach(path [, { compact_at = bytes }])
+ *
+ * Replays the log in path into the ring, which should be empty, and then
+ * appends every change made to the ring to it.  The log is created if it
+ * does not exist.  Records torn by a crash are cut off the end.  Appends
+ * are not synced; a log only ever loses its last few changes.
+ *
+ *    compact_at - log size past which compact(true) rewrites it
+ *                 (LRB_LOG_COMPACT_AT, 16k, by default)
+ */
+int l_ringbuf_attach (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	const char *path = luaL_checkstring (L, 2);
+	lua_Number compact_at = LRB_LOG_COMPACT_AT;
+	unsigned long records = 0;
+	struct lrb_log *log;
+	struct stat st;
+	size_t size, good, dropped = 0;
+	int fd;
+
+	luaL_argcheck (L, !r->log, 1, "already attached to a log");
+
+	if (lua_istable (L, 3)) {
+		lua_getfield (L, 3, "compact_at");
+		compact_at = luaL_optnumber (L, -1, compact_at);
+		lua_pop (L, 1);
+	}
+
+	DBGF("** ringbuf:attach (%s) **\n", path);
+
+	fd = open (path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0 || fstat (fd, &st) < 0) {
+		if (fd >= 0)
+			close (fd);
+		return lrb_pusherror (L, "could not open log");
+	}
+	size = st.st_size;
+
+	if (size < LRB_LOG_HEADER_SIZE) {
+		// new, or torn while it was being created
+		dropped = size;
+		if (ftruncate (fd, 0) < 0 || write_header (fd, r->kind) < 0) {
+			close (fd);
+			return lrb_pusherror (L, "could not write log");
+		}
+		good = LRB_LOG_HEADER_SIZE;
+
+	} else {
+		const unsigned char *map;
+
+		map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close (fd);
+			return lrb_pusherror (L, "could not map log");
+		}
+
+		if (memcmp (map, LRB_LOG_MAGIC, 4)
+				|| map[4] != LRB_LOG_VERSION
+				|| map[5] != r->kind) {
+			munmap ((void*)map, size);
+			close (fd);
+			errno = 0;
+			return lrb_pusherror (L, "not a log of this kind of ring");
+		}
+
+		good = replay (L, r, 1, map, size, &records);
+		munmap ((void*)map, size);
+
+		if (good < size) {
+			dropped = size - good;
+			if (ftruncate (fd, good) < 0) {
+				close (fd);
+				return lrb_pusherror (L, "could not truncate log");
+			}
+		}
+	}
+
+	log = (struct lrb_log*)calloc (1, sizeof (*log));
+	if (!log || !(log->path = strdup (path))) {
+		free (log);
+		close (fd);
+		return lrb_pusherror (L, "could not allocate log");
+	}
+
+	log->fd = fd;
+	log->bytes = good;
+	log->records = records;
+	log->compact_at = compact_at;
+	log->dropped = dropped;
+	r->log = log;
+
+	lua_pushboolean (L, 1);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: rb:detach() -- stops logging changes; also done when rb is collected
+ */
+int l_ringbuf_detach (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	lrb_log_close (r);
+	return 0;
+}
+
+int l_ringbuf_gc (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+
+	DBGF("** ringbuf:__gc (%p) **\n", r);
+
+	lrb_log_close (r);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * lua: done = rb:compact([if_needed])
+ *
+ * Rewrites the log to hold just the entries in the ring.  The new log is
+ * written next to the old one, synced and renamed over it, so a crash
+ * leaves one or the other.  With if_needed, only does so once the log has
+ * grown past compact_at, and returns false otherwise.
+ */
+static void sync_dir (const char *path)
+{
+	const char *slash = strrchr (path, '/');
+	char *dir;
+	int fd;
+
+	if (!slash)
+		dir = strdup (".");
+	else if (slash == path)
+		dir = strdup ("/");
+	else
+		dir = strndup (path, slash - path);
+	if (!dir)
+		return;
+
+	fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		fsync (fd);
+		close (fd);
+	}
+	free (dir);
+}
+
+int l_ringbuf_compact (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	struct lrb_log *log = r->log;
+	unsigned long long s;
+	const char *tmp;
+	size_t bytes = LRB_LOG_HEADER_SIZE, size;
+	int fd;
+
+	luaL_argcheck (L, log != NULL, 1, "not attached to a log");
+
+	if (lua_toboolean (L, 2) && log->bytes <= log->compact_at) {
+		lua_pushboolean (L, 0);
+		return 1;
+	}
+
+	DBGF("** ringbuf:compact (%s, %lu bytes) **\n", log->path,
+			(unsigned long)log->bytes);
+
+	tmp = lua_pushfstring (L, "%s.tmp", log->path);
+
+	fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return lrb_pusherror (L, "could not create log");
+
+	if (write_header (fd, r->kind) < 0)
+		goto failed;
+
+	for (s = r->head - r->count; s < r->head; s++) {
+		const void *data;
+		size_t len;
+		double n;
+
+		lrb_push_entry (L, r, 1, s);
+		if (r->kind == LRB_NUMBERS) {
+			n = lua_tonumber (L, -1);
+			data = &n;
+			len = sizeof (n);
+		} else
+			data = lua_tolstring (L, -1, &len);
+
+		size = write_record (fd, r->kind, LRB_OP_PUSH, data, len);
+		lua_pop (L, 1);
+		if (!size)
+			goto failed;
+		bytes += size;
+	}
+
+	if (fsync (fd) < 0 || rename (tmp, log->path) < 0)
+		goto failed;
+	sync_dir (log->path);
+
+	close (log->fd);
+	log->fd = fd;
+	log->bytes = bytes;
+	log->records = r->count;
+	log->error = 0;
+
+	lua_pushboolean (L, 1);
+	return 1;
+
+failed:
+	{
+		int err = errno;
+		close (fd);
+		unlink (tmp);
+		errno = err;
+	}
+	return lrb_pusherror (L, "could not write log");
+}
+
+/* ------------------------------------------------------------------------
+ * lua: stats = rb:log_stats() -- nil if the ring is not attached
+ *
+ *    stats.path        - the log file
+ *    stats.bytes       - its size
+ *    stats.records     - changes it holds
+ *    stats.compact_at  - size past which compact(true) rewrites it
+ *    stats.dropped     - bytes of torn records cut off when it was loaded
+ *    stats.error       - why the last append failed, if one did
+ */
+int l_ringbuf_log_stats (lua_State *L)
+{
+	struct lrb_ring *r = lrb_checkring (L, 1);
+	struct lrb_log *log = r->log;
+
+	if (!log) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_newtable (L);
+	lua_pushstring (L, log->path);
+	lua_setfield (L, -2, "path");
+	lua_pushnumber (L, log->bytes);
+	lua_setfield (L, -2, "bytes");
+	lua_pushnumber (L, log->records);
+	lua_setfield (L, -2, "records");
+	lua_pushnumber (L, log->compact_at);
+	lua_setfield (L, -2, "compact_at");
+	lua_pushnumber (L, log->dropped);
+	lua_setfield (L, -2, "dropped");
+	if (log->error) {
+		lua_pushstring (L, strerror (log->error));
+		lua_setfield (L, -2, "error");
+	}
+	return 1;
+}
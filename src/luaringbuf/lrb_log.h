@@ -0,0 +1,53 @@
+#ifndef __LUARINGBUF_LOG_H__
+#define __LUARINGBUF_LOG_H__
+
+#include <lua.h>
+
+struct lrb_ring;
+
+/* An append-only log of the changes made to a ring, so it can be rebuilt
+ * after a restart.  The file starts with an 8 byte header:
+ *
+ *     "WLRB", version, ring kind, 2 bytes zero
+ *
+ * followed by records, all numbers little endian:
+ *
+ *     u32 payload length, u8 op, payload, u32 crc32 of op and payload
+ *
+ * A record that is cut short or fails its crc ends the log; it is what a
+ * crash in the middle of an append leaves, and is truncated away. */
+#define LRB_LOG_MAGIC "WLRB"
+#define LRB_LOG_VERSION 1
+#define LRB_LOG_HEADER_SIZE 8
+#define LRB_LOG_RECORD_OVERHEAD 9
+
+#define LRB_LOG_COMPACT_AT 16384	// default log size that asks for compaction
+
+enum lrb_log_op {
+	LRB_OP_PUSH = 'P',		// payload is the value
+	LRB_OP_REMOVE = 'R',		// payload is the value
+	LRB_OP_CLEAR = 'C',		// no payload
+};
+
+struct lrb_log {
+	int fd;				// opened O_APPEND
+	char *path;
+	size_t bytes;			// size of the log file
+	unsigned long records;
+	size_t compact_at;		// compact once bytes grows past this
+	size_t dropped;			// bytes of torn records cut off on load
+	int error;			// errno of the last failed append, or 0
+};
+
+extern void lrb_log_append (struct lrb_ring *r, enum lrb_log_op op,
+		const void *data, size_t len);
+extern void lrb_log_close (struct lrb_ring *r);
+
+/* exported api */
+extern int l_ringbuf_attach (lua_State *L);
+extern int l_ringbuf_detach (lua_State *L);
+extern int l_ringbuf_compact (lua_State *L);
+extern int l_ringbuf_log_stats (lua_State *L);
+extern int l_ringbuf_gc (lua_State *L);
+
+#endif // __LUARINGBUF_LOG_H__
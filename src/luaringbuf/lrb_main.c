@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lcompat.h"
+#include "lrb_debug.h"
+#include "lrb_instance.h"
+#include "lrb_log.h"
+
+
+/* ------------------------------------------------------------------------
+ * lua: rb = ringbuf.new(size [, kind]) -- create a new ring buffer
+ *
+ *    size - entries it holds before the oldest are dropped
+ *    kind - "number" (the default) or "string"
+ */
+static int l_new (lua_State *L)
+{
+	static const char *kinds[] = { "number", "string", NULL };
+	lua_Integer size;
+	int kind;
+
+	size = luaL_checkinteger (L, 1);
+	kind = luaL_checkoption (L, 2, "number", kinds);
+	luaL_argcheck (L, size > 0, 1, "size must be positive");
+
+	DBGF("** ringbuf.new (%d, %s) **\n", (int)size, kinds[kind]);
+
+	lrb_ring_new (L, size, kind ? LRB_STRINGS : LRB_NUMBERS);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * the class method table 
+ */
+static const luaL_reg class_table[] =
+{
+	{ "new",		l_new },
+	
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the instance method table 
+ */
+static const luaL_reg instance_table[] =
+{
+	{ "__tostring",		l_ringbuf_tostring },
+	{ "__len",		l_ringbuf_count },
+	{ "__gc",		l_ringbuf_gc },
+
+	{ "push",		l_ringbuf_push },
+	{ "add",		l_ringbuf_push },
+	{ "get",		l_ringbuf_get },
+	{ "newest",		l_ringbuf_newest },
+	{ "oldest",		l_ringbuf_oldest },
+	{ "count",		l_ringbuf_count },
+	{ "size",		l_ringbuf_size },
+	{ "clear",		l_ringbuf_clear },
+	{ "remove",		l_ringbuf_remove },
+
+	{ "walk",		l_ringbuf_walk },
+	{ "walk_reverse",	l_ringbuf_walk_reverse },
+	{ "walk_reverse_unique",l_ringbuf_walk_reverse_unique },
+
+	{ "min",		l_ringbuf_min },
+	{ "max",		l_ringbuf_max },
+	{ "mean",		l_ringbuf_mean },
+	{ "render",		l_ringbuf_render },
+
+	{ "attach",		l_ringbuf_attach },
+	{ "detach",		l_ringbuf_detach },
+	{ "compact",		l_ringbuf_compact },
+	{ "log_stats",		l_ringbuf_log_stats },
+
+	{ NULL,			NULL },
+};
+
+/* ------------------------------------------------------------------------
+ * the class metatable
+ */
+static int lrb_init_ringbuf_class (lua_State *L)
+{
+	luaL_newmetatable(L, L_RINGBUF_MT);
+
+	// setup the __index and __gc field
+	lua_pushstring (L, "__index");
+	lua_pushvalue (L, -2);		// pushes the new metatable
+	lua_settable (L, -3);		// metatable.__index = metatable
+
+	luaL_openlib (L, NULL, instance_table, 0);
+	lrb_init_unique_iter (L);
+
+	luaL_openlib (L, "ringbuf", class_table, 0);
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * library entry
+ */
+LUALIB_API int luaopen_ringbuf (lua_State *L)
+{
+	return lrb_init_ringbuf_class (L);
+}
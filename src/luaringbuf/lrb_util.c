@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "lrb_util.h"
+
+
+/* ------------------------------------------------------------------------
+ * error helper
+ */
+int lrb_pusherror(lua_State *L, const char *info)
+{
+	lua_pushnil(L);
+	if (info==NULL) {
+		lua_pushstring(L, strerror(errno));
+		lua_pushnumber(L, errno);
+		return 3;
+	} else if (errno) {
+		lua_pushfstring(L, "%s: %s", info, strerror(errno));
+		lua_pushnumber(L, errno);
+		return 3;
+	} else {
+		lua_pushfstring(L, "%s", info);
+		return 2;
+	}
+}
+
@@ -0,0 +1,8 @@
+#ifndef __LUARINGBUF_UTIL_H__
+#define __LUARINGBUF_UTIL_H__
+
+#include <lua.h>
+
+extern int lrb_pusherror(lua_State *L, const char *info);
+
+#endif // __LUARINGBUF_UTIL_H__
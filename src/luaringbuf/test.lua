@@ -0,0 +1,73 @@
+#!/usr/bin/env lua
+
+require "ringbuf"
+
+local function list (rb, walk)
+        local t = {}
+        for v in rb[walk] (rb) do
+                t[#t+1] = tostring(v)
+        end
+        return table.concat (t, " ")
+end
+
+print ("ring of strings...")
+local h = ringbuf.new (5, "string")
+for _, v in ipairs { "xterm", "firefox", "xterm", "gimp", "vim", "xterm", "mutt" } do
+        h:push (v)
+end
+print ("  " .. tostring(h) .. ", #h = " .. #h)
+print ("  oldest " .. h:oldest () .. ", newest " .. h:newest ()
+        .. ", get(1) " .. h:get (1) .. ", get(-2) " .. h:get (-2))
+print ("  walk:           " .. list (h, "walk"))
+print ("  walk_reverse:   " .. list (h, "walk_reverse"))
+print ("  reverse unique: " .. list (h, "walk_reverse_unique"))
+
+print ("removing...")
+print ("  removed " .. h:remove ("xterm") .. " xterm, " .. h:remove ("nothing") .. " nothing")
+print ("  walk:           " .. list (h, "walk"))
+h:push ("gimp")
+print ("  reverse unique: " .. list (h, "walk_reverse_unique"))
+h:clear ()
+print ("  cleared: " .. tostring(h) .. ", newest " .. tostring(h:newest ()))
+
+print ("ring of numbers...")
+local n = ringbuf.new (8)
+for i = 1, 12 do
+        n:push (i % 5)
+end
+print ("  walk:           " .. list (n, "walk"))
+print ("  reverse unique: " .. list (n, "walk_reverse_unique"))
+print (string.format ("  all: min %s max %s mean %s", n:min (), n:max (), n:mean ()))
+print (string.format ("  newest 3: min %s max %s mean %s", n:min (3), n:max (3), n:mean (3)))
+print ("  render: '" .. n:render (".oO", 0, 4) .. "'")
+local g = ringbuf.new (10)
+g:push (0) g:push (0.5) g:push (1)
+print ("  padded: '" .. g:render (".oO", 0, 1, "_") .. "'")
+print ("  empty: " .. tostring(ringbuf.new (3):mean ()))
+
+print ("logging to a file...")
+local path = os.tmpname ()
+os.remove (path)
+local l = ringbuf.new (4, "string")
+print ("  attach: " .. tostring(l:attach (path, { compact_at = 64 })))
+for _, v in ipairs { "a", "b", "c", "a", "d", "e" } do
+        l:push (v)
+end
+l:remove ("a")
+local st = l:log_stats ()
+print (string.format ("  %d records, %d bytes", st.records, st.bytes))
+l:detach ()
+local again = ringbuf.new (4, "string")
+again:attach (path, { compact_at = 64 })
+print ("  replayed: " .. list (again, "walk"))
+print ("  compact: " .. tostring(again:compact (true)))
+st = again:log_stats ()
+print (string.format ("  %d records, %d bytes", st.records, st.bytes))
+again:detach ()
+os.remove (path)
+
+print ("errors...")
+print ("  " .. select (2, pcall (ringbuf.new, 0)))
+print ("  " .. select (2, pcall (h.mean, h)))
+
+print ("finished!")
@@ -39,7 +39,9 @@ Defaults to ""
 
 =item battery.poll_rate
 
-Time in seconds to wait between checks for battery status.
+Time in seconds to wait between checks for battery status.  The checks
+are lined up with the wall clock, at multiples of this since midnight, so
+they happen together with other timers' updates.
 
 Defaults to 30
 
@@ -152,6 +154,7 @@ local wmii   = require("wmii")
 local io     = require("io")
 local os     = require("os")
 local string = require("string")
+local math   = require("math")
 local posix  = require("posix")
 local type   = type
 local tostring = tostring
@@ -207,6 +210,13 @@ local function read_sys_number(file)
         return ret
 end
 
+-- run a low/critical action, it is a shell command line
+local function run_action (cmd)
+        if type(cmd) == "string" and cmd:match("%S") then
+                wmii.launch { argv = { "/bin/sh", "-c", cmd } }
+        end
+end
+
 -- The actual work performed here.
 -- parses info, state file and preps for display
 local function update_single_battery ( name )
@@ -252,7 +262,7 @@ local function update_single_battery ( name )
 	if batt_percent <= critical then
 		if batt_status == "Discharging" and not battery["warned_crit"] then
 			wmii.log("Warning about critical battery.")
-			os.execute(wmii.get_conf("battmon.critical_action"), "&")
+			run_action(wmii.get_conf("battery.critical_action"))
 			battery["warned_crit"] = true
 		end
 		colors = string.gsub(colors, "^%S+ %S+",
@@ -263,7 +273,7 @@ local function update_single_battery ( name )
 	elseif batt_percent <= low then
 		if batt_status == "Discharging" and not battery["warned_low"] then
 			wmii.log("Warning about low battery.")
-			os.execute(wmii.get_conf("battmon.low_action"), "&")
+			run_action(wmii.get_conf("battery.low_action"))
 			battery["warned_low"] = true
 		end
 		colors = string.gsub(colors, "^%S+ %S+",
@@ -304,7 +314,7 @@ local function update_single_battery ( name )
                 else
                         hours = batt_energy_now / batt_current_now
                 end
-                printout = printout .. string.format("%d:%0.2d ", hours, (hours*60) % 60)
+                printout = printout .. string.format("%d:%0.2d ", math.floor(hours), math.floor(hours*60) % 60)
 	end
 
 	printout = printout .. '(' .. batt_state .. string.format("%.0f", batt_percent) .. batt_state .. ')'
@@ -333,7 +343,8 @@ local function update_batt_data (time_since_update)
                 end
         end
 
-	return wmii.get_conf("battery.poll_rate")
+	-- on the wall clock, so it wakes up together with the clock
+	return { every = wmii.get_conf("battery.poll_rate") }
 end
 
 
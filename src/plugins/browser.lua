@@ -15,40 +15,47 @@ local type = type
 module ("browser")
 api_version=0.1
 
--- configuration defaults
+-- loaded when one of the actions is first used
+--@lazy action browser
+--@lazy action google
 
-wmii.set_conf ("browser", "firefox")
+-- configuration defaults, wmiirc may have set them already
+
+if not wmii.get_conf ("browser") then
+        wmii.set_conf ("browser", "firefox")
+end
 
 -- new handlers
 
-wmii.add_action_handler ("browser", function (act, args)
-        local url = ""
-        if type(args) == "string" then
-                -- create an quoted string, with quotes in the argument escaped
-                url = args:gsub("^%s*",""):gsub("%s*$","")
-                url = "'" .. url:gsub("'", "\\'") .. "'"
+-- the argument, or the X selection when there is none
+local function get_text (args)
+        local text
+        if type(args) == "string" and args:match("%S") then
+                text = args
         else
-                -- TODO: need to escape this
-                url = '"`xclip -o`"'
+                text = wmii.capture ("xclip -o") or ""
+        end
+        return (text:gsub("^%s*",""):gsub("%s*$",""))
+end
+
+-- the browser setting may carry options, "firefox -new-tab"
+local function browse (url)
+        local argv = {}
+        local w
+        for w in (wmii.get_conf ("browser") or "x-www-browser"):gmatch("%S+") do
+                argv[#argv+1] = w
         end
-        local browser = wmii.get_conf ("browser") or "x-www-browser"
-        local cmd = browser .. " " .. url .. " &"
-        wmii.log ("    executing: " .. cmd)
-        os.execute (cmd)
+        argv[#argv+1] = url
+        wmii.launch { argv = argv }
+end
+
+wmii.add_action_handler ("browser", function (act, args)
+        browse (get_text (args))
 end)
 
 wmii.add_action_handler ("google", function (act, args)
-        local search = ""
-        if type(args) == "string" then
-                -- create an quoted string, with quotes in the argument escaped
-                search = args:gsub("^%s*",""):gsub("%s*$","")
-                search = search:gsub("'", "\\'")
-        else
-                -- TODO: need to escape this
-                search = '`xclip -o`'
-        end
-        local browser = wmii.get_conf ("browser") or "x-www-browser"
-        local cmd = browser .. " \"http://google.com/search?q=" .. search .. "\" &"
-        wmii.log ("    executing: " .. cmd)
-        os.execute (cmd)
+        local search = get_text (args):gsub("[^%w%-_%.~ ]", function (c)
+                return string.format ("%%%02X", c:byte())
+        end):gsub(" ", "+")
+        browse ("http://google.com/search?q=" .. search)
 end)
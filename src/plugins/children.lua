@@ -0,0 +1,114 @@
+--[[
+=pod
+
+=head1 NAME
+
+children.lua - wmiirc-lua plugin showing the busiest programs wmii started
+
+=head1 SYNOPSIS
+
+    -- in your wmiirc.lua:
+    wmii.load_plugin("children")
+
+    -- optionally
+    wmii.set_conf ("children.count", 3)
+    wmii.set_conf ("children.interval", 5)
+
+=head1 DESCRIPTION
+
+Shows the programs started by wmiirc, through launch() or add_exec(),
+that used the most CPU time over the last interval, along with their
+resident memory.  The numbers come from wmii.children(), which reads
+/proc or the programs' cgroups; see I<exec_cgroup> in L<wmii.lua>.
+
+=head1 SEE ALSO
+
+L<wmii(1)>, L<lua(1)>
+
+=head1 LICENCE AND COPYRIGHT
+
+This is free software.  You may redistribute copies of it under the terms of
+the GNU General Public License L<http://www.gnu.org/licenses/gpl.html>.  There
+is NO WARRANTY, to the extent permitted by law.
+
+=cut
+--]]
+
+local wmii = require("wmii")
+local eventloop = require("eventloop")
+local math = require("math")
+local string = require("string")
+local table = require("table")
+local ipairs = ipairs
+local tonumber = tonumber
+
+module("children")
+api_version = 0.1
+
+if not wmii.get_conf ("children.count") then
+        wmii.set_conf ("children.count", 3)
+end
+if not wmii.get_conf ("children.interval") then
+        wmii.set_conf ("children.interval", 5)
+end
+
+-- ------------------------------------------------------------
+-- MODULE VARIABLES
+local widget = wmii.widget:new ("850_children")
+local last_cpu = {}             -- cpu seconds at the last update, by pid
+local last_time = nil
+
+local function short_name (name)
+        local prog = name:match ("^(%S+)") or name
+        return prog:match ("([^/]+)$") or prog
+end
+
+local function human_kb (kb)
+        if kb >= 1024 * 1024 then
+                return string.format ("%.1fG", kb / 1024 / 1024)
+        elseif kb >= 1024 then
+                return string.format ("%dM", math.floor (kb / 1024))
+        end
+        return string.format ("%dk", kb)
+end
+
+local function children_timer ()
+        local now = eventloop.now ()
+        local elapsed = last_time and (now - last_time) or 0
+        local list = wmii.children ()
+        local cpu = {}
+        local top = {}
+
+        last_time = now
+
+        for _, c in ipairs (list) do
+                if c.running then
+                        cpu[c.pid] = c.cpu
+                        local prev = last_cpu[c.pid]
+                        if prev and elapsed > 0 then
+                                top[#top+1] = { name = short_name (c.name),
+                                                pct = (c.cpu - prev) * 100 / elapsed,
+                                                rss = c.rss }
+                        end
+                end
+        end
+        last_cpu = cpu
+
+        table.sort (top, function (a, b) return a.pct > b.pct end)
+
+        local count = tonumber (wmii.get_conf ("children.count")) or 3
+        local t = {}
+        for i, e in ipairs (top) do
+                if i > count or e.pct < 1 then
+                        break
+                end
+                t[#t+1] = string.format ("%s %d%% %s", e.name,
+                                         math.floor (e.pct + 0.5), human_kb (e.rss))
+        end
+
+        widget:show (#t > 0 and table.concat (t, " | ") or nil)
+
+        return tonumber (wmii.get_conf ("children.interval")) or 5
+end
+
+local timer = wmii.timer:new (children_timer, 1)
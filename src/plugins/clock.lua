@@ -5,6 +5,7 @@
 --
 local wmii = require("wmii")
 local os = require("os")
+local tonumber = tonumber
 
 module("clock")         -- module name
 api_version=0.1         -- api version, see doc/plugin-api
@@ -14,14 +15,14 @@ api_version=0.1         -- api version, see doc/plugin-api
 --
 -- these can be overridden by wmiirc
 
-wmii.set_conf ("clock.update", 1)
+wmii.set_conf ("clock.update", 0)      -- seconds, 0 to go by the format
 wmii.set_conf ("clock.format", "%Y/%m/%d %H:%M:%S")
 
 -- ------------------------------------------------------------
 -- MODULE VARIABLES
 
 local widget = nil       -- the display on the bar
-local timer = nil       -- the 1/second tick timer
+local timer = nil       -- the tick timer, on the wall clock
 
 -- ------------------------------------------------------------
 -- THE TIMER WIDGET
@@ -37,7 +38,7 @@ local xmessagebox = "xmessage -center -buttons quit:0 -default quit -file -"
 local function button_handler (ev, button)
 	-- 3 is right button
 	if button == 3 then
-		os.execute("ncal -y | wmiisetsid " .. xmessagebox .. "&")
+		wmii.launch { argv = { "/bin/sh", "-c", "ncal -y | " .. xmessagebox } }
 	end
 end
 
@@ -51,15 +52,32 @@ widget:add_event_handler("RightBarClick", button_handler)
 -- The timer function will be called every X seconds.  If the 
 -- timer function returns a number 
 
+-- how often the format changes: every second if it shows seconds,
+-- otherwise every minute
+local function clock_schedule (fmt)
+        local every = tonumber (wmii.get_conf("clock.update")) or 0
+        if every <= 0 then
+                every = 60
+                local c
+                for c in fmt:gmatch ("%%(.)") do
+                        if c:find ("[ScrsTX+]") then
+                                every = 1
+                        end
+                end
+        end
+        return { every = every }
+end
+
 local function clock_timer (time_since_update)
         local fmt = wmii.get_conf("clock.format") or "%c"
         widget:show (os.date(fmt))
 
-        -- returning a positive number of seconds before next wakeup, or
-        -- nil (or no return at all) repeats the last schedule, or
-        -- -1 to stop the timer
-        return 1
+        -- returning a number of seconds or a schedule before the next
+        -- wakeup, or nil (or no return at all) repeats the last schedule,
+        -- or -1 to stop the timer; the schedule is on the wall clock, so
+        -- the display changes right as the time does
+        return clock_schedule (fmt)
 end
 
-local timer = wmii.timer:new (clock_timer, 1)
+local timer = wmii.timer:new (clock_timer, { every = 1 })
 
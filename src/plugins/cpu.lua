@@ -3,16 +3,25 @@
 
 =head1 NAME
 
-cpu.lua - wmiirc-lua plugin for monitoring acpi stuff
+cpu.lua - wmiirc-lua plugin for monitoring cpu frequency and load
 
 =head1 SYNOPSIS
 
     -- in your wmiirc.lua:
     wmii.load_plugin("cpu")
 
+    -- one segment per package, however many cpus there are
+    wmii.set_conf("cpu.grouping", "package")
+
 
 =head1 DESCRIPTION
 
+Shows the frequency, governor and load of the cpus.  On machines with more
+than a few cpus they are grouped by cluster or package, each group showing
+the lowest, median and highest frequency of its cpus, their mean load, and
+a heat map of the load of each of its cpus (or of a run of them, on big
+machines), so the bar stays the same width whatever the core count.
+
 =head1 SEE ALSO
 
 L<wmii(1)>, L<lua(1)>
@@ -33,101 +42,109 @@ is NO WARRANTY, to the extent permitted by law.
 --]]
 
 local wmii = require("wmii")
+local cpustat = require("cpustat")
 local os = require("os")
-local posix = require("posix")
-local io = require("io")
-local type = type
-local error = error
-local pairs = pairs
+local string = require("string")
+local table = require("table")
+local ipairs = ipairs
 local tostring = tostring
 
 module("cpu")
 api_version = 0.1
 
+-- ------------------------------------------------------------
+-- CPU CONFIGURATION VARIABLES
+--
+-- these can be overridden by wmiirc
+
+-- "cpu", "cluster", "package" or "all"; "auto" shows each cpu while there
+-- are few of them, and groups them by topology on bigger machines
+wmii.set_conf ("cpu.grouping", "auto")
+wmii.set_conf ("cpu.max_groups", 4)    -- segments on the bar, for "auto"
+wmii.set_conf ("cpu.heat_width", 8)    -- cells in a group's heat map
+wmii.set_conf ("cpu.rescan", 300)      -- seconds, finds hotplugged cpus
+
 -- ------------------------------------------------------------
 -- MODULE VARIABLES
 local widget = nil
 local timer  = nil
+local sampler = nil
+local scanned = 0       -- when the sampler last looked for cpus
 
 widget = wmii.widget:new ("400_cpu")
 
-local function cpu_list()
-        local dir = "/sys/devices/system/cpu/"
-        local _,cpu
-        local list = {}
-        for _,cpu in pairs(posix.glob(dir .. 'cpu[0-9]*')) do
-                local stat
-                if cpu then
-                        stat = posix.stat(cpu)
-                        if stat and stat.type == 'directory' then
-                                list[#list+1] = cpu
-                        end
+-- one sampler reads all the cpus, opening no files as it does
+local function get_sampler()
+        local grouping = wmii.get_conf("cpu.grouping")
+        if not sampler or sampler.grouping ~= grouping then
+                local s, err = cpustat.new {
+                        grouping   = grouping,
+                        max_groups = wmii.get_conf("cpu.max_groups"),
+                        heat_width = wmii.get_conf("cpu.heat_width"),
+                }
+                if not s then
+                        wmii.log("cpu: " .. tostring(err))
+                        return nil
                 end
+                sampler = { s = s, grouping = grouping }
+                scanned = os.time()
         end
-        return list
+        return sampler.s
 end
 
-
-function read_file(path)
-      local fd = io.open(path, "r")
-      if fd == nil then
-              return nil
-      end
-
-      local text = fd:read("*a")
-       fd:close()
-
-       if type(text) == 'string' then
-               text = text:match('(%w+)')
-       end
-
-      return text
+-- a group's summary, the same width however many cpus it has:
+--   P0 1200/1800/2400MHz schedutil  37% [ .:-=+*#]
+-- or for a group of one
+--   cpu0 1800MHz schedutil  37%
+local function create_string(g)
+        local txt = g.name
+        if g.freq_median then
+                if g.cpus > 1 then
+                        txt = txt .. string.format(" %.0f/%.0f/%.0fMHz",
+                                g.freq_min, g.freq_median, g.freq_max)
+                else
+                        txt = txt .. string.format(" %.0fMHz", g.freq_median)
+                end
+        end
+        if g.governor then
+                txt = txt .. " " .. g.governor
+        end
+        if g.util_mean then
+                txt = txt .. string.format(" %3.0f%%", g.util_mean * 100)
+        else
+                txt = txt .. " off"
+        end
+        if g.cpus > 1 then
+                txt = txt .. " [" .. g.heat .. "]"
+        end
+        return txt
 end
 
 
-local function create_string(cpu)
-       local govfile = cpu .. '/cpufreq/scaling_governor'
-       local gov = read_file(govfile) or ""
-
-       local frqfile = cpu .. '/cpufreq/scaling_cur_freq'
-       local frq = read_file(frqfile) or ""
-
-       if type(frq) == 'string' then
-               local mhz = frq:match('(.*)000')
-               if mhz then
-                       frq = mhz .. " MHz"
-               else
-                       frq = frq .. "kHz"
-               end
-       else
-               frq = ""
-       end
+function update ( new_vol )
+        local s = get_sampler()
+        if not s then
+                return
+        end
 
-      return frq .. "(" .. gov .. ")" 
-end
+        if os.time() - scanned >= wmii.get_conf("cpu.rescan") then
+                s:rescan()
+                scanned = os.time()
+        end
 
+        local groups = s:sample()
+        local list = {}
+        local _, g
+        for _, g in ipairs(groups or {}) do
+                list[#list+1] = create_string(g)
+        end
 
-function update ( new_vol )
-       local txt = ""
-       local _, cpu
-       local list = cpu_list()
-	   local space = ""
-       for _,cpu in pairs(list) do
-		   local str = create_string(cpu)
-		   if txt == str then
-			   txt = "2x " .. txt
-		   else
-               txt = txt .. create_string(cpu) .. space
-		   end
-		   space = " "
-       end
-
-	widget:show(txt)
+        widget:show(table.concat(list, " "))
 end
 
 local function cpu_timer ( timer )
-	update(0)
-    return 10
+        update(0)
+        return 10
 end
 
 timer = wmii.timer:new (cpu_timer, 1)
@@ -13,6 +13,10 @@ cpugraph.lua - wmiirc-lua plugin for monitoring cpu frequency
 
 =head1 DESCRIPTION
 
+Graphs the frequency of the cpus over the last few updates.  On machines
+with more than a few cpus there is a graph for each cluster or package,
+following the median frequency of its cpus; see cpu.lua for the grouping.
+
 =head1 SEE ALSO
 
 L<wmii(1)>, L<lua(1)>
@@ -35,111 +39,100 @@ is NO WARRANTY, to the extent permitted by law.
 --]]
 
 local wmii = require("wmii")
+local ringbuf = require("ringbuf")
+local cpustat = require("cpustat")
 local os = require("os")
-local posix = require("posix")
-local io = require("io")
-local string = require("string")
-local type = type
-local error = error
-local pairs = pairs
 local tostring = tostring
+local ipairs = ipairs
 
 module("cpugraph")
 api_version = 0.1
 
+-- ------------------------------------------------------------
+-- CPUGRAPH CONFIGURATION VARIABLES
+--
+-- these can be overridden by wmiirc
+
+-- as cpu.grouping: a graph for each cpu while there are few of them, and
+-- for each cluster or package of them on bigger machines
+wmii.set_conf ("cpugraph.grouping", "auto")
+wmii.set_conf ("cpugraph.max_groups", 4)
+wmii.set_conf ("cpugraph.rescan", 300)  -- seconds, finds hotplugged cpus
+
 -- ------------------------------------------------------------
 -- MODULE VARIABLES
 local widget = nil
 local timer  = nil
+local sampler = nil
+local scanned = 0
 
 widget = wmii.widget:new ("400_cpugraph")
 
--- used to remember the cpu speeds from past intervals
+-- used to remember the cpu speeds from past intervals, by group, as a
+-- fraction of the range the group can run at
 history = { }
-
--- ------------------------------------------------------------
--- looks into /sys/devices/system/cpu and gets a list of all 
--- 	cpus in the system.. returns it as a list
-local function cpu_list()
-	local dir = "/sys/devices/system/cpu/"
-	local _,cpu
-	local list = {}
-	for _,cpu in pairs(posix.glob(dir .. 'cpu[0-9]*')) do
-		local stat
-		if cpu then
-			stat = posix.stat(cpu)
-			if stat and stat.type == 'directory' then
-				list[#list+1] = cpu
-			end
-		end
-	end
-	return list
-end
-
--- ------------------------------------------------------------------
--- read a file, return the first line
-local function read_sys_line(file, fmt)
-	local ret = nil
-	local fd = io.open(file)
-	if fd then
-		ret = fd:read(fmt or "*l")
-	end
-	return ret
-end
-
+local history_len = 10
 
 -- ------------------------------------------------------------------
--- read a file and return the first line as a number
-local function read_sys_number(file)
-	local ret = read_sys_line(file, "*n")
-	if type(ret) ~= type(1) then
-		ret = 0
+-- one sampler reads all the cpus, opening no files as it does
+local function get_sampler()
+	local grouping = wmii.get_conf("cpugraph.grouping")
+	if not sampler or sampler.grouping ~= grouping then
+		local s, err = cpustat.new {
+			grouping   = grouping,
+			max_groups = wmii.get_conf("cpugraph.max_groups"),
+		}
+		if not s then
+			wmii.log("cpugraph: " .. tostring(err))
+			return nil
+		end
+		sampler = { s = s, grouping = grouping }
+		scanned = os.time()
+		history = { }
 	end
-	return ret
+	return sampler.s
 end
 
 
 -- ------------------------------------------------------------------
--- create a string describing the cpu speed for the last 10 intervals
-local function create_string(cpu)
-
-	-- read all the info we need and define other vars
-	local curfreq = read_sys_number(cpu .. '/cpufreq/scaling_cur_freq')
-	local minfreq = read_sys_number(cpu .. '/cpufreq/scaling_min_freq')
-	local maxfreq = read_sys_number(cpu .. '/cpufreq/scaling_max_freq')
-	local freqsym = " "
-	local cpuname = string.gsub(cpu, ".*/", "")
-
-	-- figure out how big each frequency division is
-	local increment = (maxfreq - minfreq) / 3
-
-	-- figure out what symbol to use.. we split the bar into 3
-	if (curfreq <= minfreq + increment) then
-		freqsym = "."
-	elseif (curfreq <= (minfreq + 2*increment)) then
-		freqsym = "o"
-	else 
-		freqsym = "O"
+-- create a string describing the speed of a group for the last 10
+-- intervals, going by the median of its cpus
+local function create_string(g)
+	local hist = history[g.name]
+
+	if not hist then
+		hist = ringbuf.new(history_len)
+		history[g.name] = hist
 	end
 
-	-- now shift over the history if needed and glue on this char
-	history[cpuname] = string.sub(history[cpuname], 2, -1)
-	history[cpuname] = history[cpuname] .. freqsym
+	-- the oldest value drops out once the ring is full
+	local range = (g.freq_hi or 0) - (g.freq_lo or 0)
+	hist:push(range > 0 and g.freq_median
+		and (g.freq_median - g.freq_lo) / range or 0)
 
-	-- now that we are done, return it
-	return history[cpuname]
+	-- we split the bar into 3, and pad intervals not seen yet
+	return hist:render(".oO", 0, 1, "_")
 end
 
 
 -- ------------------------------------------------------------------
 -- update our plugin's display widgets
 function update ()
+	local s = get_sampler()
+	if not s then
+		return
+	end
+
+	if os.time() - scanned >= wmii.get_conf("cpugraph.rescan") then
+		s:rescan()
+		scanned = os.time()
+	end
+
 	local txt = ""
-	local _, cpu
-	local list = cpu_list()
+	local _, g
 	local space = ""
-	for _,cpu in pairs(list) do
-		txt = txt .. space .. create_string(cpu)
+	for _,g in ipairs(s:sample() or {}) do
+		txt = txt .. space .. create_string(g)
 		space = "   "
 	end
 
@@ -156,22 +149,6 @@ end
 
 
 -- ------------------------------------------------------------------
--- initialize our cpu speed history var for each cpu in system
-local function init_history ()
-	local txt = ""
-	local _, cpu
-	local list = cpu_list()
-	local space = ""
-	for _,cpu in pairs(list) do
-		local cpuname = string.gsub(cpu, ".*/", "")
-		history[cpuname] = string.rep("_", 10)
-	end
-end
-
--- ------------------------------------------------------------------
-
--- initialize the values in our history var for all the cpus we have
-init_history()
 
 -- now setup our timer to call the update function
 timer = wmii.timer:new (cpugraph_timer, 2)
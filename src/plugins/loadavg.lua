@@ -47,7 +47,9 @@ local function loadavg_timer (time_since_update)
 			local current_avg = tonumber(one)
 			if type(current_avg) == "number" then
 				local index  = math.min(math.floor(current_avg * (#palette-1)) + 1, #palette)
-				local normal = wmii.get_ctl("normcolors")
+				-- the bar's colours are cached, /ctl is not
+				-- read on every tick
+				local normal = wmii.palette().normcolors
 				colors = string.gsub(normal, "^%S+", palette[index], 1)
 			end
 		end
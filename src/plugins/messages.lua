@@ -23,6 +23,9 @@ local tostring = tostring
 module ("messages")
 api_version=0.1
 
+-- the widget shows up with the first message
+--@lazy event msg
+
 -- local variables
 local color_index = 0
 local colors = {}
@@ -60,9 +60,7 @@ local function _command ( cmd )
 
 	if (cmd) then
 		wmii.log( "about to run " .. cmd)
-		local file = io.popen( cmd)
-		local status = file:read("*a")
-		file:close()
+		local status = wmii.capture( cmd ) or ""
 
 		return status
 		--return status:match("[^\n]*")
@@ -0,0 +1,203 @@
+--[[
+=pod
+
+=head1 NAME
+
+pressure.lua - wmiirc-lua plugin showing cpu, memory and io pressure
+
+=head1 SYNOPSIS
+
+    -- in your wmiirc
+    wmii.load_plugin("pressure")
+
+    -- to configure (after loading plugin)
+    wmii.set_conf("pressure.resources", "cpu,memory")
+    wmii.set_conf("pressure.trigger", "some 200000 2000000")
+    pressure.setup()
+
+=head1 DESCRIPTION
+
+Shows how much of the last 10 seconds tasks spent waiting for the cpu,
+for memory and for io, from the kernel's pressure stall information, and
+colours the widget by the worst of them.
+
+Rather than reading the numbers every few seconds the plugin leaves a
+trigger with the kernel, which wakes wmiirc up as soon as tasks stall for
+longer than it allows.  The widget then follows the pressure until it has
+died down, and costs nothing while the machine is calm.  Kernels that
+will not take the trigger are polled instead.
+
+=head1 CONFIGURATION AND ENVIRONMENT
+
+=over 4
+
+=item pressure.resources
+
+A comma-separated list of "cpu", "memory" and "io", or paths of cgroup
+pressure files such as /sys/fs/cgroup/user.slice/cpu.pressure.
+
+Defaults to "cpu,memory,io"
+
+=item pressure.trigger
+
+When to wake up: "some <stall> <window>" in microseconds.  The window
+should be a multiple of 2 seconds, as the kernel takes nothing else from
+unprivileged users.
+
+Defaults to "some 100000 2000000", 100ms of stall within 2s.
+
+=item pressure.settle
+
+Seconds between updates after a trigger, until the pressure is below
+I<pressure.quiet> percent again.
+
+Defaults to 2, and 1 (percent)
+
+=item pressure.poll
+
+Seconds between updates when triggers are not available.
+
+Defaults to 10
+
+=back
+
+=head1 SEE ALSO
+
+L<wmii(1)>, L<lua(1)>, the kernel's Documentation/accounting/psi.rst
+
+=head1 LICENCE AND COPYRIGHT
+
+This is free software.  You may redistribute copies of it under the terms of
+the GNU General Public License L<http://www.gnu.org/licenses/gpl.html>.  There
+is NO WARRANTY, to the extent permitted by law.
+
+=cut
+--]]
+
+local wmii = require("wmii")
+local math = require("math")
+local string = require("string")
+local table = require("table")
+local ipairs = ipairs
+local pairs = pairs
+local tostring = tostring
+
+module("pressure")
+api_version=0.1
+
+-- ------------------------------------------------------------
+-- PRESSURE CONFIGURATION VARIABLES
+--
+-- these can be overridden by wmiirc
+
+wmii.set_conf ("pressure.resources", "cpu,memory,io")
+wmii.set_conf ("pressure.trigger", "some 100000 2000000")
+wmii.set_conf ("pressure.settle", 2)
+wmii.set_conf ("pressure.quiet", 1)
+wmii.set_conf ("pressure.poll", 10)
+
+-- ------------------------------------------------------------
+-- MODULE VARIABLES
+
+-- from calm to 50% of the time stalled and up
+local palette = { "#888888",
+                  "#999988",
+                  "#AAAA88",
+                  "#BBBB88",
+
+                  "#CCCC88",
+                  "#CCBB88",
+                  "#CCAA88",
+
+                  "#DD9988",
+                  "#EE8888",
+                  "#FF4444",
+          }
+
+local widget = wmii.widget:new ("800_pressure")
+local timer = nil
+local triggers = {}     -- fds of the triggers, by resource
+local polling = false   -- some resource has no trigger
+
+local function resource_list ()
+        local list = {}
+        local r
+        for r in tostring(wmii.get_conf("pressure.resources")):gmatch("[^,%s]+") do
+                list[#list+1] = r
+        end
+        return list
+end
+
+-- cpu.pressure in a cgroup shows as cpu, like /proc/pressure/cpu
+local function short_name (r)
+        local name = r:match("([^/]+)$"):gsub("%.pressure$", "")
+        return name == "memory" and "mem" or name
+end
+
+-- shows the pressure; returns the worst of it
+local function update ()
+        local worst = 0
+        local parts = {}
+        local _, r
+        for _, r in ipairs(resource_list()) do
+                local p = wmii.pressure(r)
+                if p and p.some then
+                        parts[#parts+1] = string.format("%s %.0f%%",
+                                short_name(r), p.some.avg10)
+                        worst = math.max(worst, p.some.avg10)
+                end
+        end
+
+        local index = math.min(math.floor(worst / 5) + 1, #palette)
+        local p = wmii.palette()
+        local colors = nil
+        if p.normbg then
+                colors = palette[index] .. " " .. p.normbg .. " " .. p.normborder
+        end
+        widget:show(table.concat(parts, " "), colors)
+        return worst
+end
+
+-- follows the pressure after a trigger, and polls where there are none
+local function pressure_timer (time_since_update)
+        if update() >= wmii.get_conf("pressure.quiet") then
+                return wmii.get_conf("pressure.settle")
+        elseif polling then
+                return wmii.get_conf("pressure.poll")
+        end
+        return -1
+end
+
+local function stalled (fd, p, err)
+        update()
+        timer:resched(wmii.get_conf("pressure.settle"))
+end
+
+-- ------------------------------------------------------------
+-- (re)creates the triggers, after the configuration changed
+function setup ()
+        local r, fd
+        for r, fd in pairs(triggers) do
+                wmii.remove_pressure(fd)
+        end
+        triggers = {}
+        polling = false
+
+        local trigger = wmii.get_conf("pressure.trigger")
+        local _
+        for _, r in ipairs(resource_list()) do
+                local fd, err = wmii.add_pressure(r, trigger, stalled)
+                if fd then
+                        triggers[r] = fd
+                else
+                        wmii.log("pressure: no trigger on " .. r .. ", polling: "
+                                .. tostring(err))
+                        polling = true
+                end
+        end
+
+        timer:resched(1)
+end
+
+timer = wmii.timer:new (pressure_timer)
+setup ()
@@ -142,6 +142,7 @@ local wmii   = require("wmii")
 local io     = require("io")
 local os     = require("os")
 local string = require("string")
+local math   = require("math")
 
 module("battery")
 api_version=0.1
@@ -175,6 +176,13 @@ wmii.set_conf ("battery.showrate", true)
 --
 local batteries       = { }
 
+-- run a low/critical action, it is a shell command line
+local function run_action (cmd)
+        if type(cmd) == "string" and cmd:match("%S") then
+                wmii.launch { argv = { "/bin/sh", "-c", cmd } }
+        end
+end
+
 -- The actual work performed here.
 -- parses info, state file and preps for display
 local function update_single_battery ( battery )
@@ -210,7 +218,7 @@ local function update_single_battery ( battery )
 	if batt_percent <= critical then
 		if batt_state == "discharging" and not battery["warned_crit"] then
 			wmii.log("Warning about critical battery.")
-			os.execute(wmii.get_conf("battmon.critical_action"), "&")
+			run_action(wmii.get_conf("battery.critical_action"))
 			battery["warned_crit"] = true
 		end
 		colors = string.gsub(colors, "^%S+ %S+",
@@ -221,7 +229,7 @@ local function update_single_battery ( battery )
 	elseif batt_percent <= low then
 		if batt_state == "discharging" and not battery["warned_low"] then
 			wmii.log("Warning about low battery.")
-			os.execute(wmii.get_conf("battmon.low_action"), "&")
+			run_action(wmii.get_conf("battery.low_action"))
 			battery["warned_low"] = true
 		end
 		colors = string.gsub(colors, "^%S+ %S+",
@@ -258,7 +266,7 @@ local function update_single_battery ( battery )
 			else
 				batt_time = batt:match('remaining capacity:%s+(%d+)') / batt_rate
 			end
-			local hour = string.format("%d",batt_time)
+			local hour = math.floor(batt_time)
 			local min = (batt_time - hour) * 60
 
 			if min > 59 then
@@ -269,7 +277,7 @@ local function update_single_battery ( battery )
 				min = 0
 			end
 			batt_time = hour .. ':'
-			batt_time = batt_time .. string.format("%.2d",min)
+			batt_time = batt_time .. string.format("%.2d",math.floor(min))
 		end
 	end
 
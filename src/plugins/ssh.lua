@@ -18,7 +18,8 @@ into your wmiirc.lua.
 
 This reads ~/.ssh/known_hosts in order to display a menu of hosts (and IP
 addresses) found in the file.  It assumes 'HashKnownHosts no' is set in
-~/.ssh/config (otherwise it displays the hashed hosts).
+~/.ssh/config (otherwise it displays the hashed hosts).  Hosts picked before
+are listed first, the most used and most recent at the top.
 
 =head1 SEE ALSO
 
@@ -47,11 +48,19 @@ local type = type
 module ("ssh")
 api_version=0.1
 
-wmii.set_conf ("ssh.askforuser", true);
+-- the host list is read when the menu is first shown
+--@lazy call show_menu
+
+if wmii.get_conf ("ssh.askforuser") == nil then
+  wmii.set_conf ("ssh.askforuser", true);
+end
 
 local hosts
 local users
 
+-- hosts picked from the menu, most recent first in it
+local host_hist = wmii.history ("ssh", 20)
+
 function load_hosts()
   hosts = {}
 
@@ -86,17 +95,19 @@ function load_users()
 end
 
 function show_menu()
-  local str = wmii.menu(hosts, "ssh:")
+  local str = wmii.menu(wmii.ranked(hosts, host_hist), "ssh:")
   if type(str) == "string" then
-    local cmd = wmii.get_conf("xterm") .. " -e /bin/sh -c \"exec ssh "
+    host_hist:add(str)
+    local argv = wmii.xterm_argv("-e", "ssh")
 	if wmii.get_conf("ssh.askforuser") then
   		local user = wmii.menu(users, "username:")
 		if type(user) == "string" and user ~= "" then
-			cmd = cmd .. "-l " .. user .. " " 
+			argv[#argv+1] = "-l"
+			argv[#argv+1] = user
 		end
 	end
-	cmd = cmd .. str .. "\" &"
-    os.execute(cmd)
+	argv[#argv+1] = str
+    wmii.launch { argv = argv }
   end
 end
 
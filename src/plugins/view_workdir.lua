@@ -26,7 +26,23 @@ local tostring = tostring
 module("view_workdir")
 api_version = 0.1
 
-local view_workdirs = {}
+-- nothing to do until a shell reports a directory or the key is used
+--@lazy event ShellChangeDir
+--@lazy key Mod1-apostrophe
+
+-- "view\tdir" entries, kept across restarts; the newest one for a view
+-- is its directory
+local view_workdirs = wmii.history ("view_workdir", 64)
+
+local function workdir_of (view)
+        local e
+        for e in view_workdirs:walk_reverse_unique() do
+                local v, dir = e:match ("^(.-)\t(.*)$")
+                if v == view then
+                        return dir
+                end
+        end
+end
 
 wmii.add_event_handler("ShellChangeDir", 
         function(ev,arg)
@@ -36,26 +52,30 @@ wmii.add_event_handler("ShellChangeDir",
                         wmii.log("view_workdir: view is " .. type(view))
                         if type(view) == 'string' then
                                 wmii.log("view_workdir: view_workdirs["..view.."] = "..arg)
-                                view_workdirs[view] = arg
+                                local old = workdir_of (view)
+                                if old ~= arg then
+                                        if old then
+                                                view_workdirs:remove (view .. "\t" .. old)
+                                        end
+                                        view_workdirs:push (view .. "\t" .. arg)
+                                end
                         end
                 end
         end)
 
 wmii.add_key_handler("Mod1-apostrophe",
         function (key)
-                local xterm = wmii.get_conf("xterm") or "xterm"
-                local cd_cmd = ''
+                local cwd
 
                 local view = wmii.get_view()
                 wmii.log("view_workdir: view is " .. type(view))
                 if type(view) == 'string' then
-                        local dir = view_workdirs[view]
+                        local dir = workdir_of (view)
                         if type(dir) == 'string' then
-                                cd_cmd = "cd '"..dir.."' ; "
+                                cwd = dir
                         end
                 end
 
-                wmii.log ("    executing: " .. cd_cmd .. xterm)
-                os.execute (cd_cmd .. xterm .. " &")
+                wmii.launch { argv = wmii.xterm_argv(), cwd = cwd }
         end)
 
@@ -150,9 +150,7 @@ widget = wmii.widget:new ("999_volume")
 local function _amixer_command ( cmd )
 
 	wmii.log( "about to run " .. cmd)
-	local file = io.popen( cmd )
-	local status = file:read("*a")
-	file:close()
+	local status = wmii.capture( cmd ) or ""
 
 	local volume
 	-- omfg.  lua regexes are uuuugly